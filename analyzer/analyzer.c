@@ -17,6 +17,7 @@
 
 #include "../common/instr.h"
 #include "../common/v2_instr.h"
+#include "../common/v3_instr.h"
 #include "imm_list.h"
 
 #define CONV_PSEUDO  (0x01)
@@ -26,6 +27,7 @@
 #define IMM_STAT     (0x10)
 #define NOP_DEL_STAT (0x20)
 #define REG_STAT     (0x40)
+#define ENC_STAT     (0x80)
 
 static char *program_name = "analyzer";
 
@@ -34,17 +36,21 @@ static struct imm_list uimm_list;
 static struct imm_list simm_list;
 uint32_t rs_count[32] = {0};
 uint32_t rd_count[32] = {0};
+uint32_t opcode_count[32] = {0};
+uint32_t base_count[32] = {0};
 
 static void usage(void)
 {
-	fprintf(stderr, "Usage: %s [-cpbmidr] FILE\n", program_name);
+	fprintf(stderr, "Usage: %s [-c3pbmidre] FILE\n", program_name);
 	fprintf(stderr, "\t-c\tUse the compressed instruction format\n");
+	fprintf(stderr, "\t-3\tUse the experimental v3 encoding for -c and the estimated size\n");
 	fprintf(stderr, "\t-p\tConvert to pseudo instructions\n");
 	fprintf(stderr, "\t-b\tShow statistics about branch offsets\n");
-	fprintf(stderr, "\t-m\tShow statistics about stack offsets\n");
+	fprintf(stderr, "\t-m\tShow statistics about stack offsets and base registers\n");
 	fprintf(stderr, "\t-i\tShow statistics about immediates\n");
 	fprintf(stderr, "\t-d\tShow statistics about NOPs in delay slots\n");
 	fprintf(stderr, "\t-r\tShow statistics about used registers\n");
+	fprintf(stderr, "\t-e\tShow how often every compressed opcode is usable\n");
 	exit(EXIT_FAILURE);
 }
 
@@ -123,6 +129,7 @@ static void print_stat(int freq[NUM_INSTR], int freq_comp[NUM_INSTR], uint32_t t
 
 	PRINT(MFC0);
 	PRINT(MTC0);
+	PRINT(RFE);
 
 	PRINT(MULT);
 	PRINT(MULTU);
@@ -157,20 +164,14 @@ static void print_stat(int freq[NUM_INSTR], int freq_comp[NUM_INSTR], uint32_t t
 static bool is_compressible(struct instr *instr)
 {
 	assert(instr != NULL);
-	//if (is_compressible_simple(instr) || is_compressible_branch(instr))
-	if (is_compressible_simple(instr))
-		return true;
 
-	if (instr->op == B || instr->op == BAL) {
-		if (-1024 <= instr->simm && instr->simm <= 1022) {
-			return true;
-		}
-	} else if (instr->op == BEQZ || instr->op == BNEZ) {
-		if (-32 <= instr->simm && instr->simm <= 30) {
-			return true;
-		}
-	}
-	return false;
+	/* branch offsets are taken as they are */
+	const struct c_encoding *enc = match_encoding(c_encodings, num_c_encodings, instr);
+	if (enc == NULL)
+		return false;
+
+	opcode_count[enc->opcode]++;
+	return true;
 }
 
 static void update_branch_stat(struct instr *instr)
@@ -308,6 +309,7 @@ static void update_mem_stat(struct instr *instr)
 	case SB:
 	case LB:
 	case LBU:
+		base_count[instr->rs]++;
 		if (instr->rs != 29)
 			return;
 		add_mem_op(instr->op, simm);
@@ -501,6 +503,7 @@ static void update_reg_stat(struct instr *instr)
 
 	case MFC0:
 	case MTC0:
+	case RFE:
 	case J:
 	case NOP:
 	case B:
@@ -561,6 +564,7 @@ static void analyze2(FILE *in, uint32_t flags)
 	bool imm_stat      = (flags & IMM_STAT)     != 0;
 	bool nop_stat      = (flags & NOP_DEL_STAT) != 0;
 	bool reg_stat      = (flags & REG_STAT)     != 0;
+	bool enc_stat      = (flags & ENC_STAT)     != 0;
 
 	uint32_t total_instr = 0;
 
@@ -659,6 +663,11 @@ static void analyze2(FILE *in, uint32_t flags)
 				mem_stat[i].h_count, mem_stat[i].hu_count, mem_stat[i].b_count,
 				mem_stat[i].bu_count);
 		}
+		printf("All mem_op base registers:\n");
+		for (uint32_t i = 0; i < 32; i++) {
+			if (base_count[i] > 0)
+				printf("r%-2u: %4u\n", i, base_count[i]);
+		}
 	}
 
 	if (imm_stat) {
@@ -737,6 +746,19 @@ static void analyze2(FILE *in, uint32_t flags)
 			printf("r%-2u | %4u | %4u\n", i, rs_count[i], rd_count[i]);
 		}
 	}
+
+	if (enc_stat) {
+		printf("opcode | name   | count\n");
+		for (uint8_t opcode = 0; opcode < 32; opcode++) {
+			for (size_t i = 0; i < num_c_encodings; i++) {
+				if (c_encodings[i].opcode == opcode) {
+					printf("  0x%2.2X | %-6s | %5u\n", opcode, c_encodings[i].name,
+						opcode_count[opcode]);
+					break;
+				}
+			}
+		}
+	}
 }
 
 int main(int argc, char *argv[])
@@ -748,12 +770,16 @@ int main(int argc, char *argv[])
 
 	int opt = 0;
 
-	while ((opt = getopt(argc, argv, "mcbpird")) != -1) {
+	while ((opt = getopt(argc, argv, "mc3bpirde")) != -1) {
 		switch (opt) {
 		case 'c':
 			flags |= COMPRESSED;
 			break;
 
+		case '3':
+			use_v3_encodings();
+			break;
+
 		case 'b':
 			flags |= BRANCH_STAT;
 			break;
@@ -778,6 +804,10 @@ int main(int argc, char *argv[])
 			flags |= NOP_DEL_STAT;
 			break;
 
+		case 'e':
+			flags |= ENC_STAT;
+			break;
+
 		case '?':
 		default:
 			usage();
@@ -0,0 +1,44 @@
+# Regression test: renaming the source of a NOT (nor rd, rs, $0)
+# Prints '7'
+
+.set noreorder
+.set noat
+
+.text
+.balign 4
+.global main
+.ent main
+.type main, %function
+
+main:
+	addiu $sp, $sp, -8
+	sw $ra, 4($sp)
+	jal not_sum
+	nop
+	addiu $1, $0, -4
+	sw $2, 0($1)
+	addiu $2, $0, 10
+	sw $2, 0($1)
+	lw $ra, 4($sp)
+	jr $ra
+	addiu $sp, $sp, 8
+
+.end main
+.size main, .-main
+
+.balign 4
+.ent not_sum
+.type not_sum, %function
+
+# returns ~(5 + 3) & 0x3F, which is '7'
+not_sum:
+	addiu $10, $0, 1
+	addiu $4, $0, 5
+	addiu $5, $0, 3
+	addu $10, $4, $5
+	nor $11, $10, $0
+	jr $ra
+	andi $2, $11, 0x3F
+
+.end not_sum
+.size not_sum, .-not_sum
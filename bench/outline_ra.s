@@ -0,0 +1,55 @@
+# Regression test: outlining (-O) a sequence that follows lw $ra
+# The last occurrence is right behind the load and $ra is live after it,
+# so its call would have to save $ra in the delay slot of the load. It
+# stays in place, the other occurrences are outlined. Prints "6"
+
+.set noreorder
+.set noat
+
+.text
+.balign 4
+.global main
+.ent main
+.type main, %function
+
+main:
+	addiu $sp, $sp, -32
+	sw $ra, 28($sp)
+	addiu $4, $0, 0
+
+	# every occurrence adds 2 to $4
+	addiu $8, $0, 1
+	addiu $5, $4, 1
+	addu $6, $5, $5
+	subu $6, $6, $5
+	addiu $4, $6, 1
+	addu $7, $4, $0
+	addu $4, $7, $0
+
+	addiu $8, $8, 1
+	addiu $5, $4, 1
+	addu $6, $5, $5
+	subu $6, $6, $5
+	addiu $4, $6, 1
+	addu $7, $4, $0
+	addu $4, $7, $0
+
+	lw $ra, 28($sp)
+	addiu $5, $4, 1
+	addu $6, $5, $5
+	subu $6, $6, $5
+	addiu $4, $6, 1
+	addu $7, $4, $0
+	addu $4, $7, $0
+
+	addiu $1, $0, -4
+	addiu $2, $4, 48
+	sw $2, 0($1)
+	addiu $2, $0, 10
+	sw $2, 0($1)
+	addiu $sp, $sp, 32
+	jr $ra
+	nop
+
+.end main
+.size main, .-main
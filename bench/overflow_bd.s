@@ -0,0 +1,61 @@
+# Regression test: an overflow in the delay slot of a branch that isn't taken
+# The exception sets BD and EPC points to the branch. The handler counts the
+# exceptions with BD and continues behind the delay slot. Prints "3 3"
+
+.set noreorder
+.set noat
+
+.text
+.balign 4
+.global main
+.ent main
+.type main, %function
+
+main:
+	lui $9, 0x7FFF
+	ori $9, $9, 0xFFFF
+	addiu $16, $0, 0
+	addiu $17, $0, 0
+	addiu $10, $0, 3
+.Lloop:
+	addiu $10, $10, -1
+	bne $10, $10, .Lloop
+	add $11, $9, $9
+	bne $10, $0, .Lloop
+	nop
+
+	addiu $1, $0, -4
+	addiu $2, $16, 48
+	sw $2, 0($1)
+	addiu $2, $0, 32
+	sw $2, 0($1)
+	addiu $2, $17, 48
+	sw $2, 0($1)
+	addiu $2, $0, 10
+	jr $ra
+	sw $2, 0($1)
+
+.end main
+.size main, .-main
+
+.balign 4
+.global exc_handler
+.ent exc_handler
+.type exc_handler, %function
+
+# counts the exceptions in $s0 and those with BD in $s1; with BD the branch
+# wasn't taken and the handler skips it too
+exc_handler:
+	mfc0 $26, $14
+	mfc0 $27, $13
+	addiu $16, $16, 1
+	srl $27, $27, 31
+	addu $17, $17, $27
+	sll $27, $27, 2
+	addu $26, $26, $27
+	addiu $26, $26, 4
+	jr $26
+	rfe
+
+.end exc_handler
+.size exc_handler, .-exc_handler
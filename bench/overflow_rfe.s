@@ -0,0 +1,58 @@
+# Regression test: an overflow handler that returns with jr k0; rfe
+# Every ADD overflows and the handler skips it. The KU/IE stack has to be
+# the same as before the exceptions. Prints "3 1"
+
+.set noreorder
+.set noat
+
+.text
+.balign 4
+.global main
+.ent main
+.type main, %function
+
+main:
+	# IEc = 1
+	addiu $8, $0, 1
+	mtc0 $8, $12
+	lui $9, 0x7FFF
+	ori $9, $9, 0xFFFF
+	addiu $16, $0, 0
+	addiu $10, $0, 3
+.Lloop:
+	add $11, $9, $9
+	addiu $10, $10, -1
+	bne $10, $0, .Lloop
+	nop
+
+	addiu $1, $0, -4
+	addiu $2, $16, 48
+	sw $2, 0($1)
+	addiu $2, $0, 32
+	sw $2, 0($1)
+	mfc0 $8, $12
+	andi $8, $8, 0x3F
+	addiu $2, $8, 48
+	sw $2, 0($1)
+	addiu $2, $0, 10
+	jr $ra
+	sw $2, 0($1)
+
+.end main
+.size main, .-main
+
+.balign 4
+.global exc_handler
+.ent exc_handler
+.type exc_handler, %function
+
+# counts the exceptions in $s0 and continues behind the ADD
+exc_handler:
+	mfc0 $26, $14
+	addiu $16, $16, 1
+	addiu $26, $26, 4
+	jr $26
+	rfe
+
+.end exc_handler
+.size exc_handler, .-exc_handler
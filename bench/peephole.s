@@ -0,0 +1,59 @@
+# Regression test: the peephole rules of the converter (-w)
+# Every rule result feeds the output, the cleared registers start at 1.
+# Prints '8'
+
+.set noreorder
+.set noat
+
+.text
+.balign 4
+.global main
+.ent main
+.type main, %function
+
+main:
+	addiu $2, $0, 1
+	addiu $3, $0, 1
+	addiu $6, $0, 1
+	addiu $7, $0, 1
+	addiu $25, $0, 1
+
+	# can't overflow, $12 = 2
+	addi $8, $0, 2
+	addi $9, $8, 0
+	add $10, $0, $9
+	add $11, $10, $0
+	sub $12, $11, $0
+
+	# small constants, $15 = 3 and $24 = 2
+	ori $13, $0, 3
+	xori $14, $0, 2
+
+	# the same source twice, $5 = ~3 & 4 = 4
+	or $15, $13, $13
+	and $24, $14, $14
+	nor $5, $15, $15
+	andi $5, $5, 4
+	xor $25, $15, $15
+	subu $3, $15, $15
+	slt $2, $15, $15
+	sltu $7, $15, $15
+	sltiu $6, $15, 0
+
+	addu $4, $12, $24
+	addu $4, $4, $5
+	addu $4, $4, $2
+	addu $4, $4, $3
+	addu $4, $4, $6
+	addu $4, $4, $7
+	addu $4, $4, $25
+	addiu $4, $4, 48
+
+	addiu $1, $0, -4
+	sw $4, 0($1)
+	addiu $4, $0, 10
+	jr $ra
+	sw $4, 0($1)
+
+.end main
+.size main, .-main
@@ -0,0 +1,220 @@
+/**
+ * @file blockpack.c
+ * @date 2026-10-18
+ * Compresses a program image (.bin or .c.bin) in blocks of a fixed size
+ * with LZ4 into a block image (common/block_image.h). The simulator (-Z)
+ * decompresses the blocks into the instruction cache on a miss. Every
+ * block is decompressed again to check it.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../bench/lz4.h"
+#include "../common/alloc.h"
+#include "../common/block_image.h"
+
+#define DEFAULT_BLOCK_SIZE (256)
+
+static char *program_name = "blockpack";
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: %s [-b BLOCK_SIZE] [-d] IN-FILE OUT-FILE\n", program_name);
+	fprintf(stderr, "\t-b\tBytes per block, a power of 2 and at least 16. Default: %d\n", DEFAULT_BLOCK_SIZE);
+	fprintf(stderr, "\t-d\tDecompress the block image IN-FILE into the program OUT-FILE\n");
+	exit(EXIT_FAILURE);
+}
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	size_t capacity = 4096;
+	uint8_t *data = alloc(capacity, 1);
+	*size = 0;
+
+	size_t num;
+	while ((num = fread(data + *size, 1, capacity - *size, file)) > 0) {
+		*size += num;
+		if (*size == capacity) {
+			capacity *= 2;
+			data = realloc(data, capacity);
+			if (data == NULL) {
+				fprintf(stderr, "Out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	fclose(file);
+	return data;
+}
+
+static void write_file(const char *path, const uint8_t *data, size_t size)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == NULL || (size > 0 && fwrite(data, size, 1, file) != 1)) {
+		fprintf(stderr, "Couldn't write file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+	fclose(file);
+}
+
+static void write32(uint8_t *p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = (value >> 16) & 0xFF;
+	p[2] = (value >> 8) & 0xFF;
+	p[3] = value & 0xFF;
+}
+
+/* decompresses the block into out, which holds block_length bytes */
+static bool unpack_block(const struct block_image *image, uint32_t block, uint8_t *out)
+{
+	const uint8_t *in = image->data + image->offsets[block];
+	uint32_t len = block_length(image, block);
+
+	if (block_is_raw(image, block)) {
+		memcpy(out, in, len);
+		return true;
+	}
+
+	int size = LZ4_decompress_safe((const char *)in, (char *)out,
+		block_comp_size(image, block), len);
+	return size == (int)len;
+}
+
+static void pack(const char *in_path, const char *out_path, uint32_t block_size)
+{
+	size_t size;
+	uint8_t *in = read_file(in_path, &size);
+	if (size > UINT32_MAX - block_size) {
+		fprintf(stderr, "'%s' is too large\n", in_path);
+		exit(EXIT_FAILURE);
+	}
+
+	struct block_image image = {
+		.block_size = block_size,
+		.size = size,
+		.num_blocks = (size + block_size - 1) / block_size,
+	};
+
+	size_t index_size = BLOCK_IMAGE_HEADER_SIZE + 4 * (image.num_blocks + 1);
+	size_t bound = LZ4_compressBound(block_size);
+	uint8_t *out = alloc(index_size + image.num_blocks * bound, 1);
+	image.offsets = alloc(image.num_blocks + 1, sizeof(*image.offsets));
+	image.data = out + index_size;
+
+	uint32_t offset = 0;
+	uint32_t raw = 0;
+	for (uint32_t i = 0; i < image.num_blocks; i++) {
+		uint32_t len = block_length(&image, i);
+		const char *src = (const char *)in + i * block_size;
+		char *dst = (char *)image.data + offset;
+
+		int comp = LZ4_compress_default(src, dst, len, bound);
+		if (comp <= 0 || (uint32_t)comp >= len) {
+			memcpy(dst, src, len);
+			comp = len;
+			raw++;
+		}
+
+		image.offsets[i] = offset;
+		offset += comp;
+	}
+	image.offsets[image.num_blocks] = offset;
+
+	uint8_t *check = alloc(block_size, 1);
+	for (uint32_t i = 0; i < image.num_blocks; i++) {
+		if (!unpack_block(&image, i, check)
+			|| memcmp(check, in + i * block_size, block_length(&image, i)) != 0) {
+			fprintf(stderr, "Block %u doesn't decompress to its program bytes\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	write32(out, BLOCK_IMAGE_MAGIC);
+	write32(out + 4, image.block_size);
+	write32(out + 8, image.size);
+	write32(out + 12, image.num_blocks);
+	for (uint32_t i = 0; i <= image.num_blocks; i++) {
+		write32(out + BLOCK_IMAGE_HEADER_SIZE + 4 * i, image.offsets[i]);
+	}
+	write_file(out_path, out, index_size + offset);
+
+	fprintf(stderr, "%u blocks of %u bytes (%u stored raw): %zu -> %zu bytes, %zu of them index, %5.1f %%\n",
+		image.num_blocks, block_size, raw, size, index_size + offset, index_size,
+		size > 0 ? 100.0 * (index_size + offset) / size : 0.0);
+
+	free(check);
+	free(image.offsets);
+	free(out);
+	free(in);
+}
+
+static void unpack(const char *in_path, const char *out_path)
+{
+	struct block_image image;
+	block_image_read(&image, in_path);
+
+	uint8_t *out = alloc(image.size, 1);
+	for (uint32_t i = 0; i < image.num_blocks; i++) {
+		if (!unpack_block(&image, i, out + i * image.block_size)) {
+			fprintf(stderr, "Block %u of '%s' is corrupt\n", i, in_path);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	write_file(out_path, out, image.size);
+	free(out);
+	block_image_free(&image);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 0)
+		program_name = argv[0];
+
+	uint32_t block_size = DEFAULT_BLOCK_SIZE;
+	bool decompress = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "b:d")) != -1) {
+		switch (opt) {
+		case 'b':
+			block_size = strtoul(optarg, NULL, 0);
+			if (block_size < 16 || (block_size & (block_size - 1)) != 0 || block_size > (1 << 20)) {
+				fprintf(stderr, "The block size has to be a power of 2 between 16 and %d\n", 1 << 20);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'd':
+			decompress = true;
+			break;
+
+		default:
+			usage();
+		}
+	}
+
+	if (argc - optind != 2)
+		usage();
+
+	if (decompress) {
+		unpack(argv[optind], argv[optind + 1]);
+	} else {
+		pack(argv[optind], argv[optind + 1], block_size);
+	}
+
+	return 0;
+}
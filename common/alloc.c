@@ -0,0 +1,33 @@
+/**
+ * @file alloc.c
+ * @date 2026-10-18
+ */
+
+#include "../common/alloc.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+void *alloc(size_t num, size_t size)
+{
+	void *ptr = calloc(num > 0 ? num : 1, size);
+	if (ptr == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	return ptr;
+}
+
+void *grow(void *ptr, size_t num, size_t *max, size_t size)
+{
+	if (num < *max)
+		return ptr;
+
+	*max = *max > 0 ? 2 * *max : 64;
+	ptr = realloc(ptr, *max * size);
+	if (ptr == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	return ptr;
+}
@@ -0,0 +1,16 @@
+/**
+ * @file alloc.h
+ * @date 2026-10-18
+ */
+
+#include <stddef.h>
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+/* zeroed memory for num elements, at least one; exits if there is none */
+void *alloc(size_t num, size_t size);
+/* makes room for at least one more element behind num, *max is the room */
+void *grow(void *ptr, size_t num, size_t *max, size_t size);
+
+#endif
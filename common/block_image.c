@@ -0,0 +1,104 @@
+/**
+ * @file block_image.c
+ * @date 2026-10-18
+ */
+
+#include "../common/block_image.h"
+#include "../common/alloc.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+static uint32_t read32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void invalid_image(const char *path)
+{
+	fprintf(stderr, "'%s' isn't a valid block image\n", path);
+	exit(EXIT_FAILURE);
+}
+
+void block_image_read(struct block_image *image, const char *path)
+{
+	assert(image != NULL);
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	uint8_t header[BLOCK_IMAGE_HEADER_SIZE];
+	if (fread(header, sizeof(header), 1, file) != 1 || read32(header) != BLOCK_IMAGE_MAGIC)
+		invalid_image(path);
+
+	image->block_size = read32(header + 4);
+	image->size = read32(header + 8);
+	image->num_blocks = read32(header + 12);
+
+	if (image->block_size == 0
+		|| image->num_blocks != (image->size + image->block_size - 1) / image->block_size)
+		invalid_image(path);
+
+	image->offsets = alloc(image->num_blocks + 1, sizeof(*image->offsets));
+
+	for (uint32_t i = 0; i <= image->num_blocks; i++) {
+		uint8_t word[4];
+		if (fread(word, sizeof(word), 1, file) != 1)
+			invalid_image(path);
+
+		image->offsets[i] = read32(word);
+		if (i > 0 && image->offsets[i] < image->offsets[i - 1])
+			invalid_image(path);
+	}
+
+	if (image->offsets[0] != 0)
+		invalid_image(path);
+
+	uint32_t data_size = image->offsets[image->num_blocks];
+	image->data = alloc(data_size, 1);
+
+	if (data_size > 0 && fread(image->data, data_size, 1, file) != 1)
+		invalid_image(path);
+
+	for (uint32_t i = 0; i < image->num_blocks; i++) {
+		if (block_comp_size(image, i) > block_length(image, i))
+			invalid_image(path);
+	}
+
+	fclose(file);
+}
+
+void block_image_free(struct block_image *image)
+{
+	assert(image != NULL);
+
+	free(image->offsets);
+	free(image->data);
+	image->offsets = NULL;
+	image->data = NULL;
+}
+
+uint32_t block_length(const struct block_image *image, uint32_t block)
+{
+	assert(block < image->num_blocks);
+
+	uint32_t start = block * image->block_size;
+	uint32_t left = image->size - start;
+	return left < image->block_size ? left : image->block_size;
+}
+
+uint32_t block_comp_size(const struct block_image *image, uint32_t block)
+{
+	assert(block < image->num_blocks);
+
+	return image->offsets[block + 1] - image->offsets[block];
+}
+
+bool block_is_raw(const struct block_image *image, uint32_t block)
+{
+	return block_comp_size(image, block) == block_length(image, block);
+}
@@ -0,0 +1,40 @@
+/**
+ * @file block_image.h
+ * @date 2026-10-18
+ * A program image that is compressed in blocks of a fixed size, e.g. for
+ * an external flash. The index holds the offset of every compressed block,
+ * so every block can be decompressed on its own. All words are big endian:
+ *
+ *   magic, block size, program size, number of blocks
+ *   offset of every block and the end of the last block
+ *   LZ4 blocks, a block that LZ4 can't shrink is stored as it is
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef BLOCK_IMAGE_H
+#define BLOCK_IMAGE_H
+
+/* "BLKZ" */
+#define BLOCK_IMAGE_MAGIC (0x424C4B5A)
+#define BLOCK_IMAGE_HEADER_SIZE (16)
+
+struct block_image {
+	uint32_t block_size;
+	uint32_t size; /* of the uncompressed program */
+	uint32_t num_blocks;
+	uint32_t *offsets; /* num_blocks + 1 offsets into data */
+	uint8_t *data; /* the compressed blocks */
+};
+
+void block_image_read(struct block_image *image, const char *path);
+void block_image_free(struct block_image *image);
+
+/* the uncompressed size of the block, the last block may be shorter */
+uint32_t block_length(const struct block_image *image, uint32_t block);
+uint32_t block_comp_size(const struct block_image *image, uint32_t block);
+/* the block is stored uncompressed */
+bool block_is_raw(const struct block_image *image, uint32_t block);
+
+#endif
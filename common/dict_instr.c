@@ -0,0 +1,133 @@
+/**
+ * @file dict_instr.c
+ * @date 2026-10-18
+ * The dictionary of the dictionary encoding. The words are looked up with
+ * an open addressing hash table, because the converter looks up every
+ * instruction whenever a pass asks whether it is compressible.
+ */
+
+#include "../common/dict_instr.h"
+#include "../common/v2_instr.h"
+#include "../common/alloc.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+static uint32_t *words = NULL;
+static size_t num_words = 0;
+
+/* index + 1 of the word in every slot, 0 for an empty slot */
+static uint32_t *slots = NULL;
+static uint32_t slot_mask = 0;
+
+static uint32_t hash_word(uint32_t word)
+{
+	return (word * 2654435761u) ^ (word >> 16);
+}
+
+void use_dictionary(const uint32_t *dict, size_t num)
+{
+	if (num > DICT_MAX_ENTRIES) {
+		fprintf(stderr, "The dictionary has more than %d entries\n", DICT_MAX_ENTRIES);
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t num_slots = 16;
+	while (num_slots < 2 * num)
+		num_slots *= 2;
+
+	free(words);
+	free(slots);
+	words = alloc(num, sizeof(*words));
+	slots = alloc(num_slots, sizeof(*slots));
+
+	num_words = num;
+	slot_mask = num_slots - 1;
+	for (size_t i = 0; i < num; i++) {
+		words[i] = dict[i];
+
+		uint32_t slot = hash_word(dict[i]) & slot_mask;
+		while (slots[slot] != 0)
+			slot = (slot + 1) & slot_mask;
+		slots[slot] = i + 1;
+	}
+
+	/* all small instructions are indices now */
+	num_c_encodings = 0;
+}
+
+void read_dictionary(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t *dict = alloc(DICT_MAX_ENTRIES, sizeof(*dict));
+
+	size_t num = 0;
+	uint8_t bytes[4];
+	while (num < DICT_MAX_ENTRIES && fread(bytes, sizeof(bytes), 1, file) == 1) {
+		dict[num++] = ((uint32_t)bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+	}
+
+	if (fread(bytes, 1, 1, file) != 0) {
+		fprintf(stderr, "The dictionary '%s' is too large\n", path);
+		exit(EXIT_FAILURE);
+	}
+	fclose(file);
+
+	use_dictionary(dict, num);
+	free(dict);
+}
+
+bool dict_active(void)
+{
+	return slots != NULL;
+}
+
+size_t dict_entries(void)
+{
+	return num_words;
+}
+
+int32_t dict_find(uint32_t word)
+{
+	if (slots == NULL)
+		return -1;
+
+	uint32_t slot = hash_word(word) & slot_mask;
+	while (slots[slot] != 0) {
+		if (words[slots[slot] - 1] == word)
+			return slots[slot] - 1;
+		slot = (slot + 1) & slot_mask;
+	}
+	return -1;
+}
+
+bool dict_word(uint16_t index, uint32_t *word)
+{
+	assert(word != NULL);
+
+	if (index >= num_words)
+		return false;
+
+	*word = words[index];
+	return true;
+}
+
+bool dict_compressible(const struct instr *instr)
+{
+	assert(instr != NULL);
+
+	if (is_branch(instr->op) || instr->op == J || instr->op == JAL)
+		return false;
+
+	struct instr large = *instr;
+	uint32_t word;
+	large.compressed = false;
+	write_instr_v2(&large, &word);
+	return dict_find(word) >= 0;
+}
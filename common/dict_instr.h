@@ -0,0 +1,39 @@
+/**
+ * @file dict_instr.h
+ * @date 2026-10-18
+ * The dictionary encoding, an alternative to the 16-bit formats that is
+ * similar to CodePack. A small instruction holds the index of a large
+ * instruction in a dictionary of the most frequent instructions of the
+ * program. The large instructions are the same as in v2.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../common/instr.h"
+
+#ifndef DICT_INSTR_H
+#define DICT_INSTR_H
+
+/* the 15 bits behind the high bit of a small instruction */
+#define DICT_MAX_ENTRIES (1 << 15)
+
+/* parse_instr_v2, write_instr_v2 and is_compressible_simple use the
+ * dictionary of the large instruction words afterwards instead of the
+ * 16-bit formats */
+void use_dictionary(const uint32_t *words, size_t num);
+/* reads the big endian words of a dictionary file and uses them */
+void read_dictionary(const char *path);
+bool dict_active(void);
+size_t dict_entries(void);
+
+/* the index of the large instruction word, -1 if it isn't in the dictionary */
+int32_t dict_find(uint32_t word);
+/* the large instruction word at index, false if there is no such entry */
+bool dict_word(uint16_t index, uint32_t *word);
+
+/* Only instructions whose word doesn't depend on the addresses can be in
+ * the dictionary, the branches and jumps stay large. */
+bool dict_compressible(const struct instr *instr);
+
+#endif
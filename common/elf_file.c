@@ -0,0 +1,229 @@
+/**
+ * @file elf_file.c
+ * @date 2026-10-18
+ */
+
+#include "../common/elf_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+uint16_t elf_read16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+uint32_t elf_read32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+void elf_write16(uint8_t *p, uint16_t value)
+{
+	p[0] = value >> 8;
+	p[1] = value & 0xFF;
+}
+
+void elf_write32(uint8_t *p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value & 0xFF;
+}
+
+bool is_elf(const uint8_t *data, size_t size)
+{
+	return size >= EI_NIDENT && memcmp(data, ELFMAG, SELFMAG) == 0;
+}
+
+static void elf_error(const char *msg)
+{
+	fprintf(stderr, "Invalid ELF file: %s\n", msg);
+	exit(EXIT_FAILURE);
+}
+
+/* The header fields are read and written in the order of the file layout */
+#define R16(type, field) hdr->field = elf_read16(p + offsetof(type, field))
+#define R32(type, field) hdr->field = elf_read32(p + offsetof(type, field))
+#define W32(type, field) elf_write32(p + offsetof(type, field), hdr->field)
+
+static void read_shdr(Elf32_Shdr *hdr, const uint8_t *p)
+{
+	R32(Elf32_Shdr, sh_name);
+	R32(Elf32_Shdr, sh_type);
+	R32(Elf32_Shdr, sh_flags);
+	R32(Elf32_Shdr, sh_addr);
+	R32(Elf32_Shdr, sh_offset);
+	R32(Elf32_Shdr, sh_size);
+	R32(Elf32_Shdr, sh_link);
+	R32(Elf32_Shdr, sh_info);
+	R32(Elf32_Shdr, sh_addralign);
+	R32(Elf32_Shdr, sh_entsize);
+}
+
+static void write_shdr(const Elf32_Shdr *hdr, uint8_t *p)
+{
+	W32(Elf32_Shdr, sh_name);
+	W32(Elf32_Shdr, sh_type);
+	W32(Elf32_Shdr, sh_flags);
+	W32(Elf32_Shdr, sh_addr);
+	W32(Elf32_Shdr, sh_offset);
+	W32(Elf32_Shdr, sh_size);
+	W32(Elf32_Shdr, sh_link);
+	W32(Elf32_Shdr, sh_info);
+	W32(Elf32_Shdr, sh_addralign);
+	W32(Elf32_Shdr, sh_entsize);
+}
+
+static void read_phdr(Elf32_Phdr *hdr, const uint8_t *p)
+{
+	R32(Elf32_Phdr, p_type);
+	R32(Elf32_Phdr, p_offset);
+	R32(Elf32_Phdr, p_vaddr);
+	R32(Elf32_Phdr, p_paddr);
+	R32(Elf32_Phdr, p_filesz);
+	R32(Elf32_Phdr, p_memsz);
+	R32(Elf32_Phdr, p_flags);
+	R32(Elf32_Phdr, p_align);
+}
+
+static void write_phdr(const Elf32_Phdr *hdr, uint8_t *p)
+{
+	W32(Elf32_Phdr, p_type);
+	W32(Elf32_Phdr, p_offset);
+	W32(Elf32_Phdr, p_vaddr);
+	W32(Elf32_Phdr, p_paddr);
+	W32(Elf32_Phdr, p_filesz);
+	W32(Elf32_Phdr, p_memsz);
+	W32(Elf32_Phdr, p_flags);
+	W32(Elf32_Phdr, p_align);
+}
+
+void elf_parse(struct elf_file *elf, uint8_t *data, size_t size)
+{
+	assert(elf != NULL);
+
+	if (!is_elf(data, size) || size < sizeof(Elf32_Ehdr))
+		elf_error("no ELF header");
+
+	if (data[EI_CLASS] != ELFCLASS32 || data[EI_DATA] != ELFDATA2MSB)
+		elf_error("only 32-bit big-endian files are supported");
+
+	elf->data = data;
+	elf->size = size;
+
+	Elf32_Ehdr *hdr = &elf->ehdr;
+	const uint8_t *p = data;
+	memcpy(hdr->e_ident, data, EI_NIDENT);
+	R16(Elf32_Ehdr, e_type);
+	R16(Elf32_Ehdr, e_machine);
+	R32(Elf32_Ehdr, e_version);
+	R32(Elf32_Ehdr, e_entry);
+	R32(Elf32_Ehdr, e_phoff);
+	R32(Elf32_Ehdr, e_shoff);
+	R32(Elf32_Ehdr, e_flags);
+	R16(Elf32_Ehdr, e_ehsize);
+	R16(Elf32_Ehdr, e_phentsize);
+	R16(Elf32_Ehdr, e_phnum);
+	R16(Elf32_Ehdr, e_shentsize);
+	R16(Elf32_Ehdr, e_shnum);
+	R16(Elf32_Ehdr, e_shstrndx);
+
+	if (hdr->e_machine != EM_MIPS)
+		elf_error("not a MIPS file");
+
+	if (hdr->e_shnum == 0 || hdr->e_shentsize != sizeof(Elf32_Shdr) ||
+		hdr->e_shoff > size || (size - hdr->e_shoff) / sizeof(Elf32_Shdr) < hdr->e_shnum)
+		elf_error("invalid section header table");
+
+	if (hdr->e_phnum != 0 && (hdr->e_phentsize != sizeof(Elf32_Phdr) ||
+		hdr->e_phoff > size || (size - hdr->e_phoff) / sizeof(Elf32_Phdr) < hdr->e_phnum))
+		elf_error("invalid program header table");
+
+	if (hdr->e_shstrndx >= hdr->e_shnum)
+		elf_error("invalid section name table");
+
+	elf->shdr = calloc(hdr->e_shnum, sizeof(*elf->shdr));
+	elf->phdr = calloc(hdr->e_phnum + 1, sizeof(*elf->phdr));
+	if (elf->shdr == NULL || elf->phdr == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = 0; i < hdr->e_shnum; i++) {
+		Elf32_Shdr *shdr = &elf->shdr[i];
+		read_shdr(shdr, data + hdr->e_shoff + i * sizeof(Elf32_Shdr));
+
+		if (shdr->sh_type != SHT_NOBITS &&
+			(shdr->sh_offset > size || size - shdr->sh_offset < shdr->sh_size))
+			elf_error("section is outside of the file");
+	}
+
+	for (size_t i = 0; i < hdr->e_phnum; i++) {
+		read_phdr(&elf->phdr[i], data + hdr->e_phoff + i * sizeof(Elf32_Phdr));
+	}
+}
+
+void elf_update(struct elf_file *elf)
+{
+	Elf32_Ehdr *hdr = &elf->ehdr;
+	uint8_t *p = elf->data;
+	W32(Elf32_Ehdr, e_entry);
+
+	for (size_t i = 0; i < hdr->e_shnum; i++) {
+		write_shdr(&elf->shdr[i], elf->data + hdr->e_shoff + i * sizeof(Elf32_Shdr));
+	}
+
+	for (size_t i = 0; i < hdr->e_phnum; i++) {
+		write_phdr(&elf->phdr[i], elf->data + hdr->e_phoff + i * sizeof(Elf32_Phdr));
+	}
+}
+
+void elf_free(struct elf_file *elf)
+{
+	free(elf->shdr);
+	free(elf->phdr);
+	elf->shdr = NULL;
+	elf->phdr = NULL;
+}
+
+const char *elf_section_name(struct elf_file *elf, size_t index)
+{
+	assert(index < elf->ehdr.e_shnum);
+	Elf32_Shdr *strtab = &elf->shdr[elf->ehdr.e_shstrndx];
+
+	if (elf->shdr[index].sh_name >= strtab->sh_size)
+		return "";
+
+	return (const char *)elf->data + strtab->sh_offset + elf->shdr[index].sh_name;
+}
+
+size_t elf_find_section(struct elf_file *elf, const char *name)
+{
+	for (size_t i = 1; i < elf->ehdr.e_shnum; i++) {
+		if (strcmp(elf_section_name(elf, i), name) == 0)
+			return i;
+	}
+
+	return 0;
+}
+
+uint8_t *elf_section_data(struct elf_file *elf, size_t index)
+{
+	assert(index < elf->ehdr.e_shnum);
+	return elf->data + elf->shdr[index].sh_offset;
+}
+
+size_t elf_num_entries(struct elf_file *elf, size_t index)
+{
+	assert(index < elf->ehdr.e_shnum);
+	Elf32_Shdr *shdr = &elf->shdr[index];
+
+	if (shdr->sh_entsize == 0)
+		return 0;
+
+	return shdr->sh_size / shdr->sh_entsize;
+}
+
@@ -0,0 +1,45 @@
+/**
+ * @file elf_file.h
+ * @date 2026-10-18
+ * Access to 32-bit big-endian MIPS ELF files that are kept in memory. The
+ * headers are converted to the host byte order, the contents of the
+ * sections are modified in place and keep the big-endian byte order.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <elf.h>
+
+#ifndef ELF_FILE_H
+#define ELF_FILE_H
+
+struct elf_file {
+	uint8_t *data; /* the whole file */
+	size_t size;
+	Elf32_Ehdr ehdr;
+	Elf32_Shdr *shdr;
+	Elf32_Phdr *phdr;
+};
+
+bool is_elf(const uint8_t *data, size_t size);
+
+/* exits if the file isn't a 32-bit big-endian MIPS ELF file */
+void elf_parse(struct elf_file *elf, uint8_t *data, size_t size);
+/* writes the modified headers back to the file data */
+void elf_update(struct elf_file *elf);
+void elf_free(struct elf_file *elf);
+
+const char *elf_section_name(struct elf_file *elf, size_t index);
+/* returns the index of the section or 0 if there is no such section */
+size_t elf_find_section(struct elf_file *elf, const char *name);
+uint8_t *elf_section_data(struct elf_file *elf, size_t index);
+size_t elf_num_entries(struct elf_file *elf, size_t index);
+
+uint16_t elf_read16(const uint8_t *p);
+uint32_t elf_read32(const uint8_t *p);
+void elf_write16(uint8_t *p, uint16_t value);
+void elf_write32(uint8_t *p, uint32_t value);
+
+#endif
+
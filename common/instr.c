@@ -192,6 +192,12 @@ static enum operation parse_cop0(uint32_t instr)
 	case 0x04: /* MTC0 */
 		return MTC0;
 
+	case 0x10: /* CO */
+		if (get_func(instr) == 0x10)
+			return RFE;
+		fprintf(stderr, "Unknown instruction: %8.8X\n", instr);
+		return INVALID_OP;
+
 	default:
 		fprintf(stderr, "Unknown instruction: %8.8X\n", instr);
 		return INVALID_OP;
@@ -469,6 +475,8 @@ void conv_to_pseudo(struct instr *out)
 			if (rt == 0) {
 				out->rt = rs;
 			}
+			/* the passes only track rt */
+			out->rs = 0;
 		}
 		break;
 
@@ -627,102 +635,178 @@ bool is_branch(enum operation op)
 	}
 }
 
-bool contains_imm(enum operation op)
+/* stores pointers to the fields of the registers that the instruction
+ * reads in regs and returns their number */
+int get_src_regs(struct instr *instr, uint8_t *regs[2])
 {
-	switch(op) {
+	switch(instr->op) {
+		case SLLV:
+		case SRLV:
+		case SRAV:
+		case ADD:
+		case ADDU:
+		case SUB:
+		case SUBU:
+		case AND:
+		case OR:
+		case XOR:
+		case NOR:
+		case SLT:
+		case SLTU:
+		case MULT:
+		case MULTU:
+		case DIV:
+		case DIVU:
+		case SB:
+		case SH:
+		case SW:
+		case BEQ:
+		case BNE:
+			regs[0] = &instr->rs;
+			regs[1] = &instr->rt;
+			return 2;
+
+		case ADDI:
+		case ADDIU:
 		case ANDI:
-		case LUI: /* it's neither signed or unsigned on 32bit but signed on 64bit */
 		case ORI:
 		case XORI:
-			return true;
+		case SLTI:
+		case SLTIU:
+		case MTHI:
+		case MTLO:
+		case LB:
+		case LH:
+		case LW:
+		case LBU:
+		case LHU:
+		case BLTZ:
+		case BGEZ:
+		case BLTZAL:
+		case BGEZAL:
+		case BLEZ:
+		case BGTZ:
+		case BEQZ:
+		case BNEZ:
+		case JR:
+		case JALR:
+		case SEQZ:
+		case SLTZ:
+			regs[0] = &instr->rs;
+			return 1;
+
+		case SLL:
+		case SRL:
+		case SRA:
+		case MTC0:
+		case MOV:
+		case NOT:
+		case NEG:
+		case SNEZ:
+			regs[0] = &instr->rt;
+			return 1;
 
 		default:
-			return false;
+			return 0;
 	}
 }
 
-bool contains_simm(enum operation op)
+/* returns the field of the register that the instruction writes or NULL */
+uint8_t *get_dest_field(struct instr *instr)
 {
-	switch(op) {
+	switch(instr->op) {
+		case SLL:
+		case SRL:
+		case SRA:
+		case SLLV:
+		case SRLV:
+		case SRAV:
+		case ADD:
+		case ADDU:
+		case SUB:
+		case SUBU:
+		case AND:
+		case OR:
+		case XOR:
+		case NOR:
+		case SLT:
+		case SLTU:
+		case MFHI:
+		case MFLO:
+		case JALR:
+		case MOV:
+		case CLEAR:
+		case NOT:
+		case NEG:
+		case SNEZ:
+		case SLTZ:
+		case LSI:
+			return &instr->rd;
+
 		case ADDI:
 		case ADDIU:
+		case ANDI:
+		case ORI:
+		case XORI:
+		case LUI:
+		case LB:
+		case LH:
+		case LW:
+		case LBU:
+		case LHU:
 		case SLTI:
 		case SLTIU:
-			return true;
+		case MFC0:
+		case SEQZ: /* only created from SLTIU */
+			return &instr->rt;
 
 		default:
-			return false;
+			return NULL;
 	}
 }
 
-
-bool is_compressible_simple(struct instr *instr)
+/* returns the register that the instruction writes or -1 */
+int get_dest_reg(struct instr *instr)
 {
-	assert(instr != NULL);
-
-	uint8_t rs = instr->rs;
-	uint8_t rt = instr->rt;
-	uint8_t rd = instr->rd;
-	uint16_t imm = instr->imm;
-	int16_t simm = instr->simm;
-
 	switch(instr->op) {
-	case NOP:
-	case MOV:
-	case CLEAR:
-	case NOT:
-	case NEG:
-	case LSI:
-	case JR:
-	case JALR:
-		return true;
+		case BLTZAL:
+		case BGEZAL:
+		case JAL:
+		case BAL:
+			return 31;
 
-	case SLL:
-	case SRL:
-	case SRA:
-		if (rd == rt)
-			return true;
-		return false;
+		default: {
+			uint8_t *field = get_dest_field(instr);
+			return field != NULL ? *field : -1;
+		}
+	}
+}
 
-	case ADDU:
-	case OR:
-	case XOR:
-		if (rd == rs || rd == rt)
-			return true;
-		return false;
-	
-	case SUBU:
-	case SLTU:
-		if (rd == rs)
+bool contains_imm(enum operation op)
+{
+	switch(op) {
+		case ANDI:
+		case LUI: /* it's neither signed or unsigned on 32bit but signed on 64bit */
+		case ORI:
+		case XORI:
 			return true;
-		return false;
 
-	case ADDIU:
-		if (rs == rt && -16 <= simm && simm <= 15)
-			return true;
-		return false;
+		default:
+			return false;
+	}
+}
 
-	case ANDI:
-		if (rs == rt && imm <= 31)
+bool contains_simm(enum operation op)
+{
+	switch(op) {
+		case ADDI:
+		case ADDIU:
+		case SLTI:
+		case SLTIU:
 			return true;
-		return false;
 
-		/*
-	case LUI:
-		if (-16 <= simm && simm <= 15)
-			return true;
-		return false;
-		*/
-	
-	case SW:
-	case LW:
-		/* Stack pointer is $29 */
-		if (rs == 29 && imm % 4 == 0 && imm < 128)
-			return true;
-		return false;
-	
-	default:
-		return false;
+		default:
+			return false;
 	}
 }
 
@@ -751,6 +835,7 @@ void conv_to_native(struct instr *out)
 
 	case NOT:
 		out->op = NOR;
+		out->rs = 0;
 		break;
 
 	case NEG:
@@ -770,12 +855,15 @@ void conv_to_native(struct instr *out)
 		out->rt = 0;
 		break;
 
+	/* rt may still hold the register that rs was taken from */
 	case BEQZ:
 		out->op = BEQ;
+		out->rt = 0;
 		break;
 
 	case BNEZ:
 		out->op = BNE;
+		out->rt = 0;
 		break;
 
 	case SEQZ:
@@ -1080,6 +1168,15 @@ uint32_t write_instr(struct instr *instr)
 
 	case MTLO:
 		return write_r(0x00, instr->rs, 0x00, 0x00, 0x00, 0x13);
+
+	case MFC0:
+		return write_r(0x10, 0x00, instr->rt, instr->rd, 0x00, 0x00);
+
+	case MTC0:
+		return write_r(0x10, 0x04, instr->rt, instr->rd, 0x00, 0x00);
+
+	case RFE:
+		return write_r(0x10, 0x10, 0x00, 0x00, 0x00, 0x10);
 	
 	case SYSCALL:
 		return write_r(0x00, 0x00, 0x00, 0x00, 0x00, 0x0C);
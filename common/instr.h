@@ -79,6 +79,7 @@ enum operation {
 	/* COP0 instructions */
 	MFC0,
 	MTC0,
+	RFE, /* restores the KU/IE stack of the Status register */
 
 	/* Instructions to stop simulation */
 	BREAK,
@@ -123,8 +124,9 @@ void conv_to_native(struct instr *out);
 bool is_branch(enum operation op);
 bool contains_imm(enum operation op);
 bool contains_simm(enum operation op);
-
-bool is_compressible_simple(struct instr *instr);
+uint8_t *get_dest_field(struct instr *instr);
+int get_dest_reg(struct instr *instr);
+int get_src_regs(struct instr *instr, uint8_t *regs[2]);
 
 #endif
 
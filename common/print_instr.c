@@ -8,7 +8,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 
-#define PRINT(...) fprintf(stdout, __VA_ARGS__)
+#define PRINT(...) fprintf(out, __VA_ARGS__)
 #define PRINT_R(op)  PRINT("%s r%d, r%d, r%d\n", op, instr->rd, instr->rs, instr->rt)
 #define PRINT_RMD(op)  PRINT("%s r%d, r%d\n", op, instr->rs, instr->rt)
 #define PRINT_R2(op)  PRINT("%s r%d, r%d\n", op, instr->rd, instr->rt)
@@ -21,6 +21,11 @@
 #define PRINT_LS(op) PRINT("%s r%d, %d(r%d)\n", op, instr->rt, instr->simm, instr->rs)
 
 void print_instr(struct instr *instr)
+{
+	fprint_instr(stdout, instr);
+}
+
+void fprint_instr(FILE *out, struct instr *instr)
 {
 	switch (instr->op) {
 	case SLL:
@@ -231,6 +236,18 @@ void print_instr(struct instr *instr)
 		PRINT_R1("mflo");
 		break;
 
+	case MFC0:
+		PRINT("mfc0 r%d, $%d\n", instr->rt, instr->rd);
+		break;
+
+	case MTC0:
+		PRINT("mtc0 r%d, $%d\n", instr->rt, instr->rd);
+		break;
+
+	case RFE:
+		PRINT("rfe\n");
+		break;
+
 	/* pseudo instructions */
 	case NOP:
 		PRINT("nop\n");
@@ -5,11 +5,13 @@
  */
 
 #include "instr.h"
+#include <stdio.h>
 
 #ifndef PRINT_INSTR_H
 #define PRINT_INSTR_H
 
 void print_instr(struct instr *instr);
+void fprint_instr(FILE *out, struct instr *instr);
 
 #endif
 
@@ -5,32 +5,390 @@
  */
 
 #include "../common/v2_instr.h"
+#include "../common/v3_instr.h"
+#include "../common/dict_instr.h"
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
 
-/* 5 bit opcodes for the small instructions (without the high bit set) */
-#define C_MOV   (0x00)
-#define C_ADDU  (0x01)
-#define C_SUBU  (0x02)
-#define C_OR    (0x03)
-#define C_XOR   (0x04)
-#define C_NEG   (0x05)
-#define C_NOT   (0x06)
-#define C_SLTU  (0x07)
-#define C_ADDIU (0x08)
-#define C_ANDI  (0x09)
-#define C_SLL   (0x0A)
-#define C_SRL   (0x0B)
-#define C_SRA   (0x0C)
-#define C_LSI   (0x0D)
-#define C_B     (0x0E)
-#define C_BAL   (0x0F)
-#define C_BEQZ  (0x10)
-#define C_BNEZ  (0x11)
-#define C_JALR  (0x12)
-#define C_LWS   (0x13)
-#define C_SWS   (0x14)
+/*
+ * The small instructions. An instruction is encoded by the first entry of
+ * its operation that it fits, a small instruction is decoded by the first
+ * entry of its opcode whose unused fields are 0.
+ */
+const struct c_encoding v2_encodings[] = {
+	/* name    opcode format       op     rd         rs          rt          imm           commutative */
+	{ "mov",   0x00, C_FORMAT_R, MOV,   C_REG_RDS,  C_REG_NONE, C_REG_RT,   C_IMM_NONE,   false },
+	{ "mov",   0x00, C_FORMAT_R, NOP,   C_REG_NONE, C_REG_NONE, C_REG_NONE, C_IMM_NONE,   false },
+	{ "mov",   0x00, C_FORMAT_R, CLEAR, C_REG_RDS,  C_REG_NONE, C_REG_NONE, C_IMM_NONE,   false },
+	{ "addu",  0x01, C_FORMAT_R, ADDU,  C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,   true  },
+	{ "subu",  0x02, C_FORMAT_R, SUBU,  C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,   false },
+	{ "or",    0x03, C_FORMAT_R, OR,    C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,   true  },
+	{ "xor",   0x04, C_FORMAT_R, XOR,   C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,   true  },
+	{ "neg",   0x05, C_FORMAT_R, NEG,   C_REG_RDS,  C_REG_NONE, C_REG_RT,   C_IMM_NONE,   false },
+	{ "not",   0x06, C_FORMAT_R, NOT,   C_REG_RDS,  C_REG_NONE, C_REG_RT,   C_IMM_NONE,   false },
+	{ "sltu",  0x07, C_FORMAT_R, SLTU,  C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,   false },
+	{ "addiu", 0x08, C_FORMAT_I, ADDIU, C_REG_NONE, C_REG_RDS,  C_REG_RDS,  C_IMM_S5,     false },
+	{ "andi",  0x09, C_FORMAT_I, ANDI,  C_REG_NONE, C_REG_RDS,  C_REG_RDS,  C_IMM_U5,     false },
+	{ "sll",   0x0A, C_FORMAT_I, SLL,   C_REG_RDS,  C_REG_NONE, C_REG_RDS,  C_IMM_SHAMT,  false },
+	{ "srl",   0x0B, C_FORMAT_I, SRL,   C_REG_RDS,  C_REG_NONE, C_REG_RDS,  C_IMM_SHAMT,  false },
+	{ "sra",   0x0C, C_FORMAT_I, SRA,   C_REG_RDS,  C_REG_NONE, C_REG_RDS,  C_IMM_SHAMT,  false },
+	{ "lsi",   0x0D, C_FORMAT_I, LSI,   C_REG_NONE, C_REG_NONE, C_REG_RDS,  C_IMM_S5,     false },
+	{ "b",     0x0E, C_FORMAT_B, B,     C_REG_NONE, C_REG_NONE, C_REG_NONE, C_IMM_S10_X2, false },
+	{ "bal",   0x0F, C_FORMAT_B, BAL,   C_REG_NONE, C_REG_NONE, C_REG_NONE, C_IMM_S10_X2, false },
+	{ "beqz",  0x10, C_FORMAT_I, BEQZ,  C_REG_NONE, C_REG_RDS,  C_REG_NONE, C_IMM_S5_X2,  false },
+	{ "bnez",  0x11, C_FORMAT_I, BNEZ,  C_REG_NONE, C_REG_RDS,  C_REG_NONE, C_IMM_S5_X2,  false },
+	{ "jalr",  0x12, C_FORMAT_R, JR,    C_REG_NONE, C_REG_RT,   C_REG_NONE, C_IMM_NONE,   false },
+	{ "jalr",  0x12, C_FORMAT_R, JALR,  C_REG_RDS,  C_REG_RT,   C_REG_NONE, C_IMM_NONE,   false },
+	{ "lws",   0x13, C_FORMAT_I, LW,    C_REG_NONE, C_REG_SP,   C_REG_RDS,  C_IMM_U5_X4,  false },
+	{ "sws",   0x14, C_FORMAT_I, SW,    C_REG_NONE, C_REG_SP,   C_REG_RDS,  C_IMM_U5_X4,  false },
+	{ "lwb",   0x15, C_FORMAT_M, LW,    C_REG_NONE, C_REG_BASE, C_REG_RDS,  C_IMM_U3_X4,  false },
+	{ "swb",   0x16, C_FORMAT_M, SW,    C_REG_NONE, C_REG_BASE, C_REG_RDS,  C_IMM_U3_X4,  false },
+	{ "lhb",   0x17, C_FORMAT_M, LH,    C_REG_NONE, C_REG_BASE, C_REG_RDS,  C_IMM_U3_X2,  false },
+	{ "lhub",  0x18, C_FORMAT_M, LHU,   C_REG_NONE, C_REG_BASE, C_REG_RDS,  C_IMM_U3_X2,  false },
+	{ "shb",   0x19, C_FORMAT_M, SH,    C_REG_NONE, C_REG_BASE, C_REG_RDS,  C_IMM_U3_X2,  false },
+	{ "lbb",   0x1A, C_FORMAT_M, LB,    C_REG_NONE, C_REG_BASE, C_REG_RDS,  C_IMM_U3,     false },
+	{ "lbub",  0x1B, C_FORMAT_M, LBU,   C_REG_NONE, C_REG_BASE, C_REG_RDS,  C_IMM_U3,     false },
+	{ "sbb",   0x1C, C_FORMAT_M, SB,    C_REG_NONE, C_REG_BASE, C_REG_RDS,  C_IMM_U3,     false },
+	{ "lw0",   0x1D, C_FORMAT_R, LW,    C_REG_NONE, C_REG_RT,   C_REG_RDS,  C_IMM_ZERO,   false },
+	{ "sw0",   0x1E, C_FORMAT_R, SW,    C_REG_NONE, C_REG_RT,   C_REG_RDS,  C_IMM_ZERO,   false },
+};
+
+/* The base registers of the M format, pointers in arguments and results are
+ * the most common bases besides $sp (analyzer -m) */
+const uint8_t v2_base_regs[4] = { 4, 5, 2, 3 };
+
+const size_t num_v2_encodings = sizeof(v2_encodings) / sizeof(v2_encodings[0]);
+
+const struct c_encoding *c_encodings = v2_encodings;
+size_t num_c_encodings = sizeof(v2_encodings) / sizeof(v2_encodings[0]);
+
+/* The register fields of a format follow the opcode, the immediate is in
+ * the lowest bits. 3 bit register fields index the registers of v3_regs,
+ * 2 bit register fields the ones of v2_base_regs. */
+struct c_layout {
+	uint8_t num_regs;
+	uint8_t reg_width[3];
+	uint8_t imm_width;
+};
+
+static const struct c_layout layouts[] = {
+	[C_FORMAT_R]  = { 2, { 5, 5, 0 }, 0 },
+	[C_FORMAT_I]  = { 1, { 5, 0, 0 }, 5 },
+	[C_FORMAT_B]  = { 0, { 0, 0, 0 }, 10 },
+	[C_FORMAT_M]  = { 2, { 5, 2, 0 }, 3 },
+	[C_FORMAT_R3] = { 3, { 3, 3, 3 }, 0 },
+	[C_FORMAT_I3] = { 2, { 3, 3, 0 }, 4 },
+	[C_FORMAT_I7] = { 1, { 3, 0, 0 }, 7 }
+};
+
+struct c_imm_kind {
+	uint8_t width;
+	bool is_signed;
+	uint8_t scale;
+};
+
+static const struct c_imm_kind imm_kinds[] = {
+	[C_IMM_NONE]   = { 0,  false, 1 },
+	[C_IMM_ZERO]   = { 0,  false, 1 },
+	[C_IMM_S5]     = { 5,  true,  1 },
+	[C_IMM_U5]     = { 5,  false, 1 },
+	[C_IMM_SHAMT]  = { 5,  false, 1 },
+	[C_IMM_U5_X4]  = { 5,  false, 4 },
+	[C_IMM_S5_X2]  = { 5,  true,  2 },
+	[C_IMM_S10_X2] = { 10, true,  2 },
+	[C_IMM_S4]     = { 4,  true,  1 },
+	[C_IMM_U4_X4]  = { 4,  false, 4 },
+	[C_IMM_S7]     = { 7,  true,  1 },
+	[C_IMM_U7_X4]  = { 7,  false, 4 },
+	[C_IMM_S7_X2]  = { 7,  true,  2 },
+	[C_IMM_U3]     = { 3,  false, 1 },
+	[C_IMM_U3_X2]  = { 3,  false, 2 },
+	[C_IMM_U3_X4]  = { 3,  false, 4 }
+};
+
+static int32_t sign_extend(uint16_t bits, unsigned width)
+{
+	int32_t value = bits & ((1 << width) - 1);
+	if (value >= (1 << (width - 1))) {
+		value -= 1 << width;
+	}
+	return value;
+}
+
+bool is_branch_imm(enum c_imm imm)
+{
+	return imm == C_IMM_S5_X2 || imm == C_IMM_S7_X2 || imm == C_IMM_S10_X2;
+}
+
+bool imm_fits(enum c_imm imm, int32_t value)
+{
+	const struct c_imm_kind *kind = &imm_kinds[imm];
+
+	if (imm == C_IMM_NONE)
+		return true;
+
+	if (kind->width == 0)
+		return value == 0;
+
+	if (value % kind->scale != 0)
+		return false;
+
+	value /= kind->scale;
+	if (kind->is_signed)
+		return -(1 << (kind->width - 1)) <= value && value < (1 << (kind->width - 1));
+	return 0 <= value && value < (1 << kind->width);
+}
+
+static int32_t get_imm(enum c_imm imm, const struct instr *instr)
+{
+	if (imm == C_IMM_SHAMT)
+		return instr->shamt;
+
+	if (imm_kinds[imm].width > 0 && !imm_kinds[imm].is_signed)
+		return (uint16_t)instr->imm;
+
+	return instr->simm;
+}
+
+/* the bits of the immediate in the instruction */
+static uint16_t imm_bits(enum c_imm imm, int32_t value)
+{
+	const struct c_imm_kind *kind = &imm_kinds[imm];
+	return (value / kind->scale) & ((1 << kind->width) - 1);
+}
+
+static int32_t imm_value(enum c_imm imm, uint16_t bits)
+{
+	const struct c_imm_kind *kind = &imm_kinds[imm];
+
+	if (kind->width == 0)
+		return 0;
+
+	if (kind->is_signed)
+		return sign_extend(bits, kind->width) * kind->scale;
+	return (bits & ((1 << kind->width) - 1)) * kind->scale;
+}
+
+/* the index of the register field or -1 */
+static int reg_field(enum c_reg where)
+{
+	switch(where) {
+	case C_REG_RDS:
+	case C_REG_RD3:
+		return 0;
+
+	case C_REG_RT:
+	case C_REG_RS3:
+	case C_REG_BASE:
+		return 1;
+
+	case C_REG_RT3:
+		return 2;
+
+	default:
+		return -1;
+	}
+}
+
+/* the width of the field that the register kind needs */
+static uint8_t reg_kind_width(enum c_reg where)
+{
+	switch(where) {
+	case C_REG_RD3:
+	case C_REG_RS3:
+	case C_REG_RT3:
+		return 3;
+
+	case C_REG_BASE:
+		return 2;
+
+	default:
+		return 5;
+	}
+}
+
+static unsigned reg_shift(const struct c_layout *layout, int field)
+{
+	unsigned shift = 10;
+	for (int f = 0; f <= field; f++) {
+		shift -= layout->reg_width[f];
+	}
+	return shift;
+}
+
+/* the registers of the field or NULL if it holds the register number */
+static const uint8_t *reg_map(uint8_t width)
+{
+	if (width == 3)
+		return v3_regs;
+	if (width == 2)
+		return v2_base_regs;
+	return NULL;
+}
+
+/* puts the register into its field, fails if the field holds another one */
+static bool put_reg(const struct c_layout *layout, enum c_reg where, uint8_t reg, int fields[3])
+{
+	switch(where) {
+	case C_REG_NONE:
+		return true;
+
+	case C_REG_ZERO:
+		return reg == 0;
+
+	case C_REG_SP:
+		return reg == 29;
+
+	default:
+		break;
+	}
+
+	int field = reg_field(where);
+	assert(0 <= field && field < layout->num_regs);
+
+	uint8_t width = layout->reg_width[field];
+	assert(width == reg_kind_width(where));
+
+	const uint8_t *map = reg_map(width);
+	int value = reg;
+	if (map != NULL) {
+		for (value = 0; value < (1 << width) && map[value] != reg; value++)
+			;
+		if (value == (1 << width))
+			return false;
+	}
+
+	if (fields[field] >= 0 && fields[field] != value)
+		return false;
+	fields[field] = value;
+	return true;
+}
+
+static uint8_t get_reg(const struct c_layout *layout, enum c_reg where, uint16_t code)
+{
+	switch(where) {
+	case C_REG_NONE:
+	case C_REG_ZERO:
+		return 0;
+
+	case C_REG_SP:
+		return 29;
+
+	default:
+		break;
+	}
+
+	int field = reg_field(where);
+	uint8_t width = layout->reg_width[field];
+	const uint8_t *map = reg_map(width);
+	uint8_t value = (code >> reg_shift(layout, field)) & ((1 << width) - 1);
+	return map != NULL ? map[value] : value;
+}
+
+/* encodes the instruction, returns false if it doesn't fit the encoding */
+static bool encode(const struct c_encoding *enc, const struct instr *instr, bool swap,
+	uint16_t *code)
+{
+	const struct c_layout *layout = &layouts[enc->format];
+	assert(imm_kinds[enc->imm].width == layout->imm_width);
+
+	int fields[3] = { -1, -1, -1 };
+	uint8_t rs = swap ? instr->rt : instr->rs;
+	uint8_t rt = swap ? instr->rs : instr->rt;
+
+	if (!put_reg(layout, enc->rd, instr->rd, fields) || !put_reg(layout, enc->rs, rs, fields) ||
+		!put_reg(layout, enc->rt, rt, fields))
+		return false;
+
+	int32_t value = get_imm(enc->imm, instr);
+	if (!imm_fits(enc->imm, value))
+		return false;
+
+	assert(enc->opcode < 32);
+	*code = 0x8000 | (enc->opcode << 10);
+	for (int f = 0; f < layout->num_regs; f++) {
+		if (fields[f] >= 0)
+			*code |= fields[f] << reg_shift(layout, f);
+	}
+	*code |= imm_bits(enc->imm, value);
+
+	return true;
+}
+
+const struct c_encoding *match_encoding(const struct c_encoding *table, size_t num,
+	const struct instr *instr)
+{
+	uint16_t code;
+
+	for (size_t i = 0; i < num; i++) {
+		const struct c_encoding *enc = &table[i];
+		if (enc->op != instr->op)
+			continue;
+
+		if (encode(enc, instr, false, &code) ||
+			(enc->commutative && encode(enc, instr, true, &code)))
+			return enc;
+	}
+	return NULL;
+}
+
+uint16_t write_encoding(const struct c_encoding *enc, const struct instr *instr)
+{
+	uint16_t code = 0;
+	if (!encode(enc, instr, false, &code)) {
+		bool ok = enc->commutative && encode(enc, instr, true, &code);
+		assert(ok);
+		(void)ok;
+	}
+	return code;
+}
+
+/* the bits behind the opcode that hold a register or the immediate */
+static uint16_t used_bits(const struct c_encoding *enc)
+{
+	const struct c_layout *layout = &layouts[enc->format];
+	const enum c_reg regs[3] = { enc->rd, enc->rs, enc->rt };
+	uint16_t used = (1 << layout->imm_width) - 1;
+
+	for (int r = 0; r < 3; r++) {
+		int field = reg_field(regs[r]);
+		if (field >= 0)
+			used |= ((1 << layout->reg_width[field]) - 1) << reg_shift(layout, field);
+	}
+	return used;
+}
+
+const struct c_encoding *parse_encoding(const struct c_encoding *table, size_t num,
+	uint16_t code, struct instr *out)
+{
+	uint8_t opcode = (code >> 10) & 0x1F;
+
+	for (size_t i = 0; i < num; i++) {
+		const struct c_encoding *enc = &table[i];
+		const struct c_layout *layout = &layouts[enc->format];
+
+		if (enc->opcode != opcode || (code & 0x03FF & ~used_bits(enc)) != 0)
+			continue;
+
+		out->op = enc->op;
+		out->rd = get_reg(layout, enc->rd, code);
+		out->rs = get_reg(layout, enc->rs, code);
+		out->rt = get_reg(layout, enc->rt, code);
+		out->shamt = 0;
+		out->compressed = true;
+
+		int32_t value = imm_value(enc->imm, code);
+		if (enc->imm == C_IMM_SHAMT) {
+			out->shamt = value;
+		} else if (enc->imm != C_IMM_NONE) {
+			out->simm = value;
+			out->imm = value & 0xFFFF;
+		}
+		return enc;
+	}
+	return NULL;
+}
 
 int parse_instr_v2(uint32_t instr, struct instr *out)
 {
@@ -150,6 +508,20 @@ int parse_instr_v2(uint32_t instr, struct instr *out)
 			out->op = SW;
 			break;
 
+		case 0x1C: /* COP0, moved because 0x10 is used by LB */
+			out->rd = (instr >> 11) & 0x1F;
+			if (out->rs == 0x00) {
+				out->op = MFC0;
+			} else if (out->rs == 0x04) {
+				out->op = MTC0;
+			} else if (out->rs == 0x10 && (instr & 0x3F) == 0x10) {
+				out->op = RFE;
+			} else {
+				fprintf(stderr, "Unknown instruction: %8.8X\n", instr);
+				out->op = INVALID_OP;
+			}
+			break;
+
 		default:
 			parse_instr(instr, out);
 		}
@@ -157,283 +529,63 @@ int parse_instr_v2(uint32_t instr, struct instr *out)
 		return 4;
 	} else {
 		/* small instructions */
-		instr >>= 16;
-		uint8_t opcode = (instr >> 10) & 0x1F;
-		uint8_t rds    = (instr >>  5) & 0x1F;
-		uint8_t rt     = instr & 0x1F;
-		int16_t offset = instr & 0x03FF;
-		if (offset > 0x01FF) {
-			offset = -(((~offset) + 1) & 0x03FF);
-		}
-		assert(-512 <= offset && offset <= 511);
-		
-		uint8_t uimm = instr & 0x1F;
-		int8_t  simm;
-		if (uimm > 0x0F) {
-			simm = -(((~uimm) + 1) & 0x1F);
-		} else {
-			simm = uimm;
-		}
-
-		assert(-16 <= simm && simm <= 15);
-
-		out->compressed = true;
-		switch(opcode) {
-		case C_MOV:
-			out->op = SLL;
-			out->rd = rds;
-			out->rs = 0;
-			out->rt = rt;
-			out->shamt = 0;
-			break;
-
-		case C_ADDU:
-			out->op = ADDU;
-			out->rd = rds;
-			out->rs = rds;
-			out->rt = rt;
-			break;
-
-		case C_SUBU:
-			out->op = SUBU;
-			out->rd = rds;
-			out->rs = rds;
-			out->rt = rt;
-			break;
-
-		case C_OR:
-			out->op = OR;
-			out->rd = rds;
-			out->rs = rds;
-			out->rt = rt;
-			break;
-
-		case C_XOR:
-			out->op = XOR;
-			out->rd = rds;
-			out->rs = rds;
-			out->rt = rt;
-			break;
-
-		case C_NEG:
-			out->op = SUBU;
-			out->rd = rds;
-			out->rs = 0;
-			out->rt = rt;
-			break;
-
-		case C_NOT:
-			out->op = NOR;
-			out->rd = rds;
-			out->rs = 0;
-			out->rt = rt;
-			break;
-
-		case C_SLTU:
-			out->op = SLTU;
-			out->rd = rds;
-			out->rs = rds;
-			out->rt = rt;
-			break;
-
-		case C_ADDIU:
-			out->op = ADDIU;
-			out->rt = rds;
-			out->rs = rds;
-			out->simm = simm;
-			break;
-
-		case C_ANDI:
-			out->op = ANDI;
-			out->rt = rds;
-			out->rs = rds;
-			out->imm = uimm;
-			break;
-
-		case C_SLL:
-			out->op = SLL;
-			out->rd = rds;
-			out->rs = 0;
-			out->rt = rds;
-			out->shamt = uimm;
-			break;
-
-		case C_SRL:
-			out->op = SRL;
-			out->rd = rds;
-			out->rs = 0;
-			out->rt = rds;
-			out->shamt = uimm;
-			break;
-
-		case C_SRA:
-			out->op = SRA;
-			out->rd = rds;
-			out->rs = 0;
-			out->rt = rds;
-			out->shamt = uimm;
-			break;
-
-		case C_LSI:
-			out->op = ADDIU;
-			out->rt = rds;
-			out->rs = 0;
-			out->simm = simm;
-			break;
-
-		case C_B:
-			out->op = BGEZ;
-			out->rs = 0;
-			out->rt = 0;
-			out->simm = offset * 2;
-			break;
-
-		case C_BAL:
-			out->op = BGEZAL;
-			out->rs = 0;
-			out->rt = 0;
-			out->simm = offset * 2;
-			break;
-
-		case C_BEQZ:
-			out->op = BEQ;
-			out->rs = 0;
-			out->rt = rds;
-			out->simm = simm * 2;
-			break;
-
-		case C_BNEZ:
-			out->op = BNE;
-			out->rs = 0;
-			out->rt = rds;
-			out->simm = simm * 2;
-			break;
-
-		case C_JALR:
-			if (rds == 0) {
-				out->op = JR;
-				out->rs = rt;
-			} else {
-				out->op = JALR;
-				out->rs = rt;
-				out->rd = rds;
+		if (dict_active()) {
+			uint32_t word;
+			if (!dict_word((instr >> 16) & 0x7FFF, &word)) {
+				fprintf(stderr, "unknown dictionary entry\n");
+				return 0;
 			}
-			break;
 
-		case C_LWS:
-			out->op = LW;
-			out->rs = 29;
-			out->rt = rds;
-			out->simm = uimm * 4;
-			out->imm = uimm * 4;
-			break;
-
-		case C_SWS:
-			out->op = SW;
-			out->rs = 29;
-			out->rt = rds;
-			out->simm = uimm * 4;
-			out->imm = uimm * 4;
-			break;
+			parse_instr_v2(word, out);
+			out->compressed = true;
+			return 2;
+		}
 
-		default:
+		if (parse_encoding(c_encodings, num_c_encodings, instr >> 16, out) == NULL) {
 			fprintf(stderr, "unknown opcode\n");
 			return 0;
 		}
 
+		conv_to_native(out);
 		assert(out->op < NOP);
 		return 2;
 	}
 }
 
-static uint16_t write_r(uint8_t opcode, uint8_t rds, uint8_t rt)
+static uint32_t write_l_si(uint8_t opcode, uint8_t rs, uint8_t rt, int16_t simm)
 {
 	assert(opcode < 32);
-	assert(rds < 32);
+	assert(rs < 32);
 	assert(rt < 32);
 
-	uint16_t instr = 1;
-	instr = (instr << 5) | opcode;
-	instr = (instr << 5) | rds;
-	instr = (instr << 5) | rt;
-
-	return instr;
-}
-
-static uint16_t write_ui(uint8_t opcode, uint8_t rds, uint8_t imm)
-{
-	assert(opcode < 32);
-	assert(rds < 32);
-	assert(imm < 32);
-
-	uint16_t instr = 1;
-	instr = (instr << 5) | opcode;
-	instr = (instr << 5) | rds;
-	instr = (instr << 5) | imm;
-
-	return instr;
-}
-
-static uint32_t write_si(uint8_t opcode, uint8_t rds, int8_t simm)
-{
-	assert(opcode < 32);
-	assert(rds < 32);
-	assert(-16 <= simm && simm <= 15);
-
-	uint8_t imm;
+	uint16_t imm;
 	if (simm < 0) {
-		imm = (~(-simm) + 1);
+		imm = -simm;
+		imm = (~imm) + 1;
 	} else {
 		imm = simm;
 	}
-	imm &= 0x1F;
-
-	uint16_t instr = 1;
-	instr = (instr << 5) | opcode;
-	instr = (instr << 5) | rds;
-	instr = (instr << 5) | imm;
-
-	return instr;
-}
-
-static uint32_t write_b(uint8_t opcode, int16_t offset)
-{
-	assert(opcode < 32);
-	assert(-512 <= offset && offset <= 511);
-
-	uint16_t imm;
-	if (offset < 0) {
-		imm = (~(-offset) + 1);
-	} else {
-		imm = offset;
-	}
-	imm &= 0x03FF;
 
-	uint16_t instr = 1;
-	instr = (instr << 5)  | opcode;
-	instr = (instr << 10) | imm;
+	uint32_t instr = opcode;
+	instr = (instr << 5) | rs;
+	instr = (instr << 5) | rt;
+	instr = (instr << 16) | imm;
 
 	return instr;
 }
 
-static uint32_t write_l_si(uint8_t opcode, uint8_t rs, uint8_t rt, int16_t simm)
+static uint32_t write_l_r(uint8_t opcode, uint8_t rs, uint8_t rt, uint8_t rd)
 {
 	assert(opcode < 32);
 	assert(rs < 32);
 	assert(rt < 32);
-
-	uint16_t imm;
-	if (simm < 0) {
-		imm = -simm;
-		imm = (~imm) + 1;
-	} else {
-		imm = simm;
-	}
+	assert(rd < 32);
 
 	uint32_t instr = opcode;
 	instr = (instr << 5) | rs;
 	instr = (instr << 5) | rt;
-	instr = (instr << 16) | imm;
+	instr = (instr << 5) | rd;
+	instr = instr << 11;
 
 	return instr;
 }
@@ -509,11 +661,11 @@ int write_instr_v2(struct instr *instr, uint32_t *out)
 			break;
 	
 		case BEQ:
-			*out = write_l_si(0x04, instr->rs, instr->rt, instr->simm / 2);
+			*out = write_l_si(0x04, inst.rs, inst.rt, inst.simm / 2);
 			break;
 	
 		case BNE:
-			*out = write_l_si(0x05, instr->rs, instr->rt, instr->simm / 2);
+			*out = write_l_si(0x05, inst.rs, inst.rt, inst.simm / 2);
 			break;
 	
 		case BLEZ:
@@ -532,6 +684,18 @@ int write_instr_v2(struct instr *instr, uint32_t *out)
 			*out = write_l_j(0x03, instr->addr / 2);
 			break;
 
+		case MFC0:
+			*out = write_l_r(0x1C, 0x00, inst.rt, inst.rd);
+			break;
+
+		case MTC0:
+			*out = write_l_r(0x1C, 0x04, inst.rt, inst.rd);
+			break;
+
+		case RFE:
+			*out = write_l_r(0x1C, 0x10, 0x00, 0x00) | 0x10;
+			break;
+
 		default:
 			*out = write_instr(&inst);
 		}
@@ -539,119 +703,27 @@ int write_instr_v2(struct instr *instr, uint32_t *out)
 		return 4;
 	}
 
-	switch(instr->op) {
-	case NOP:
-		*out = write_r(C_MOV, 0, 0);
-		break;
-
-	case MOV:
-		*out = write_r(C_MOV, instr->rd, instr->rt);
-		break;
-
-	case CLEAR:
-		*out = write_r(C_MOV, instr->rd, 0);
-		break;
-
-	case ADDU:
-		if (instr->rd == instr->rs) {
-			*out = write_r(C_ADDU, instr->rd, instr->rt);
-		} else {
-			*out = write_r(C_ADDU, instr->rd, instr->rs);
-		}
-		break;
-
-	case SUBU:
-		*out = write_r(C_SUBU, instr->rd, instr->rt);
-		break;
+	if (dict_active()) {
+		struct instr large = *instr;
+		uint32_t word;
+		large.compressed = false;
+		write_instr_v2(&large, &word);
 
-	case OR:
-		if (instr->rd == instr->rs) {
-			*out = write_r(C_OR, instr->rd, instr->rt);
-		} else {
-			*out = write_r(C_OR, instr->rd, instr->rs);
+		int32_t index = dict_find(word);
+		if (index < 0) {
+			fprintf(stderr, "Instruction %8.8X isn't in the dictionary\n", word);
+			exit(EXIT_FAILURE);
 		}
-		break;
-
-	case XOR:
-		if (instr->rd == instr->rs) {
-			*out = write_r(C_XOR, instr->rd, instr->rt);
-		} else {
-			*out = write_r(C_XOR, instr->rd, instr->rs);
-		}
-		break;
-
-	case NEG:
-		*out = write_r(C_NEG, instr->rd, instr->rt);
-		break;
-
-	case NOT:
-		*out = write_r(C_NOT, instr->rd, instr->rt);
-		break;
-
-	case SLTU:
-		*out = write_r(C_SLTU, instr->rd, instr->rt);
-		break;
-
-	case ADDIU:
-		*out = write_si(C_ADDIU, instr->rt, instr->simm);
-		break;
-
-	case ANDI:
-		*out = write_ui(C_ANDI, instr->rt, instr->imm);
-		break;
-
-	case SLL:
-		*out = write_ui(C_SLL, instr->rd, instr->shamt);
-		break;
-
-	case SRL:
-		*out = write_ui(C_SRL, instr->rd, instr->shamt);
-		break;
-
-	case SRA:
-		*out = write_ui(C_SRA, instr->rd, instr->shamt);
-		break;
-
-	case LSI:
-		*out = write_si(C_LSI, instr->rt, instr->simm);
-		break;
-
-	case B:
-		*out = write_b(C_B, instr->simm / 2);
-		break;
-
-	case BAL: 
-		*out = write_b(C_BAL, instr->simm / 2);
-		break;
-
-	case BEQZ:
-		*out = write_si(C_BEQZ, instr->rs, instr->simm / 2);
-		break;
-
-	case BNEZ:
-		*out = write_si(C_BNEZ, instr->rs, instr->simm / 2);
-		break;
-
-	case JR:
-		*out = write_r(C_JALR, 0, instr->rs);
-		break;
-
-	case JALR:
-		*out = write_r(C_JALR, instr->rd, instr->rs);
-		break;
-
-	case SW:
-		*out = write_ui(C_SWS, instr->rt, instr->imm / 4);
-		break;
-
-	case LW:
-		*out = write_ui(C_LWS, instr->rt, instr->imm / 4);
-		break;
+		*out = 0x8000 | index;
+		return 2;
+	}
 
-	default:
+	const struct c_encoding *enc = match_encoding(c_encodings, num_c_encodings, instr);
+	if (enc == NULL) {
 		fprintf(stderr, "Invalid compressed instruction (%d)\n", instr->op);
 		exit(EXIT_FAILURE);
-		break;
 	}
+
+	*out = write_encoding(enc, instr);
 	return 2;
 }
@@ -4,13 +4,90 @@
  * @date 2016-09-26
  */
 
+#include <stddef.h>
 #include "../common/instr.h"
 
 #ifndef V2_INSTR_H
 #define V2_INSTR_H
 
+/* The layout of the 15 bits behind the high bit of a small instruction */
+enum c_format {
+	C_FORMAT_R,  /* 5 bit opcode, 5 bit rds, 5 bit rt */
+	C_FORMAT_I,  /* 5 bit opcode, 5 bit rds, 5 bit immediate */
+	C_FORMAT_B,  /* 5 bit opcode, 10 bit offset */
+	C_FORMAT_M,  /* 5 bit opcode, 5 bit rt, 2 bit base, 3 bit offset */
+	C_FORMAT_R3, /* 5 bit opcode, 3 bit rd, 3 bit rs, 3 bit rt, 1 bit 0 (v3) */
+	C_FORMAT_I3, /* 5 bit opcode, 3 bit rd, 3 bit rs, 4 bit immediate (v3) */
+	C_FORMAT_I7  /* 5 bit opcode, 3 bit rds, 7 bit immediate (v3) */
+};
+
+/* Where a register of the 32-bit equivalent comes from */
+enum c_reg {
+	C_REG_NONE, /* not part of the instruction */
+	C_REG_RDS,
+	C_REG_RT,
+	C_REG_RD3,  /* the first 3 bit field */
+	C_REG_RS3,  /* the second 3 bit field */
+	C_REG_RT3,  /* the third 3 bit field */
+	C_REG_BASE, /* the 2 bit field, one of v2_base_regs */
+	C_REG_ZERO, /* has to be $0 */
+	C_REG_SP    /* has to be $sp ($29) */
+};
+
+/* The immediate of the 32-bit equivalent */
+enum c_imm {
+	C_IMM_NONE,
+	C_IMM_ZERO,  /* has to be 0 */
+	C_IMM_S5,    /* simm in [-16; 15] */
+	C_IMM_U5,    /* imm in [0; 31] */
+	C_IMM_SHAMT, /* shamt */
+	C_IMM_U5_X4, /* imm in [0; 124], a multiple of 4 */
+	C_IMM_S5_X2, /* branch offset in [-32; 30] */
+	C_IMM_S10_X2, /* branch offset in [-1024; 1022] */
+	C_IMM_S4,    /* simm in [-8; 7] */
+	C_IMM_U4_X4, /* imm in [0; 60], a multiple of 4 */
+	C_IMM_S7,    /* simm in [-64; 63] */
+	C_IMM_U7_X4, /* imm in [0; 508], a multiple of 4 */
+	C_IMM_S7_X2, /* branch offset in [-128; 126] */
+	C_IMM_U3,    /* imm in [0; 7] */
+	C_IMM_U3_X2, /* imm in [0; 14], a multiple of 2 */
+	C_IMM_U3_X4  /* imm in [0; 28], a multiple of 4 */
+};
+
+/* One way to encode an instruction in 16 bits. Several entries may share
+ * an opcode, e.g. MOV, NOP and CLEAR. */
+struct c_encoding {
+	const char *name;
+	uint8_t opcode;
+	enum c_format format;
+	enum operation op; /* 32-bit equivalent, may be a pseudo instruction */
+	enum c_reg rd;
+	enum c_reg rs;
+	enum c_reg rt;
+	enum c_imm imm;
+	bool commutative; /* rs and rt may be swapped */
+};
+
+extern const struct c_encoding v2_encodings[];
+extern const size_t num_v2_encodings;
+extern const uint8_t v2_base_regs[4];
+
+/* the encodings that the functions below use, v2_encodings by default */
+extern const struct c_encoding *c_encodings;
+extern size_t num_c_encodings;
+
+/* returns the first entry that can encode the instruction or NULL */
+const struct c_encoding *match_encoding(const struct c_encoding *table, size_t num,
+	const struct instr *instr);
+/* returns the first entry of the opcode whose unused fields are 0 or NULL */
+const struct c_encoding *parse_encoding(const struct c_encoding *table, size_t num,
+	uint16_t code, struct instr *out);
+uint16_t write_encoding(const struct c_encoding *enc, const struct instr *instr);
+
+bool imm_fits(enum c_imm imm, int32_t value);
+bool is_branch_imm(enum c_imm imm);
+
 int parse_instr_v2(uint32_t instr, struct instr *out);
 int write_instr_v2(struct instr *instr, uint32_t *out); /* return value is the size (2 or 4) */
 
 #endif
-
@@ -0,0 +1,66 @@
+/**
+ * @file v3_instr.c
+ * @date 2026-10-18
+ * The small instructions of v3. The 5 bit register fields of R16 and I16
+ * force rd == rs and leave 5 bits for immediates. v3 keeps all of them and
+ * uses the 11 opcodes from 0x15 on, where v2 has its base register loads
+ * and stores, for formats with 3 bit register fields, which allow three
+ * addresses, base registers other than $sp and wider immediates for the 8
+ * most used registers. These are the registers with the most uses in the
+ * register statistics of the analyzer (-r) besides $0, $sp and $ra, which
+ * have their own forms, i.e. $s0, $s1 and $v0-$a3.
+ */
+
+#include "../common/v3_instr.h"
+
+const uint8_t v3_regs[8] = { 16, 17, 2, 3, 4, 5, 6, 7 };
+
+const struct c_encoding v3_encodings[] = {
+	/* name     opcode format        op     rd          rs          rt          imm           commutative */
+	{ "mov",    0x00, C_FORMAT_R,  MOV,   C_REG_RDS,  C_REG_NONE, C_REG_RT,   C_IMM_NONE,   false },
+	{ "mov",    0x00, C_FORMAT_R,  NOP,   C_REG_NONE, C_REG_NONE, C_REG_NONE, C_IMM_NONE,   false },
+	{ "mov",    0x00, C_FORMAT_R,  CLEAR, C_REG_RDS,  C_REG_NONE, C_REG_NONE, C_IMM_NONE,   false },
+	{ "addu",   0x01, C_FORMAT_R,  ADDU,  C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,   true  },
+	{ "subu",   0x02, C_FORMAT_R,  SUBU,  C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,   false },
+	{ "or",     0x03, C_FORMAT_R,  OR,    C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,   true  },
+	{ "xor",    0x04, C_FORMAT_R,  XOR,   C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,   true  },
+	{ "neg",    0x05, C_FORMAT_R,  NEG,   C_REG_RDS,  C_REG_NONE, C_REG_RT,   C_IMM_NONE,   false },
+	{ "not",    0x06, C_FORMAT_R,  NOT,   C_REG_RDS,  C_REG_NONE, C_REG_RT,   C_IMM_NONE,   false },
+	{ "sltu",   0x07, C_FORMAT_R,  SLTU,  C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,   false },
+	{ "addiu",  0x08, C_FORMAT_I,  ADDIU, C_REG_NONE, C_REG_RDS,  C_REG_RDS,  C_IMM_S5,     false },
+	{ "andi",   0x09, C_FORMAT_I,  ANDI,  C_REG_NONE, C_REG_RDS,  C_REG_RDS,  C_IMM_U5,     false },
+	{ "sll",    0x0A, C_FORMAT_I,  SLL,   C_REG_RDS,  C_REG_NONE, C_REG_RDS,  C_IMM_SHAMT,  false },
+	{ "srl",    0x0B, C_FORMAT_I,  SRL,   C_REG_RDS,  C_REG_NONE, C_REG_RDS,  C_IMM_SHAMT,  false },
+	{ "sra",    0x0C, C_FORMAT_I,  SRA,   C_REG_RDS,  C_REG_NONE, C_REG_RDS,  C_IMM_SHAMT,  false },
+	{ "lsi",    0x0D, C_FORMAT_I,  LSI,   C_REG_NONE, C_REG_NONE, C_REG_RDS,  C_IMM_S5,     false },
+	{ "b",      0x0E, C_FORMAT_B,  B,     C_REG_NONE, C_REG_NONE, C_REG_NONE, C_IMM_S10_X2, false },
+	{ "bal",    0x0F, C_FORMAT_B,  BAL,   C_REG_NONE, C_REG_NONE, C_REG_NONE, C_IMM_S10_X2, false },
+	{ "beqz",   0x10, C_FORMAT_I,  BEQZ,  C_REG_NONE, C_REG_RDS,  C_REG_NONE, C_IMM_S5_X2,  false },
+	{ "bnez",   0x11, C_FORMAT_I,  BNEZ,  C_REG_NONE, C_REG_RDS,  C_REG_NONE, C_IMM_S5_X2,  false },
+	{ "jalr",   0x12, C_FORMAT_R,  JR,    C_REG_NONE, C_REG_RT,   C_REG_NONE, C_IMM_NONE,   false },
+	{ "jalr",   0x12, C_FORMAT_R,  JALR,  C_REG_RDS,  C_REG_RT,   C_REG_NONE, C_IMM_NONE,   false },
+	{ "lws",    0x13, C_FORMAT_I,  LW,    C_REG_NONE, C_REG_SP,   C_REG_RDS,  C_IMM_U5_X4,  false },
+	{ "sws",    0x14, C_FORMAT_I,  SW,    C_REG_NONE, C_REG_SP,   C_REG_RDS,  C_IMM_U5_X4,  false },
+
+	/* 3 bit register fields */
+	{ "addu3",  0x15, C_FORMAT_R3, ADDU,  C_REG_RD3,  C_REG_RS3,  C_REG_RT3,  C_IMM_NONE,   true  },
+	{ "subu3",  0x16, C_FORMAT_R3, SUBU,  C_REG_RD3,  C_REG_RS3,  C_REG_RT3,  C_IMM_NONE,   false },
+	{ "addiu3", 0x17, C_FORMAT_I3, ADDIU, C_REG_NONE, C_REG_RS3,  C_REG_RD3,  C_IMM_S4,     false },
+	{ "addiu7", 0x18, C_FORMAT_I7, ADDIU, C_REG_NONE, C_REG_RD3,  C_REG_RD3,  C_IMM_S7,     false },
+	/* conv_to_pseudo only makes LSI of 5 bit immediates, the others stay addiu rt, $0 */
+	{ "lsi7",   0x19, C_FORMAT_I7, ADDIU, C_REG_NONE, C_REG_ZERO, C_REG_RD3,  C_IMM_S7,     false },
+	{ "lw3",    0x1A, C_FORMAT_I3, LW,    C_REG_NONE, C_REG_RS3,  C_REG_RD3,  C_IMM_U4_X4,  false },
+	{ "sw3",    0x1B, C_FORMAT_I3, SW,    C_REG_NONE, C_REG_RS3,  C_REG_RD3,  C_IMM_U4_X4,  false },
+	{ "lws7",   0x1C, C_FORMAT_I7, LW,    C_REG_NONE, C_REG_SP,   C_REG_RD3,  C_IMM_U7_X4,  false },
+	{ "sws7",   0x1D, C_FORMAT_I7, SW,    C_REG_NONE, C_REG_SP,   C_REG_RD3,  C_IMM_U7_X4,  false },
+	{ "beqz7",  0x1E, C_FORMAT_I7, BEQZ,  C_REG_NONE, C_REG_RD3,  C_REG_NONE, C_IMM_S7_X2,  false },
+	{ "bnez7",  0x1F, C_FORMAT_I7, BNEZ,  C_REG_NONE, C_REG_RD3,  C_REG_NONE, C_IMM_S7_X2,  false },
+};
+
+const size_t num_v3_encodings = sizeof(v3_encodings) / sizeof(v3_encodings[0]);
+
+void use_v3_encodings(void)
+{
+	c_encodings = v3_encodings;
+	num_c_encodings = num_v3_encodings;
+}
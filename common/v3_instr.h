@@ -0,0 +1,22 @@
+/**
+ * @file v3_instr.h
+ * @date 2026-10-18
+ * The experimental v3 encoding. The large instructions are the same as in
+ * v2, the small instructions add formats with 3 bit register fields.
+ */
+
+#include "../common/v2_instr.h"
+
+#ifndef V3_INSTR_H
+#define V3_INSTR_H
+
+/* the registers of the 3 bit register fields */
+extern const uint8_t v3_regs[8];
+
+extern const struct c_encoding v3_encodings[];
+extern const size_t num_v3_encodings;
+
+/* parse_instr_v2, write_instr_v2 and is_compressible_simple use v3 afterwards */
+void use_v3_encodings(void);
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * @file addr_map.c
+ * @date 2026-10-18
+ * The address map (-M) for the lockstep mode of the simulator (-l). Every
+ * line holds the address of an input instruction and its new address, a
+ * deleted instruction has the new address of the one that followed it.
+ * The first instruction of a basic block of the input that stays also has
+ * the registers that are live in front of it. The passes keep these
+ * instructions in place within their block, so the simulator compares
+ * the programs there.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "converter.h"
+#include "cfg.h"
+
+/* the registers live in front of every block of the input, 0 elsewhere */
+static bool *block_first = NULL;
+static uint32_t *block_live = NULL;
+
+void addr_map_init(void)
+{
+	struct cfg cfg;
+	cfg_build(&cfg);
+	cfg_liveness(&cfg);
+
+	block_first = alloc(num_instr, sizeof(*block_first));
+	block_live = alloc(num_instr, sizeof(*block_live));
+	for (size_t b = 0; b < cfg.num_blocks; b++) {
+		size_t first = cfg.blocks[b].first;
+		block_first[first] = true;
+		block_live[first] = cfg.live_in[first];
+	}
+
+	cfg_free(&cfg);
+}
+
+void write_addr_map(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t end = code_size();
+	for (size_t i = 0; i <= num_input_instr; i++) {
+		size_t index = index_map[i];
+		uint32_t addr = index < num_instr ? attr[index].new_addr : end;
+		fprintf(file, "%8.8" PRIX32 " %8.8" PRIX32, text_base + 4 * (uint32_t)i, text_base + addr);
+
+		/* a deleted instruction maps to the one that followed it */
+		bool kept = i < num_input_instr && index_map[i] != index_map[i + 1];
+		if (kept && block_first[i])
+			fprintf(file, " %8.8" PRIX32, block_live[i]);
+		fprintf(file, "\n");
+	}
+
+	fclose(file);
+	free(block_first);
+	free(block_live);
+	block_first = NULL;
+	block_live = NULL;
+}
@@ -0,0 +1,209 @@
+/**
+ * @file align.c
+ * @date 2026-10-18
+ * Aligns branch targets to the width of a fetch. A fetch at a target that
+ * isn't aligned wastes the bytes in front of it. Without a profile the
+ * targets of backward branches, i.e. loop heads, are aligned. With a
+ * profile every target is aligned whose taken entries save more than the
+ * padding costs when the code falls through into it. The padding expands
+ * compressed instructions in front of the target to their 32-bit form if
+ * they don't run more often than the NOPs would, as that doesn't add
+ * executed instructions. The rest becomes NOPs.
+ * The padding is placed during the branch relaxation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "../common/v2_instr.h"
+#include "converter.h"
+
+/* how many instructions in front of a target may be expanded */
+#define EXPAND_WINDOW 4
+
+struct align_stat {
+	uint32_t targets;
+	uint32_t nop_bytes;
+	uint32_t expanded;
+	int64_t fetched_bytes;
+};
+
+/* the entries of every target by taken branches and jumps */
+static uint64_t *entries = NULL;
+static bool *is_target = NULL;
+static struct align_stat stat;
+
+static bool is_control(enum operation op)
+{
+	return is_branch(op) || op == J || op == JAL || op == JR || op == JALR;
+}
+
+/* can the instruction change to the 32-bit form? */
+static bool can_expand(size_t index)
+{
+	enum operation op = prog[index].op;
+	bool sdi = op == B || op == BAL || op == BEQZ || op == BNEZ || op == J || op == JAL;
+
+	return prog[index].compressed && !sdi && !attr[index].code_ref;
+}
+
+void align_init(void)
+{
+	/* the branch extension may need another round */
+	free(entries);
+	free(is_target);
+
+	entries = alloc(num_instr + 1, sizeof(*entries));
+	is_target = alloc(num_instr + 1, sizeof(*is_target));
+
+	for (size_t i = 0; i < num_instr; i++) {
+		ssize_t target = attr[i].target_index;
+		enum operation op = prog[i].op;
+
+		if ((!is_branch(op) && op != J && op != JAL) || target < 0 || (size_t)target >= num_instr)
+			continue;
+
+		if (has_profile()) {
+			bool always = op == J || op == JAL || op == B || op == BAL;
+			entries[target] += always ? attr[i].exec_count : attr[i].taken_count;
+			is_target[target] |= entries[target] > 0;
+		} else if ((size_t)target <= i && op != JAL && op != BAL) {
+			is_target[target] = true;
+		}
+	}
+
+	/* padding in front of a delay slot would be executed before it */
+	for (size_t i = 1; i < num_instr; i++) {
+		if (is_control(prog[i - 1].op))
+			is_target[i] = false;
+	}
+}
+
+/* how often the code falls through into the target */
+static uint64_t fall_count(size_t index)
+{
+	uint64_t exec = attr[index].exec_count;
+	return exec > entries[index] ? exec - entries[index] : 0;
+}
+
+/* is the padding worth it according to the profile? */
+static bool pays_off(size_t index, uint32_t pad)
+{
+	if (!has_profile())
+		return true;
+
+	return entries[index] * (options.align_width - pad) > fall_count(index) * pad;
+}
+
+void align_reset(void)
+{
+	for (size_t i = 0; i < num_instr; i++) {
+		if (attr[i].expanded) {
+			prog[i].compressed = true;
+			attr[i].expanded = false;
+		}
+		attr[i].pad = 0;
+	}
+}
+
+/*
+ * Places the padding for the current instruction sizes and calculates the
+ * new addresses. Expanded instructions from the last call are compressed
+ * again first, so that the padding always follows the sizes of the SDIs.
+ */
+void align_place(void)
+{
+	uint32_t width = options.align_width;
+	uint32_t addr = 0;
+	size_t prev_target = 0;
+
+	stat = (struct align_stat) {0, 0, 0, 0};
+	align_reset();
+
+	for (size_t i = 0; i < num_instr; i++) {
+		uint32_t pad = (width - addr % width) % width;
+
+		if (is_target[i] && pad > 0 && pays_off(i, pad)) {
+			uint64_t falls = fall_count(i);
+			stat.fetched_bytes += entries[i] * (width - pad);
+			stat.targets++;
+
+			for (size_t j = i; j > prev_target && i - j < EXPAND_WINDOW && pad > 0; j--) {
+				if (!can_expand(j - 1) || attr[j - 1].exec_count > falls)
+					continue;
+
+				stat.fetched_bytes -= 2 * attr[j - 1].exec_count;
+
+				prog[j - 1].compressed = false;
+				attr[j - 1].expanded = true;
+				for (size_t k = j; k < i; k++) {
+					attr[k].new_addr += 2;
+				}
+				addr += 2;
+				pad -= 2;
+				stat.expanded++;
+			}
+
+			attr[i].pad = pad;
+			addr += pad;
+			stat.nop_bytes += pad;
+			stat.fetched_bytes -= falls * pad;
+		}
+
+		if (is_target[i])
+			prev_target = i;
+
+		attr[i].new_addr = addr;
+		addr += prog[i].compressed ? 2 : 4;
+	}
+}
+
+/* writes the NOPs in front of the instruction and returns their size */
+int encode_padding(size_t index, uint8_t *bytes)
+{
+	uint32_t pad = attr[index].pad;
+	int size = 0;
+
+	/* a 32-bit NOP is one instruction less than two 16-bit NOPs */
+	while (pad >= 4) {
+		bytes[size++] = 0;
+		bytes[size++] = 0;
+		bytes[size++] = 0;
+		bytes[size++] = 0;
+		pad -= 4;
+	}
+
+	if (pad == 2) {
+		struct instr nop;
+		uint32_t code;
+
+		parse_instr(0, &nop);
+		conv_to_pseudo(&nop);
+		nop.compressed = true;
+		write_instr_v2(&nop, &code);
+		bytes[size++] = code >> 8;
+		bytes[size++] = code & 0xFF;
+	}
+
+	return size;
+}
+
+void align_finish(void)
+{
+	fprintf(stderr, "alignment: %u targets aligned to %u bytes, %u instructions expanded, "
+		"%u bytes of NOPs, %u bytes larger", stat.targets, options.align_width,
+		stat.expanded, stat.nop_bytes, stat.nop_bytes + 2 * stat.expanded);
+	if (has_profile()) {
+		fprintf(stderr, ", about %" PRId64 " bytes less fetched", stat.fetched_bytes);
+	}
+	fprintf(stderr, "\n");
+
+	free(entries);
+	free(is_target);
+	entries = NULL;
+	is_target = NULL;
+}
@@ -0,0 +1,101 @@
+#!/usr/bin/env perl
+
+# Times the converter on large synthetic programs
+# Usage: bench.pl CONVERTER [-j THREADS] [SIZE-IN-KIB...]
+
+use strict;
+use warnings;
+use Time::HiRes qw(time);
+use File::Temp qw(tempdir);
+
+my $converter = shift(@ARGV) // die "Usage: $0 CONVERTER [-j THREADS] [SIZE-IN-KIB...]\n";
+my @flags = ();
+if (@ARGV >= 2 && $ARGV[0] eq '-j') {
+	@flags = splice(@ARGV, 0, 2);
+}
+my @sizes = @ARGV ? @ARGV : (64, 256, 1024, 4096);
+my $dir = tempdir(CLEANUP => 1);
+
+# the same programs for every run
+srand(42);
+
+sub reg { return 1 + int(rand(31)); }
+
+# random branch offset in instructions, mostly short like in real code
+sub offset {
+	my ($i, $num) = @_;
+	my $r = rand();
+	my $range = $r < 0.6 ? 16 : ($r < 0.9 ? 600 : 8000);
+	my $target = $i + 1 + int(rand(2 * $range)) - $range;
+	$target = 0 if $target < 0;
+	$target = $num - 1 if $target >= $num;
+	return ($target - $i - 1) & 0xFFFF;
+}
+
+sub gen_prog {
+	my ($num) = @_;
+	my @prog;
+
+	for (my $i = 0; $i < $num; $i++) {
+		my $r = rand();
+		my $rs = reg();
+		my $rt = reg();
+		my $instr;
+
+		if ($r < 0.3) {
+			# addu
+			$instr = ($rs << 21) | ($rt << 16) | (reg() << 11) | 0x21;
+		} elsif ($r < 0.5) {
+			# addiu
+			$instr = (0x09 << 26) | ($rs << 21) | ($rt << 16) | int(rand(0x10000));
+		} elsif ($r < 0.6) {
+			# lw
+			$instr = (0x23 << 26) | ($rs << 21) | ($rt << 16) | (int(rand(64)) * 4);
+		} elsif ($r < 0.7) {
+			# sw
+			$instr = (0x2B << 26) | ($rs << 21) | ($rt << 16) | (int(rand(64)) * 4);
+		} elsif ($i + 1 < $num && $r < 0.95) {
+			# beq, bne, beqz, bnez and b with a delay slot
+			my $opcode = 0x04 + int(rand(2));
+			$rt = rand() < 0.5 ? 0 : $rt;
+			$rs = 0 if $opcode == 0x04 && rand() < 0.3;
+			$instr = ($opcode << 26) | ($rs << 21) | ($rt << 16) | offset($i, $num);
+			push(@prog, $instr);
+			$i++;
+			$instr = 0;
+		} elsif ($i + 1 < $num) {
+			# j and jal with a delay slot
+			my $opcode = 0x02 + int(rand(2));
+			my $target = $i + 1 + offset($i, $num);
+			$target -= 0x10000 if $target - $i - 1 >= 0x8000;
+			$instr = ($opcode << 26) | $target;
+			push(@prog, $instr);
+			$i++;
+			$instr = 0;
+		} else {
+			$instr = 0;
+		}
+
+		push(@prog, $instr);
+	}
+
+	return pack("L>*", @prog);
+}
+
+printf("%10s %12s %12s %10s\n", "size/KiB", "instructions", "output/B", "time/s");
+
+foreach my $size (@sizes) {
+	my $num = $size * 256;
+	my $in = "$dir/prog_$size.bin";
+	my $out = "$dir/prog_$size.comp.bin";
+
+	open(my $fh, '>:raw', $in) or die "Couldn't open $in: $!";
+	print $fh gen_prog($num);
+	close($fh);
+
+	my $start = time();
+	system($converter, @flags, $in, $out) == 0 or die "$converter failed on $in\n";
+	my $elapsed = time() - $start;
+
+	printf("%10d %12d %12d %10.3f\n", $size, $num, -s $out, $elapsed);
+}
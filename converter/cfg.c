@@ -0,0 +1,291 @@
+/**
+ * @file cfg.c
+ * @date 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "converter.h"
+#include "cfg.h"
+
+/* the scratch registers and $ra are changed by calls */
+#define CALL_DEFS (REG_SCRATCH | REG_MASK(31))
+/* $a0-$a3, $gp and $sp are arguments of calls */
+#define CALL_USES (0x000000F0 | REG_MASK(28) | REG_MASK(29))
+/* at a return everything but the temporaries and arguments is live */
+#define RETURN_LIVE (REG_ALL & ~(REG_MASK(1) | 0x000000F0 | REG_TEMPS))
+
+bool is_call(enum operation op)
+{
+	return op == JAL || op == JALR || op == BAL || op == BLTZAL || op == BGEZAL;
+}
+
+/* instructions that end a basic block after their delay slot */
+static bool ends_block(enum operation op)
+{
+	return (is_branch(op) && !is_call(op)) || op == J || op == JR;
+}
+
+bool is_load(enum operation op)
+{
+	return op == LB || op == LH || op == LW || op == LBU || op == LHU;
+}
+
+bool load_hazard(size_t prev, uint32_t uses)
+{
+	if (!is_load(prog[prev].op))
+		return false;
+
+	int dest = get_dest_reg(&prog[prev]);
+	return dest >= 0 && (REG_MASK(dest) & uses) != 0;
+}
+
+bool is_delay_slot_of_call(size_t index)
+{
+	return index > 0 && is_call(prog[index - 1].op);
+}
+
+uint32_t instr_uses(size_t index)
+{
+	uint8_t *regs[2];
+	int num = get_src_regs(&prog[index], regs);
+	uint32_t uses = 0;
+
+	for (int i = 0; i < num; i++) {
+		uses |= REG_MASK(*regs[i]);
+	}
+
+	if (is_delay_slot_of_call(index))
+		uses |= CALL_USES;
+
+	return uses & REG_ALL;
+}
+
+uint32_t instr_defs(size_t index)
+{
+	int dest = get_dest_reg(&prog[index]);
+	uint32_t defs = dest >= 0 ? REG_MASK(dest) : 0;
+
+	if (is_delay_slot_of_call(index))
+		defs |= CALL_DEFS;
+
+	return defs & REG_ALL;
+}
+
+uint32_t live_transfer(size_t index, uint32_t live_out)
+{
+	uint8_t *regs[2];
+	int num = get_src_regs(&prog[index], regs);
+	uint32_t uses = 0;
+
+	for (int i = 0; i < num; i++) {
+		uses |= REG_MASK(*regs[i]);
+	}
+
+	/* the call happens after the delay slot */
+	if (is_delay_slot_of_call(index))
+		live_out = CALL_USES | (live_out & ~CALL_DEFS);
+
+	int dest = get_dest_reg(&prog[index]);
+	if (dest >= 0)
+		live_out &= ~REG_MASK(dest);
+
+	return (uses | live_out) & REG_ALL;
+}
+
+static void add_succ(struct cfg *cfg, struct block *block, ssize_t target)
+{
+	if (target < 0 || target >= (ssize_t)num_instr) {
+		block->exits = true;
+		block->exit_live = REG_ALL;
+		return;
+	}
+
+	block->succ[block->num_succ++] = cfg->block_of[target];
+}
+
+static void find_functions(struct cfg *cfg, bool *leader)
+{
+	bool *entry = alloc(num_instr, sizeof(*entry));
+
+	if (num_instr > 0)
+		entry[0] = true;
+
+	for (size_t i = 0; i < num_instr; i++) {
+		ssize_t target = attr[i].target_index;
+		if (is_call(prog[i].op) && prog[i].op != JALR && 0 <= target && target < (ssize_t)num_instr)
+			entry[target] = true;
+	}
+
+	for (size_t i = 0; i < num_instr; i++) {
+		if (entry[i]) {
+			cfg->num_funcs++;
+			leader[i] = true;
+		}
+	}
+
+	cfg->funcs = alloc(cfg->num_funcs, sizeof(*cfg->funcs));
+	size_t num = 0;
+	for (size_t i = 0; i < num_instr; i++) {
+		if (entry[i]) {
+			if (num > 0)
+				cfg->funcs[num - 1].last = i - 1;
+			cfg->funcs[num++].first = i;
+		}
+	}
+
+	if (num > 0)
+		cfg->funcs[num - 1].last = num_instr - 1;
+
+	free(entry);
+}
+
+void cfg_build(struct cfg *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+
+	bool *leader = alloc(num_instr + 1, sizeof(*leader));
+	find_functions(cfg, leader);
+
+	for (size_t i = 0; i < num_instr; i++) {
+		ssize_t target = attr[i].target_index;
+
+		if (attr[i].addr_taken)
+			leader[i] = true;
+
+		if (ends_block(prog[i].op)) {
+			leader[i + 2 <= num_instr ? i + 2 : num_instr] = true;
+			if (0 <= target && target < (ssize_t)num_instr)
+				leader[target] = true;
+		}
+	}
+
+	/* a delay slot always stays in the block of its branch */
+	for (size_t i = 0; i + 1 < num_instr; i++) {
+		if (ends_block(prog[i].op))
+			leader[i + 1] = false;
+	}
+
+	for (size_t i = 0; i < num_instr; i++) {
+		if (leader[i] || i == 0)
+			cfg->num_blocks++;
+	}
+
+	cfg->blocks = alloc(cfg->num_blocks, sizeof(*cfg->blocks));
+	cfg->block_of = alloc(num_instr, sizeof(*cfg->block_of));
+
+	size_t num = 0;
+	for (size_t i = 0; i < num_instr; i++) {
+		if (leader[i] || i == 0) {
+			if (num > 0)
+				cfg->blocks[num - 1].last = i - 1;
+			cfg->blocks[num++].first = i;
+		}
+		cfg->block_of[i] = num - 1;
+	}
+
+	if (num > 0)
+		cfg->blocks[num - 1].last = num_instr - 1;
+
+	for (size_t b = 0; b < cfg->num_blocks; b++) {
+		struct block *block = &cfg->blocks[b];
+		size_t last = block->last;
+		/* the control transfer is before the delay slot */
+		size_t ct = last > block->first ? last - 1 : last;
+		enum operation op = prog[ct].op;
+
+		if (!ends_block(op) || ct == last) {
+			add_succ(cfg, block, last + 1);
+		} else if (op == JR) {
+			block->exits = true;
+			/* other indirect jumps are jump tables or unknown */
+			block->exit_live = prog[ct].rs == 31 ? RETURN_LIVE : REG_ALL;
+		} else {
+			add_succ(cfg, block, attr[ct].target_index);
+			if (op != J && op != B)
+				add_succ(cfg, block, last + 1);
+		}
+	}
+
+	for (size_t f = 0; f < cfg->num_funcs; f++) {
+		cfg->blocks[cfg->block_of[cfg->funcs[f].first]].entry = true;
+	}
+
+	for (size_t i = 0; i < num_instr; i++) {
+		if (attr[i].addr_taken)
+			cfg->blocks[cfg->block_of[i]].entry = true;
+	}
+
+	/* predecessors */
+	for (size_t b = 0; b < cfg->num_blocks; b++) {
+		for (int s = 0; s < cfg->blocks[b].num_succ; s++) {
+			cfg->blocks[cfg->blocks[b].succ[s]].num_pred++;
+		}
+	}
+
+	for (size_t b = 0; b < cfg->num_blocks; b++) {
+		cfg->blocks[b].pred = alloc(cfg->blocks[b].num_pred, sizeof(size_t));
+		cfg->blocks[b].num_pred = 0;
+	}
+
+	for (size_t b = 0; b < cfg->num_blocks; b++) {
+		for (int s = 0; s < cfg->blocks[b].num_succ; s++) {
+			struct block *succ = &cfg->blocks[cfg->blocks[b].succ[s]];
+			succ->pred[succ->num_pred++] = b;
+		}
+	}
+
+	free(leader);
+}
+
+void cfg_liveness(struct cfg *cfg)
+{
+	free(cfg->live_in);
+	free(cfg->live_out);
+	cfg->live_in = alloc(num_instr, sizeof(*cfg->live_in));
+	cfg->live_out = alloc(num_instr, sizeof(*cfg->live_out));
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+
+		for (size_t b = cfg->num_blocks; b > 0; b--) {
+			struct block *block = &cfg->blocks[b - 1];
+			uint32_t live = block->exits ? block->exit_live : 0;
+
+			for (int s = 0; s < block->num_succ; s++) {
+				live |= cfg->live_in[cfg->blocks[block->succ[s]].first];
+			}
+
+			uint32_t old_live = cfg->live_in[block->first];
+			for (size_t i = block->last + 1; i > block->first; i--) {
+				cfg->live_out[i - 1] = live;
+				live = live_transfer(i - 1, live);
+				cfg->live_in[i - 1] = live;
+			}
+
+			if (live != old_live) {
+				changed = true;
+			}
+		}
+	}
+}
+
+void cfg_free(struct cfg *cfg)
+{
+	for (size_t b = 0; b < cfg->num_blocks; b++) {
+		free(cfg->blocks[b].pred);
+	}
+
+	free(cfg->blocks);
+	free(cfg->block_of);
+	free(cfg->funcs);
+	free(cfg->live_in);
+	free(cfg->live_out);
+	memset(cfg, 0, sizeof(*cfg));
+}
@@ -0,0 +1,74 @@
+/**
+ * @file cfg.h
+ * @date 2026-10-18
+ * Control flow graph and register liveness of the program in prog.
+ * Calls are not followed, instead the calling convention of the o32 ABI
+ * is assumed at every call and return.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../common/instr.h"
+
+#ifndef CFG_H
+#define CFG_H
+
+#define REG_MASK(reg) ((uint32_t)1 << (reg))
+
+/* $t0-$t9, they aren't preserved by calls and dead at returns */
+#define REG_TEMPS (0x0000FF00 | REG_MASK(24) | REG_MASK(25))
+/* $at, $v0-$v1, $a0-$a3 and the temporaries aren't preserved by calls */
+#define REG_SCRATCH (REG_MASK(1) | 0x000000FC | REG_TEMPS)
+#define REG_ALL (0xFFFFFFFE)
+
+struct block {
+	size_t first;
+	size_t last; /* the delay slot belongs to the block */
+	size_t succ[2];
+	int num_succ;
+	bool entry; /* can be reached from unknown places, e.g. by calls */
+	bool exits; /* leaves the known control flow, e.g. a return */
+	uint32_t exit_live; /* registers that are live if the block exits */
+	size_t *pred;
+	size_t num_pred;
+};
+
+struct function {
+	size_t first;
+	size_t last;
+};
+
+struct cfg {
+	struct block *blocks;
+	size_t num_blocks;
+	size_t *block_of; /* block of each instruction */
+
+	struct function *funcs;
+	size_t num_funcs;
+
+	/* registers that are live before and after each instruction */
+	uint32_t *live_in;
+	uint32_t *live_out;
+};
+
+bool is_call(enum operation op);
+bool is_load(enum operation op);
+/* does an instruction right after the load prev that reads uses get the
+ * register before it is loaded? MIPS-I has a load delay slot */
+bool load_hazard(size_t prev, uint32_t uses);
+/* the call reads its arguments after the delay slot was executed */
+bool is_delay_slot_of_call(size_t index);
+/* registers that are read and written, including the effects of a call
+ * if index is the delay slot of a call */
+uint32_t instr_uses(size_t index);
+uint32_t instr_defs(size_t index);
+uint32_t live_transfer(size_t index, uint32_t live_out);
+
+void cfg_build(struct cfg *cfg);
+void cfg_liveness(struct cfg *cfg);
+void cfg_free(struct cfg *cfg);
+
+#endif
+
@@ -0,0 +1,159 @@
+/**
+ * @file code_ref.c
+ * @date 2026-10-18
+ * Code addresses that are built by HI16/LO16 pairs or stored in data. The
+ * converter updates jumps and branches itself, these addresses are mapped
+ * to the new addresses after the conversion. Both the ELF conversion and
+ * the linker know them from the relocations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "../common/elf_file.h"
+#include "converter.h"
+
+struct code_ref {
+	size_t hi;
+	size_t lo;
+	uint32_t addr;
+};
+
+static bool known = false;
+static uint32_t text_addr = 0;
+static uint32_t text_size = 0;
+static uint32_t new_text_size = 0;
+
+static struct code_ref *refs = NULL;
+static size_t num_refs = 0;
+static size_t max_refs = 0;
+
+void code_refs_init(uint32_t addr, uint32_t size)
+{
+	known = true;
+	text_addr = addr;
+	text_size = size;
+	new_text_size = size;
+}
+
+bool code_refs_known(void)
+{
+	return known;
+}
+
+/* the end of the text section is also a valid code address */
+bool in_text(uint32_t addr)
+{
+	return text_addr <= addr && addr - text_addr <= text_size;
+}
+
+uint32_t map_addr(uint32_t addr)
+{
+	assert(in_text(addr));
+	uint32_t offset = addr - text_addr;
+
+	if (offset == text_size)
+		return text_addr + new_text_size;
+
+	if (offset % 4 != 0) {
+		fprintf(stderr, "Code address 0x%8.8X doesn't point to an instruction\n", addr);
+		exit(EXIT_FAILURE);
+	}
+
+	/* removed code at the end maps to the end */
+	size_t index = index_map[offset / 4];
+	if (index >= num_instr)
+		return text_addr + new_text_size;
+
+	return text_addr + attr[index].new_addr;
+}
+
+bool addr_removed(uint32_t addr)
+{
+	assert(in_text(addr));
+	size_t i = (addr - text_addr) / 4;
+
+	/* a deleted instruction maps to the one that followed it */
+	return i < num_input_instr && index_map[i] == index_map[i + 1];
+}
+
+/* code addresses that are built or stored somewhere can be jumped to */
+void mark_addr_taken(uint32_t addr)
+{
+	if (in_text(addr) && addr - text_addr < text_size && (addr - text_addr) % 4 == 0)
+		attr[(addr - text_addr) / 4].addr_taken = true;
+}
+
+void add_code_ref(const uint8_t *code, size_t hi, size_t lo)
+{
+	uint32_t addr = (prog[hi].imm << 16) + (int16_t)prog[lo].imm;
+	if (!in_text(addr))
+		return;
+
+	refs = grow(refs, num_refs, &max_refs, sizeof(*refs));
+	refs[num_refs++] = (struct code_ref) {hi, lo, addr};
+	mark_addr_taken(addr);
+
+	/* the pseudo instructions may have lost the immediate, e.g. MOV
+	 * for an ADDIU with 0. Both instructions keep the 32-bit format. */
+	size_t index[2] = {hi, lo};
+	for (int i = 0; i < 2; i++) {
+		parse_instr(elf_read32(code + 4 * index[i]), &prog[index[i]]);
+		prog[index[i]].compressed = false;
+		attr[index[i]].code_ref = true;
+	}
+}
+
+/* drops the code addresses that are built by removed instructions */
+void remove_dead_code_refs(const bool *live)
+{
+	size_t num = 0;
+
+	for (size_t i = 0; i < num_refs; i++) {
+		if (live[index_map[refs[i].hi]] && live[index_map[refs[i].lo]])
+			refs[num++] = refs[i];
+	}
+	num_refs = num;
+}
+
+void update_code_refs(void)
+{
+	new_text_size = code_size();
+
+	bool *hi_done = alloc(num_input_instr, sizeof(*hi_done));
+
+	for (size_t i = 0; i < num_refs; i++) {
+		struct instr *hi = &prog[index_map[refs[i].hi]];
+		struct instr *lo = &prog[index_map[refs[i].lo]];
+		uint32_t addr = map_addr(refs[i].addr);
+
+		if (!hi_done[refs[i].hi]) {
+			hi->imm = ((addr + 0x8000) >> 16) & 0xFFFF;
+			hi_done[refs[i].hi] = true;
+		}
+
+		int32_t offset = addr - (hi->imm << 16);
+		if (offset < -32768 || offset > 32767) {
+			fprintf(stderr, "Couldn't update the code address at 0x%8.8X\n",
+				text_addr + (uint32_t)refs[i].lo * 4);
+			exit(EXIT_FAILURE);
+		}
+
+		lo->imm = offset & 0xFFFF;
+		lo->simm = offset;
+	}
+
+	free(hi_done);
+}
+
+void free_code_refs(void)
+{
+	free(refs);
+	known = false;
+	refs = NULL;
+	num_refs = 0;
+	max_refs = 0;
+}
@@ -9,287 +9,812 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <inttypes.h>
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "../common/instr.h"
 #include "../common/v2_instr.h"
+#include "../common/v3_instr.h"
+#include "../common/dict_instr.h"
 #include "../common/print_instr.h"
+#include "../common/elf_file.h"
+#include "converter.h"
 
-/* ssize_t is from POSIX and not available here */
-typedef long ssize_t;
+size_t num_instr = 0;
+struct instr *prog = NULL;
+struct instr_attr *attr = NULL;
+uint32_t text_base = DEFAULT_TEXT_BASE;
+size_t num_input_instr = 0;
+size_t *index_map = NULL;
+/* the number of instructions that fit into prog and attr */
+static size_t capacity = 0;
+struct conv_options options = {
+	.remove_dead = false,
+	.keep_syms = NULL,
+	.num_keep_syms = 0,
+	.peephole = false,
+	.rename_regs = false,
+	.fill_slots = false,
+	.outline = false,
+	.layout_blocks = false,
+	.order_funcs = false,
+	.align_width = 0,
+	.num_threads = 1,
+	.profile_path = NULL,
+	.dict_path = NULL
+};
+
+bool set_conv_option(int opt, const char *arg)
+{
+	switch (opt) {
+	case 'G':
+		options.remove_dead = true;
+		break;
+
+	case 'k':
+		options.keep_syms = realloc(options.keep_syms,
+			(options.num_keep_syms + 1) * sizeof(*options.keep_syms));
+		if (options.keep_syms == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		options.keep_syms[options.num_keep_syms++] = arg;
+		break;
 
-static char *program_name = "converter";
+	case 'w':
+		options.peephole = true;
+		break;
 
-static void parse_bin(FILE *f);
+	case 'r':
+		options.rename_regs = true;
+		break;
 
-static void usage(void)
-{
-	fprintf(stderr, "Usage: %s IN-FILE OUT-FILE\n", program_name);
-	exit(EXIT_FAILURE);
+	case 's':
+		options.fill_slots = true;
+		break;
+
+	case 'O':
+		options.outline = true;
+		break;
+
+	case 'F':
+		options.order_funcs = true;
+		break;
+
+	case '3':
+		use_v3_encodings();
+		break;
+
+	case 'a':
+		options.align_width = strtoul(arg, NULL, 0);
+		if (options.align_width != 4 && options.align_width != 8) {
+			fprintf(stderr, "The alignment has to be 4 or 8 bytes\n");
+			exit(EXIT_FAILURE);
+		}
+		break;
+
+	case 'j':
+		options.num_threads = strtoul(arg, NULL, 0);
+		if (options.num_threads < 1 || options.num_threads > MAX_THREADS) {
+			fprintf(stderr, "The number of threads has to be between 1 and %d\n", MAX_THREADS);
+			exit(EXIT_FAILURE);
+		}
+		break;
+
+	case 'p':
+		options.profile_path = arg;
+		break;
+
+	case 'L':
+		options.layout_blocks = true;
+		break;
+
+	case 'X':
+		options.dict_path = arg;
+		break;
+
+	default:
+		return false;
+	}
+
+	return true;
 }
 
-static uint32_t to_instr(uint8_t bytes[4])
+static void reserve_instrs(size_t num)
 {
-	uint32_t instr = bytes[0];
-	instr = (instr << 8) | bytes[1];
-	instr = (instr << 8) | bytes[2];
-	instr = (instr << 8) | bytes[3];
-	return instr;
+	if (num <= capacity)
+		return;
+
+	prog = realloc(prog, num * sizeof(*prog));
+	attr = realloc(attr, num * sizeof(*attr));
+
+	if (prog == NULL || attr == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	capacity = num;
 }
 
-struct instr_attr {
-	uint32_t new_addr;
-	uint32_t jump_target;
-	ssize_t target_index; /* array index to the target instruction */
-};
+/* Branches are only compressible after the layout, when their offset is known */
+bool is_compressible_simple(struct instr *instr)
+{
+	assert(instr != NULL);
 
-size_t num_instr = 0;
-struct instr *prog = NULL;
-struct instr_attr *attr = NULL;
+	if (dict_active())
+		return dict_compressible(instr);
+
+	const struct c_encoding *enc = match_encoding(c_encodings, num_c_encodings, instr);
+	return enc != NULL && !is_branch_imm(enc->imm);
+}
 
-static void parse_bin(FILE *in)
+/* decodes the instruction at index, the arrays have to be large enough */
+static void decode_instr(size_t index, uint32_t code)
 {
-	uint8_t bytes[4];
 	struct instr instr;
 
-	uint32_t new_addr = 0;
+	parse_instr(code, &instr);
+	conv_to_pseudo(&instr);
 
-	while(fread(bytes, sizeof(bytes), 1, in) == 1) {
-		uint32_t code = to_instr(bytes);
-		parse_instr(code, &instr);
-		conv_to_pseudo(&instr);
+	if (instr.op == INVALID_OP) {
+		fprintf(stderr, "Invalid instruction at %lu\n", index * 4);
+		exit(EXIT_FAILURE);
+	}
 
-		if (instr.op == INVALID_OP) {
-			fprintf(stderr, "Invalid instruction at %lu\n", num_instr * 4);
-			exit(EXIT_FAILURE);
-		}
-		
-		num_instr++;
-		prog = realloc(prog, num_instr * sizeof(*prog));
+	instr.compressed = is_compressible_simple(&instr);
+
+	prog[index] = instr;
+	attr[index] = (struct instr_attr) {
+		.new_addr = index * 4,
+		.jump_target = 0,
+		.target_index = -1,
+		.code_ref = false,
+		.addr_taken = false,
+		.exec_count = 0,
+		.taken_count = 0,
+		.pad = 0,
+		.expanded = false
+	};
+
+	if (instr.op == J || instr.op == JAL) {
+		/* J and JAL only contain the lower 28 bits of the address */
+		attr[index].jump_target = instr.addr;
+		attr[index].target_index = (instr.addr - (text_base & 0x0FFFFFFF)) / 4;
+	}
 
-		if (prog == NULL) {
-			fprintf(stderr, "Out of memory\n");
-			exit(EXIT_FAILURE);
-		}
+	if (is_branch(instr.op)) {
+		attr[index].target_index = index + 1 + (instr.simm / 4);
+	}
+}
 
-		attr = realloc(attr, num_instr * sizeof(*attr));
+static void add_instr(uint32_t code)
+{
+	/* the appended jumps grow the arrays geometrically */
+	if (num_instr == capacity)
+		reserve_instrs(capacity > 0 ? 2 * capacity : 64);
 
-		if (attr == NULL) {
-			fprintf(stderr, "Out of memory\n");
-			exit(EXIT_FAILURE);
-		}
+	decode_instr(num_instr, code);
+	num_instr++;
+}
 
-		instr.compressed = is_compressible_simple(&instr);
+/* adds an instruction behind the others, it is placed with reorder_instrs */
+size_t append_instr(uint32_t code)
+{
+	add_instr(code);
 
-		prog[num_instr - 1] = instr;
-		attr[num_instr - 1] = (struct instr_attr) {
-			.new_addr = new_addr,
-			.jump_target = 0,
-			.target_index = -1
-		};
+	/* the end of the code is still behind the input instructions */
+	if (index_map != NULL && index_map[num_input_instr] == num_instr - 1)
+		index_map[num_input_instr] = num_instr;
 
-		if (instr.op == J || instr.op == JAL) {
-			attr[num_instr - 1].jump_target = instr.addr;
-			attr[num_instr - 1].target_index = instr.addr / 4;
-		}
+	return num_instr - 1;
+}
 
-		if (is_branch(instr.op)) {
-			attr[num_instr - 1].target_index = num_instr + (instr.simm / 4);
-		}
+struct decode_part {
+	const uint8_t *code;
+	size_t base;
+};
+
+static void decode_part(size_t part, size_t first, size_t end, void *arg)
+{
+	struct decode_part *dp = arg;
+	(void)part;
 
-		new_addr += instr.compressed ? 2 : 4;
+	for (size_t i = first; i < end; i++) {
+		decode_instr(dp->base + i, elf_read32(dp->code + 4 * i));
 	}
 }
 
-static uint32_t correct_branch_offsets(size_t num, struct instr prog[num], struct instr_attr attr[num])
+void parse_code(const uint8_t *code, size_t size)
 {
-	uint32_t num_mod_instr = 0;
+	struct decode_part dp = {code, num_instr};
+	size_t num = size / 4;
 
-	for (size_t i = 0; i < num_instr; i++) {
+	reserve_instrs(num_instr + num);
+	parallel_for(num, decode_part, &dp);
+	num_instr += num;
+}
+
+/* 32-bit branches have the range [-65536; 65534], the offset is scaled by 2 */
+static bool in_long_range(int32_t simm)
+{
+	return (-65536 <= simm) && (simm <= 65534);
+}
+
+static void correct_part(size_t part, size_t first, size_t end, void *arg)
+{
+	(void)part;
+	(void)arg;
+
+	for (size_t i = first; i < end; i++) {
 		if (!is_branch(prog[i].op)) {
 			continue;
 		}
 
 		ssize_t target = attr[i].target_index;
 		assert(0 <= target && target < (ssize_t)num_instr);
-		int32_t simm = attr[target].new_addr - attr[i + 1].new_addr;
+		prog[i].simm = attr[target].new_addr - attr[i + 1].new_addr;
+		assert(in_long_range(prog[i].simm));
+	}
+}
 
-		if (prog[i].simm != simm) {
-			num_mod_instr++;
-		}
+static void correct_branch_offsets(void)
+{
+	parallel_for(num_instr, correct_part, NULL);
+}
+
+/* the size of every part and then the address where it starts */
+static uint32_t part_addr[MAX_THREADS];
+
+static void sum_part(size_t part, size_t first, size_t end, void *arg)
+{
+	uint32_t size = 0;
+	(void)arg;
 
-		prog[i].simm = simm;
+	for (size_t i = first; i < end; i++) {
+		size += attr[i].pad + (prog[i].compressed ? 2 : 4);
 	}
 
-	return num_mod_instr;
+	part_addr[part] = size;
 }
 
-static uint32_t correct_jump_targets(size_t num, struct instr prog[num], struct instr_attr attr[num])
+static void addr_part(size_t part, size_t first, size_t end, void *arg)
 {
-	uint32_t num_mod_instr = 0;
+	uint32_t new_addr = part_addr[part];
+	(void)arg;
 
-	for (size_t i = 0; i < num_instr; i++) {
-		if (prog[i].op != J && prog[i].op != JAL) {
-			continue;
-		}
+	for (size_t i = first; i < end; i++) {
+		new_addr += attr[i].pad;
+		attr[i].new_addr = new_addr;
+		new_addr += prog[i].compressed ? 2 : 4;
+	}
+}
 
-		ssize_t target = attr[i].target_index;
-		assert(0 <= target && target < (ssize_t)num_instr);
-		if (attr[i].jump_target != attr[target].new_addr) {
-			num_mod_instr++;
-		}
+/* the addresses are a prefix sum over the sizes, computed in parts */
+static void calc_new_addr(void)
+{
+	size_t num_parts = parallel_parts(num_instr);
 
-		attr[i].jump_target = attr[target].new_addr;
+	parallel_for(num_instr, sum_part, NULL);
+
+	uint32_t addr = 0;
+	for (size_t p = 0; p < num_parts; p++) {
+		uint32_t size = part_addr[p];
+		part_addr[p] = addr;
+		addr += size;
 	}
 
-	return num_mod_instr;
+	parallel_for(num_instr, addr_part, NULL);
 }
 
-static uint32_t calc_new_addr(size_t num, struct instr prog[num], struct instr_attr attr[num])
+/* Fenwick tree over the instruction sizes. It gives the address of an
+ * instruction in O(log n) while the sizes change during relaxation. */
+static uint32_t *size_tree = NULL;
+
+static void size_tree_add(size_t num, size_t index, int32_t delta)
 {
-	uint32_t new_addr = 0;
-	uint32_t num_mod_instr = 0;
+	for (size_t i = index + 1; i <= num; i += i & -i) {
+		size_tree[i - 1] += delta;
+	}
+}
 
-	for (size_t i = 0; i < num_instr; i++) {
-		if (attr[i].new_addr != new_addr) {
-			num_mod_instr++;
-		}
+/* returns the address of the instruction at index, index may be num */
+static uint32_t size_tree_addr(size_t index)
+{
+	uint32_t addr = 0;
+	for (size_t i = index; i > 0; i -= i & -i) {
+		addr += size_tree[i - 1];
+	}
+	return addr;
+}
 
-		attr[i].new_addr = new_addr;
+/* Span-dependent instructions have a 16-bit form with a short range and
+ * a 32-bit form. J and JAL are replaced by B and BAL if they are in range. */
+static bool is_sdi(enum operation op)
+{
+	return op == B || op == BAL || op == BEQZ || op == BNEZ || op == J || op == JAL;
+}
 
-		new_addr += prog[i].compressed ? 2 : 4;
-	}
+/* the range may depend on the registers, e.g. for BEQZ of v3 */
+static bool in_short_range(const struct instr *sdi, int32_t simm)
+{
+	struct instr instr = *sdi;
+	instr.op = sdi->op == J ? B : (sdi->op == JAL ? BAL : sdi->op);
+	instr.simm = simm;
+	return match_encoding(c_encodings, num_c_encodings, &instr) != NULL;
+}
 
-	return num_mod_instr;
+/* A short instruction spans at most 1024 bytes, that are 512 instructions
+ * plus the instruction itself for backward branches. */
+#define RELAX_WINDOW (1024 / 2 + 1)
+
+/* Does the offset of the SDI at index i depend on the size of instruction k? */
+static bool sdi_spans(struct instr_attr attr[], size_t i, size_t k)
+{
+	size_t target = attr[i].target_index;
+	if (target > i) {
+		return i < k && k < target;
+	}
+	return target <= k && k <= i;
 }
 
-static uint32_t compress_branch(size_t num, struct instr prog[num], struct instr_attr attr[num])
+/*
+ * Chooses the size of all SDIs. Every SDI starts with the short form and
+ * is only ever grown, because growing an instruction never shortens an
+ * offset. The result is the smallest fixpoint. After an instruction grew
+ * only the short SDIs in its neighbourhood that span it are checked again.
+ */
+static void relax_sdis(size_t num, struct instr prog[num], struct instr_attr attr[num])
 {
-	uint32_t num_mod_instr = 0;
+	size_t *worklist = malloc(num * sizeof(*worklist));
+	bool *queued = calloc(num, sizeof(*queued));
+	size_tree = calloc(num, sizeof(*size_tree));
 
-	correct_branch_offsets(num, prog, attr);
+	if (num > 0 && (worklist == NULL || queued == NULL || size_tree == NULL)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
 
-	for (size_t i = 0; i < num_instr; i++) {
-		if (!is_branch(prog[i].op)) {
-			continue;
+	size_t num_work = 0;
+	for (size_t i = 0; i < num; i++) {
+		if (is_sdi(prog[i].op)) {
+			ssize_t target = attr[i].target_index;
+			assert(0 <= target && target < (ssize_t)num);
+			(void)target;
+
+			prog[i].compressed = true;
+			worklist[num_work++] = i;
+			queued[i] = true;
 		}
 
-		bool compressible = prog[i].compressed;
-		if (prog[i].op == B || prog[i].op == BAL) {
-			/* B and BAL have the range [-1024; 1022] */
-			compressible = (-1024 <= prog[i].simm) && (prog[i].simm <= 1022);
-		} else if (prog[i].op == BEQZ || prog[i].op == BNEZ) {
-			/* BEQZ and BNEZ have the range [-32; 30] */
-			compressible = (-32 <= prog[i].simm) && (prog[i].simm <= 30);
+		size_tree_add(num, i, prog[i].compressed ? 2 : 4);
+	}
+
+	while (num_work > 0) {
+		size_t i = worklist[--num_work];
+		queued[i] = false;
+
+		if (!prog[i].compressed) {
+			continue;
 		}
 
-		if (compressible != prog[i].compressed) {
-			num_mod_instr++;
+		int32_t simm = size_tree_addr(attr[i].target_index) - size_tree_addr(i + 1);
+		if (in_short_range(&prog[i], simm)) {
+			continue;
 		}
 
-		prog[i].compressed = compressible;
+		prog[i].compressed = false;
+		size_tree_add(num, i, 2);
+
+		size_t first = i > RELAX_WINDOW ? i - RELAX_WINDOW : 0;
+		size_t last = i + RELAX_WINDOW < num ? i + RELAX_WINDOW : num - 1;
+		for (size_t k = first; k <= last; k++) {
+			if (!queued[k] && prog[k].compressed && is_sdi(prog[k].op) && sdi_spans(attr, k, i)) {
+				worklist[num_work++] = k;
+				queued[k] = true;
+			}
+		}
 	}
 
-	calc_new_addr(num, prog, attr);
-	correct_branch_offsets(num, prog, attr);
-	return num_mod_instr;
+	calc_new_addr();
+
+	free(worklist);
+	free(queued);
+	free(size_tree);
+	size_tree = NULL;
+}
+
+/* "j 0" and "sll $0, $0, 0" */
+#define CODE_J (0x08000000)
+#define CODE_NOP (0x00000000)
+
+/* the size of a trampoline, the J and its NOP */
+#define TRAMPOLINE_SIZE (4 + 2)
+
+struct extend_stat {
+	uint32_t jumps;
+	uint32_t trampolines;
+	uint64_t fetched_bytes;
+};
+
+static enum operation invert_branch(enum operation op)
+{
+	switch (op) {
+	case BEQ:  return BNE;
+	case BNE:  return BEQ;
+	case BEQZ: return BNEZ;
+	case BNEZ: return BEQZ;
+	case BLTZ: return BGEZ;
+	case BGEZ: return BLTZ;
+	case BLEZ: return BGTZ;
+	case BGTZ: return BLEZ;
+	default:   return INVALID_OP;
+	}
 }
 
-int main(int argc, char *argv[])
+/*
+ * Extends the branches that don't reach their target with the 32-bit form
+ * at the current addresses. B and BAL become J and JAL. A conditional
+ * branch gets a trampoline: it is inverted and skips a J to the target
+ * that follows its delay slot, so the delay slot still runs on both paths.
+ * Returns true if the program changed and has to be relaxed again.
+ */
+static bool extend_branches(struct extend_stat *stat)
 {
-	if (argc > 0)
-		program_name = argv[0];
-	
-	if (argc != 3)
-		usage();
-	
-	FILE *file = fopen(argv[1], "rb");
-	if (file == NULL) {
-		fprintf(stderr, "Couldn't open file '%s'\n", argv[1]);
+	bool changed = false;
+	size_t num_far = 0;
+
+	for (size_t i = 0; i < num_instr; i++) {
+		if (!is_branch(prog[i].op) || prog[i].compressed)
+			continue;
+
+		int32_t simm = attr[attr[i].target_index].new_addr - attr[i + 1].new_addr;
+		if (in_long_range(simm))
+			continue;
+
+		switch (prog[i].op) {
+		case B:
+		case BAL:
+			prog[i].op = prog[i].op == B ? J : JAL;
+			stat->jumps++;
+			changed = true;
+			break;
+
+		case BLTZAL:
+		case BGEZAL:
+			fprintf(stderr, "The linking branch at %zu is out of range\n", i);
+			exit(EXIT_FAILURE);
+
+		default:
+			if (i + 2 >= num_instr) {
+				fprintf(stderr, "The branch at %zu is out of range\n", i);
+				exit(EXIT_FAILURE);
+			}
+			num_far++;
+		}
+	}
+
+	if (num_far == 0)
+		return changed;
+
+	size_t num = num_instr;
+	size_t *order = malloc((num + 2 * num_far) * sizeof(*order));
+	if (order == NULL) {
+		fprintf(stderr, "Out of memory\n");
 		exit(EXIT_FAILURE);
 	}
 
-	parse_bin(file);
-	fclose(file);
-	file = NULL;
+	size_t num_order = 0;
+	for (size_t i = 0; i < num; i++) {
+		order[num_order++] = i;
 
-	FILE *out_file = fopen(argv[2], "wb");
+		if (i == 0 || !is_branch(prog[i - 1].op) || prog[i - 1].compressed)
+			continue;
 
-	if (out_file == NULL) {
-		fprintf(stderr, "Couldn't open file '%s'\n", argv[2]);
-		exit(EXIT_FAILURE);
+		size_t branch = i - 1;
+		int32_t simm = attr[attr[branch].target_index].new_addr - attr[i].new_addr;
+		if (in_long_range(simm))
+			continue;
+
+		uint64_t taken = attr[branch].taken_count;
+
+		size_t jump = append_instr(CODE_J);
+		attr[jump].target_index = attr[branch].target_index;
+		attr[jump].exec_count = taken;
+		attr[jump].taken_count = taken;
+		order[num_order++] = jump;
+
+		size_t slot = append_instr(CODE_NOP);
+		attr[slot].exec_count = taken;
+		order[num_order++] = slot;
+
+		prog[branch].op = invert_branch(prog[branch].op);
+		attr[branch].target_index = i + 1;
+		attr[branch].taken_count = attr[branch].exec_count - taken;
+
+		stat->trampolines++;
+		stat->fetched_bytes += taken * TRAMPOLINE_SIZE;
 	}
 
-	correct_branch_offsets(num_instr, prog, attr);
+	reorder_instrs(order, num_order);
+	free(order);
+	return true;
+}
+
+/*
+ * Chooses the size of all SDIs, places the padding for the alignment and
+ * extends the branches that are still out of range. Every extension moves
+ * the code behind it, so everything is placed again until all branches
+ * reach their targets.
+ */
+void relax_branches(void)
+{
+	struct extend_stat stat = {0, 0, 0};
+	bool changed = true;
+
+	while (changed) {
+		relax_sdis(num_instr, prog, attr);
+
+		if (options.align_width > 0) {
+			align_init();
+
+			/* the padding moves the code behind it, which may put SDIs out of range */
+			bool grown = true;
+			while (grown) {
+				align_place();
+				grown = false;
+
+				for (size_t i = 0; i < num_instr; i++) {
+					if (!is_sdi(prog[i].op) || !prog[i].compressed) {
+						continue;
+					}
+
+					/* the delay slot is never padded */
+					int32_t simm = attr[attr[i].target_index].new_addr - (attr[i].new_addr + 2);
+					if (!in_short_range(&prog[i], simm)) {
+						prog[i].compressed = false;
+						grown = true;
+					}
+				}
+			}
+		}
+
+		changed = extend_branches(&stat);
+
+		/* the next round starts without the padding */
+		if (changed && options.align_width > 0)
+			align_reset();
+	}
+
+	if (options.align_width > 0)
+		align_finish();
+
+	if (stat.jumps > 0 || stat.trampolines > 0) {
+		fprintf(stderr, "long branches: %u became jumps, %u trampolines, %u bytes larger",
+			stat.jumps, stat.trampolines, stat.trampolines * TRAMPOLINE_SIZE);
+		if (has_profile()) {
+			fprintf(stderr, ", about %" PRIu64 " bytes more fetched", stat.fetched_bytes);
+		}
+		fprintf(stderr, "\n");
+	}
 
-	/* correct jump targets */
-	// TODO convert J and JAL to B/BAL if the user requests per option
 	for (size_t i = 0; i < num_instr; i++) {
 		if (prog[i].op != J && prog[i].op != JAL) {
 			continue;
 		}
 
-		ssize_t target = attr[i].target_index;
-		assert(0 <= target && target < (ssize_t)num_instr);
-
-		int32_t simm = attr[target].new_addr - attr[i + 1].new_addr;
+		attr[i].jump_target = attr[attr[i].target_index].new_addr;
 
-		if (-1024 <= simm && simm <= 1022) {
+		if (prog[i].compressed) {
 			/* convert to B or BAL */
-			prog[i].simm = simm;
-			if (prog[i].op == J) {
-				prog[i].op = B;
-			} else {
-				prog[i].op = BAL;
-			}
+			prog[i].op = prog[i].op == J ? B : BAL;
 		}
+	}
+
+	correct_branch_offsets();
+}
 
-		attr[i].jump_target = attr[target].new_addr;
+static void init_index_map(void)
+{
+	num_input_instr = num_instr;
+	index_map = malloc((num_instr + 1) * sizeof(*index_map));
+	if (index_map == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
 	}
-	
 
-	uint32_t num_mod_instr = 0;
-	do {
-		num_mod_instr = compress_branch(num_instr, prog, attr);
-	} while (num_mod_instr != 0);
+	for (size_t i = 0; i <= num_instr; i++) {
+		index_map[i] = i;
+	}
+}
 
-	correct_jump_targets(num_instr, prog, attr);
+/*
+ * Rearranges the instructions. order holds the current index of every
+ * instruction at its new place, instructions that aren't in it are deleted.
+ * Branch targets and the index map follow the instructions and references
+ * to a deleted instruction move to the instruction that followed it.
+ */
+void reorder_instrs(const size_t *order, size_t num)
+{
+	size_t *new_index = malloc((num_instr + 1) * sizeof(*new_index));
+	struct instr *new_prog = malloc((num > 0 ? num : 1) * sizeof(*new_prog));
+	struct instr_attr *new_attr = malloc((num > 0 ? num : 1) * sizeof(*new_attr));
+	if (new_index == NULL || new_prog == NULL || new_attr == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
 
+	const size_t deleted = SIZE_MAX;
 	for (size_t i = 0; i < num_instr; i++) {
-		if (prog[i].op == J || prog[i].op == JAL) {
-			prog[i].addr = attr[i].jump_target;
-		}
+		new_index[i] = deleted;
+	}
+	new_index[num_instr] = num;
 
-		uint32_t instr;
-		int rc = write_instr_v2(&prog[i], &instr);
-
-		if (rc == 2) {
-			uint16_t tmp = instr & 0xFFFF;
-			uint8_t byte = tmp >> 8;
-			fwrite(&byte, 1, 1, out_file);
-			byte = tmp & 0xFF;
-			fwrite(&byte, 1, 1, out_file);
-		} else if (rc == 4) {
-			uint8_t byte = instr >> 24;
-			fwrite(&byte, 1, 1, out_file);
-			byte = instr >> 16;
-			fwrite(&byte, 1, 1, out_file);
-			byte = instr >> 8;
-			fwrite(&byte, 1, 1, out_file);
-			byte = instr & 0xFF;
-			fwrite(&byte, 1, 1, out_file);
-		} else {
-			fprintf(stderr, "Error while writing output file\n");
-			return -1;
-		}
+	for (size_t k = 0; k < num; k++) {
+		assert(order[k] < num_instr && new_index[order[k]] == deleted);
+		new_index[order[k]] = k;
+		new_prog[k] = prog[order[k]];
+		new_attr[k] = attr[order[k]];
+	}
+
+	for (size_t i = num_instr; i > 0; i--) {
+		if (new_index[i - 1] == deleted)
+			new_index[i - 1] = new_index[i];
+	}
+
+	for (size_t k = 0; k < num; k++) {
+		if (new_attr[k].target_index >= 0)
+			new_attr[k].target_index = new_index[new_attr[k].target_index];
 	}
 
-	fclose(out_file);
+	for (size_t i = 0; i <= num_input_instr; i++) {
+		index_map[i] = new_index[index_map[i]];
+	}
 
 	free(prog);
 	free(attr);
+	free(new_index);
+	prog = new_prog;
+	attr = new_attr;
+	num_instr = num;
+	capacity = num > 0 ? num : 1;
+}
+
+void optimize(void)
+{
+	init_index_map();
+
+	if (options.profile_path != NULL)
+		read_profile(options.profile_path);
+
+	if (options.remove_dead)
+		remove_dead_code();
+
+	if (options.peephole)
+		rewrite_instrs();
+
+	if (options.rename_regs)
+		rename_registers();
+
+	if (options.layout_blocks)
+		layout_blocks();
+
+	if (options.fill_slots)
+		fill_delay_slots();
+
+	if (options.outline)
+		outline_sequences();
+
+	if (options.order_funcs)
+		order_functions();
+
+	if (options.dict_path != NULL)
+		build_dictionary();
+
+	relax_branches();
+}
+
+int encode_instr(size_t index, uint8_t bytes[4])
+{
+	struct instr *instr = &prog[index];
+
+	if (instr->op == J || instr->op == JAL) {
+		/* v2 jumps can only reach the lower 128 MiB of the region */
+		instr->addr = (text_base + attr[index].jump_target) & 0x07FFFFFF;
+	}
+
+	uint32_t code;
+	int rc = write_instr_v2(instr, &code);
+
+	if (rc == 2) {
+		bytes[0] = code >> 8;
+		bytes[1] = code & 0xFF;
+	} else if (rc == 4) {
+		elf_write32(bytes, code);
+	}
+
+	return rc;
+}
 
-	return 0;
+uint32_t code_size(void)
+{
+	if (num_instr == 0)
+		return 0;
+
+	return attr[num_instr - 1].new_addr + (prog[num_instr - 1].compressed ? 2 : 4);
 }
 
+static void encode_part(size_t part, size_t first, size_t end, void *arg)
+{
+	uint8_t *out = arg;
+	(void)part;
+
+	for (size_t i = first; i < end; i++) {
+		encode_padding(i, out + attr[i].new_addr - attr[i].pad);
+		int rc = encode_instr(i, out + attr[i].new_addr);
+
+		if (rc != 2 && rc != 4) {
+			fprintf(stderr, "Error while encoding instruction %zu\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+void encode_code(uint8_t *out)
+{
+	parallel_for(num_instr, encode_part, out);
+}
+
+/* maps the file privately, so that it can be changed in memory */
+uint8_t *map_file(const char *path, size_t *size)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "Couldn't open file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	*size = st.st_size;
+	if (*size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	uint8_t *data = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "Couldn't read file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	return data;
+}
+
+void unmap_file(uint8_t *data, size_t size)
+{
+	if (data != NULL)
+		munmap(data, size);
+}
+
+void write_file(const char *path, const uint8_t *data, size_t size)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	if (size > 0 && fwrite(data, size, 1, file) != 1) {
+		fprintf(stderr, "Error while writing file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	fclose(file);
+}
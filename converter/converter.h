@@ -0,0 +1,151 @@
+/**
+ * @file converter.h
+ * @date 2026-10-18
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+
+#ifndef CONVERTER_H
+#define CONVERTER_H
+
+/* raw images are placed at the same addresses as in the simulator */
+#define DEFAULT_TEXT_BASE (0x40000000)
+#define DEFAULT_DATA_BASE (0x00000004)
+
+struct instr_attr {
+	uint32_t new_addr;
+	uint32_t jump_target;
+	ssize_t target_index; /* array index to the target instruction */
+	bool code_ref; /* holds a part of a code address and keeps its size */
+	bool addr_taken; /* target of an indirect jump */
+	uint64_t exec_count; /* from the profile */
+	uint64_t taken_count;
+	uint8_t pad; /* bytes of NOPs in front of the instruction for alignment */
+	bool expanded; /* compressible, but 32-bit wide for alignment */
+};
+
+extern size_t num_instr;
+extern struct instr *prog;
+extern struct instr_attr *attr;
+
+/* address of the first instruction, only used for J and JAL */
+extern uint32_t text_base;
+
+/* the current index of every input instruction, including the end of the
+ * code. A deleted instruction maps to the instruction that followed it. */
+extern size_t num_input_instr;
+extern size_t *index_map;
+
+/* optional passes that are selected on the command line */
+struct conv_options {
+	bool remove_dead;
+	const char **keep_syms; /* code symbols that stay with remove_dead */
+	size_t num_keep_syms;
+	bool peephole;
+	bool rename_regs;
+	bool fill_slots;
+	bool outline;
+	bool layout_blocks;
+	bool order_funcs;
+	uint32_t align_width; /* 0 if branch targets aren't aligned */
+	size_t num_threads;
+	const char *profile_path;
+	const char *dict_path; /* the dictionary encoding if it isn't NULL */
+};
+
+extern struct conv_options options;
+
+/* the getopt string of the options above */
+#define CONV_OPTIONS "GwrsOF3a:j:k:p:LX:"
+
+/* sets the option opt of the getopt string, false if it isn't one of them */
+bool set_conv_option(int opt, const char *arg);
+
+/* whether the instruction has a small form in the current encoding, the
+ * 16-bit formats or the dictionary */
+bool is_compressible_simple(struct instr *instr);
+
+void parse_code(const uint8_t *code, size_t size);
+void relax_branches(void);
+/* runs the selected passes and relaxes the branches */
+void optimize(void);
+void reorder_instrs(const size_t *order, size_t num);
+size_t append_instr(uint32_t code);
+/* returns the size of the encoded instruction */
+int encode_instr(size_t index, uint8_t bytes[4]);
+/* the NOPs in front of the instruction, at most 6 bytes */
+int encode_padding(size_t index, uint8_t *bytes);
+/* the size of the converted code with the padding */
+uint32_t code_size(void);
+/* encodes all instructions at their new addresses in out */
+void encode_code(uint8_t *out);
+
+#define MAX_THREADS 64
+
+/* works on the instructions [first, end) of one part */
+typedef void (*part_fn)(size_t part, size_t first, size_t end, void *arg);
+
+/* the number of parts that parallel_for splits num instructions into */
+size_t parallel_parts(size_t num);
+void parallel_for(size_t num, part_fn fn, void *arg);
+
+/* maps the file privately, so that it can be changed in memory */
+uint8_t *map_file(const char *path, size_t *size);
+void unmap_file(uint8_t *data, size_t size);
+void write_file(const char *path, const uint8_t *data, size_t size);
+
+/* code addresses outside of jumps and branches, in the text section at
+ * addr with size bytes of input instructions */
+void code_refs_init(uint32_t addr, uint32_t size);
+/* false for raw images, whose code addresses are unknown */
+bool code_refs_known(void);
+bool in_text(uint32_t addr);
+/* the new address of a code address, after update_code_refs */
+uint32_t map_addr(uint32_t addr);
+/* the instruction at the code address was deleted */
+bool addr_removed(uint32_t addr);
+void mark_addr_taken(uint32_t addr);
+/* the HI16 instruction hi and the LO16 instruction lo build a code address */
+void add_code_ref(const uint8_t *code, size_t hi, size_t lo);
+/* live holds every current instruction that stays */
+void remove_dead_code_refs(const bool *live);
+void update_code_refs(void);
+void free_code_refs(void);
+
+void find_jump_tables(const uint8_t *data, size_t size, uint32_t data_base);
+void update_jump_tables(uint8_t *data, uint32_t data_base);
+
+void convert_elf(uint8_t *data, size_t size, const char *out_path);
+
+void remove_dead_code(void);
+void rewrite_instrs(void);
+void rename_registers(void);
+void fill_delay_slots(void);
+void outline_sequences(void);
+void layout_blocks(void);
+void order_functions(void);
+/* uses the dictionary encoding and writes the dictionary */
+void build_dictionary(void);
+
+void align_init(void);
+void align_place(void);
+/* removes the padding and the expansions of align_place */
+void align_reset(void);
+void align_finish(void);
+
+/* the address map for the lockstep mode of the simulator. init takes the
+ * basic blocks of the input before optimize changes them. */
+void addr_map_init(void);
+void write_addr_map(const char *path);
+
+void read_profile(const char *path);
+bool has_profile(void);
+
+#endif
+
@@ -0,0 +1,113 @@
+/**
+ * @file dead_code.c
+ * @date 2026-10-18
+ * Removes the code that can't be reached from the start of the program
+ * (-G). The control flow follows branches, jumps and calls and returns to
+ * the instruction behind the delay slot of every call. Indirect jumps and
+ * calls only reach code addresses, which are known from the relocations,
+ * so raw images keep their code. The symbols to keep (-k) are code
+ * addresses as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "converter.h"
+#include "cfg.h"
+
+/* visited instructions also continue behind themselves */
+static void reach(bool *live, bool *visited, size_t *work, size_t *num_work, ssize_t index)
+{
+	if (index < 0 || index >= (ssize_t)num_instr || visited[index])
+		return;
+
+	live[index] = true;
+	visited[index] = true;
+	work[(*num_work)++] = index;
+}
+
+static void find_live(bool *live)
+{
+	bool *visited = alloc(num_instr, sizeof(*visited));
+	size_t *work = alloc(num_instr, sizeof(*work));
+	size_t num_work = 0;
+
+	reach(live, visited, work, &num_work, 0);
+	for (size_t i = 0; i < num_instr; i++) {
+		if (attr[i].addr_taken)
+			reach(live, visited, work, &num_work, i);
+	}
+
+	while (num_work > 0) {
+		size_t i = work[--num_work];
+		enum operation op = prog[i].op;
+
+		if (!is_branch(op) && op != J && op != JAL && op != JR && op != JALR) {
+			reach(live, visited, work, &num_work, i + 1);
+			continue;
+		}
+
+		/* the delay slot only continues behind it if it is reached otherwise */
+		if (i + 1 < num_instr)
+			live[i + 1] = true;
+
+		if (op != JR && op != JALR)
+			reach(live, visited, work, &num_work, attr[i].target_index);
+
+		/* everything but B, J and JR continues behind the delay slot */
+		if (op != B && op != J && op != JR)
+			reach(live, visited, work, &num_work, i + 2);
+	}
+
+	free(work);
+	free(visited);
+}
+
+void remove_dead_code(void)
+{
+	if (!code_refs_known()) {
+		fprintf(stderr, "Warning: dead code isn't removed without the relocations of an ELF file\n");
+		return;
+	}
+
+	bool *live = alloc(num_instr, sizeof(*live));
+	find_live(live);
+
+	struct cfg cfg;
+	cfg_build(&cfg);
+
+	size_t dead_funcs = 0;
+	for (size_t f = 0; f < cfg.num_funcs; f++) {
+		bool dead = true;
+		for (size_t i = cfg.funcs[f].first; i <= cfg.funcs[f].last && dead; i++) {
+			dead = !live[i];
+		}
+		dead_funcs += dead;
+	}
+
+	size_t *order = alloc(num_instr, sizeof(*order));
+	size_t num_order = 0;
+	uint32_t bytes = 0;
+
+	for (size_t i = 0; i < num_instr; i++) {
+		if (live[i])
+			order[num_order++] = i;
+		else
+			bytes += prog[i].compressed ? 2 : 4;
+	}
+
+	fprintf(stderr, "dead code: %zu of %zu functions and %zu instructions removed, about %u bytes smaller\n",
+		dead_funcs, cfg.num_funcs, num_instr - num_order, bytes);
+	cfg_free(&cfg);
+
+	if (num_order < num_instr) {
+		remove_dead_code_refs(live);
+		reorder_instrs(order, num_order);
+	}
+
+	free(order);
+	free(live);
+}
@@ -0,0 +1,294 @@
+/**
+ * @file delay_slot.c
+ * @date 2026-10-18
+ * Removes the NOPs in delay slots. An independent instruction from before
+ * a branch or jump is moved into its delay slot. The NOP after a load is
+ * removed if the next instruction doesn't use the loaded value, otherwise
+ * the instruction before the load is moved behind it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "converter.h"
+#include "cfg.h"
+
+/* how far a branch looks back for an instruction to fill its delay slot */
+#define FILL_WINDOW 8
+
+#define NONE SIZE_MAX
+
+struct fill_stat {
+	uint32_t branch_slots;
+	uint32_t load_slots;
+	uint32_t nops_removed;
+	uint32_t bytes;
+	uint64_t fetched_bytes;
+};
+
+/* the instruction at every position, NONE if it is deleted */
+static size_t *place = NULL;
+/* instructions that were changed or whose neighbours were changed */
+static bool *touched = NULL;
+
+static bool is_store(enum operation op)
+{
+	return op == SB || op == SH || op == SW;
+}
+
+static bool is_control(enum operation op)
+{
+	return is_branch(op) || op == J || op == JAL || op == JR || op == JALR;
+}
+
+static bool reads_hilo(enum operation op)
+{
+	return op == MFHI || op == MFLO;
+}
+
+static bool writes_hilo(enum operation op)
+{
+	return op == MULT || op == MULTU || op == DIV || op == DIVU || op == MTHI || op == MTLO;
+}
+
+/* instructions that can change their place without side effects. Loads
+ * would need a delay slot themselves and ADD, ADDI and SUB can trap. */
+static bool is_movable(enum operation op)
+{
+	switch (op) {
+	case NOP:
+	case LB:
+	case LH:
+	case LW:
+	case LBU:
+	case LHU:
+	case ADD:
+	case ADDI:
+	case SUB:
+	case MULT:
+	case MULTU:
+	case DIV:
+	case DIVU:
+	case MTHI:
+	case MTLO:
+	case MFHI:
+	case MFLO:
+	case MFC0:
+	case MTC0:
+	case RFE:
+	case BREAK:
+	case SYSCALL:
+		return false;
+
+	default:
+		return !is_control(op);
+	}
+}
+
+static uint32_t reg_uses(size_t index)
+{
+	uint8_t *regs[2];
+	int num = get_src_regs(&prog[index], regs);
+	uint32_t uses = 0;
+
+	for (int i = 0; i < num; i++) {
+		uses |= REG_MASK(*regs[i]);
+	}
+
+	return uses & REG_ALL;
+}
+
+static uint32_t reg_defs(size_t index)
+{
+	int dest = get_dest_reg(&prog[index]);
+	return dest >= 0 ? REG_MASK(dest) & REG_ALL : 0;
+}
+
+/* MIPS-I needs two instructions between MFHI/MFLO and an instruction that
+ * writes HI or LO. Checks it for removing the instruction at index. */
+static bool hilo_hazard(size_t index)
+{
+	bool reads = false;
+	bool writes = false;
+
+	for (size_t i = index >= 2 ? index - 2 : 0; i < index; i++) {
+		reads |= reads_hilo(prog[i].op);
+	}
+
+	for (size_t i = index + 1; i <= index + 2 && i < num_instr; i++) {
+		writes |= writes_hilo(prog[i].op);
+	}
+
+	return reads && writes;
+}
+
+static bool is_first(struct cfg *cfg, size_t index)
+{
+	return cfg->blocks[cfg->block_of[index]].first == index;
+}
+
+static bool all_untouched(size_t first, size_t last)
+{
+	for (size_t i = first; i <= last && i < num_instr; i++) {
+		if (touched[i])
+			return false;
+	}
+
+	return true;
+}
+
+static void touch(size_t first, size_t last)
+{
+	for (size_t i = first; i <= last && i < num_instr; i++) {
+		touched[i] = true;
+	}
+}
+
+static void remove_nop(struct fill_stat *stat, size_t nop)
+{
+	uint32_t size = prog[nop].compressed ? 2 : 4;
+
+	stat->nops_removed++;
+	stat->bytes += size;
+	stat->fetched_bytes += attr[nop].exec_count * size;
+}
+
+/* can the instruction at index be moved behind the instructions up to last? */
+static bool can_move_behind(size_t index, size_t last)
+{
+	uint32_t uses = reg_uses(index);
+	uint32_t defs = reg_defs(index);
+	bool store = is_store(prog[index].op);
+
+	for (size_t i = index + 1; i <= last; i++) {
+		if ((is_control(prog[i].op) && i != last) || prog[i].op == BREAK || prog[i].op == SYSCALL)
+			return false;
+
+		if ((defs & (reg_uses(i) | reg_defs(i))) || (uses & reg_defs(i)))
+			return false;
+
+		if (store && (is_load(prog[i].op) || is_store(prog[i].op)))
+			return false;
+	}
+
+	return true;
+}
+
+static void fill_branch_slot(struct cfg *cfg, struct fill_stat *stat, size_t branch)
+{
+	size_t slot = branch + 1;
+	size_t first = cfg->blocks[cfg->block_of[branch]].first;
+
+	if (slot >= num_instr || prog[slot].op != NOP || attr[slot].code_ref)
+		return;
+
+	for (size_t i = branch; i > first + 1 && branch - i < FILL_WINDOW; i--) {
+		size_t cand = i - 1;
+
+		if (!is_movable(prog[cand].op) || is_control(prog[cand - 1].op) || is_first(cfg, cand))
+			continue;
+
+		if (!can_move_behind(cand, branch) || load_hazard(cand - 1, reg_uses(cand + 1)) ||
+			hilo_hazard(cand) || !all_untouched(cand >= 2 ? cand - 2 : 0, slot + 1))
+			continue;
+
+		place[slot] = cand;
+		place[cand] = NONE;
+		touch(cand >= 2 ? cand - 2 : 0, slot + 1);
+
+		stat->branch_slots++;
+		remove_nop(stat, slot);
+		return;
+	}
+}
+
+static void fill_load_slot(struct cfg *cfg, struct fill_stat *stat, size_t load)
+{
+	size_t nop = load + 1;
+
+	if (nop >= num_instr || prog[nop].op != NOP || attr[nop].code_ref ||
+		is_first(cfg, nop) || (load > 0 && is_control(prog[load - 1].op)))
+		return;
+
+	if (!all_untouched(load >= 2 ? load - 2 : 0, nop + 2) || hilo_hazard(nop))
+		return;
+
+	/* the NOP isn't needed */
+	if (nop + 1 >= num_instr || !load_hazard(load, reg_uses(nop + 1))) {
+		place[nop] = NONE;
+		touch(load >= 2 ? load - 2 : 0, nop + 2);
+		remove_nop(stat, nop);
+		return;
+	}
+
+	/* move the instruction before the load into the delay slot */
+	if (load < 2 || is_first(cfg, load))
+		return;
+
+	size_t cand = load - 1;
+	uint32_t load_regs = reg_uses(load) | reg_defs(load);
+
+	if (!is_movable(prog[cand].op) || is_store(prog[cand].op) || is_first(cfg, cand) ||
+		is_control(prog[cand - 1].op))
+		return;
+
+	if ((reg_defs(cand) & load_regs) || (reg_uses(cand) & reg_defs(load)) ||
+		load_hazard(cand - 1, reg_uses(load)))
+		return;
+
+	place[cand] = load;
+	place[load] = cand;
+	place[nop] = NONE;
+	touch(cand - 1, nop + 2);
+
+	stat->load_slots++;
+	remove_nop(stat, nop);
+}
+
+void fill_delay_slots(void)
+{
+	struct cfg cfg;
+	cfg_build(&cfg);
+
+	place = alloc(num_instr + 1, sizeof(*place));
+	touched = alloc(num_instr + 1, sizeof(*touched));
+
+	for (size_t i = 0; i < num_instr; i++) {
+		place[i] = i;
+	}
+
+	struct fill_stat stat = {0, 0, 0, 0, 0};
+	for (size_t i = 0; i < num_instr; i++) {
+		if (is_control(prog[i].op)) {
+			fill_branch_slot(&cfg, &stat, i);
+		} else if (is_load(prog[i].op)) {
+			fill_load_slot(&cfg, &stat, i);
+		}
+	}
+
+	size_t num = 0;
+	for (size_t i = 0; i < num_instr; i++) {
+		if (place[i] != NONE)
+			place[num++] = place[i];
+	}
+
+	if (num != num_instr)
+		reorder_instrs(place, num);
+
+	fprintf(stderr, "delay slots: %u branch and %u load slots filled, %u NOPs removed, "
+		"%u bytes smaller", stat.branch_slots, stat.load_slots, stat.nops_removed, stat.bytes);
+	if (has_profile()) {
+		fprintf(stderr, ", %" PRIu64 " bytes less fetched", stat.fetched_bytes);
+	}
+	fprintf(stderr, "\n");
+
+	free(place);
+	free(touched);
+	place = NULL;
+	touched = NULL;
+	cfg_free(&cfg);
+}
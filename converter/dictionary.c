@@ -0,0 +1,124 @@
+/**
+ * @file dictionary.c
+ * @date 2026-10-18
+ * Builds the dictionary of the dictionary encoding (-X) from the program
+ * after the other passes. A dictionary entry costs 4 bytes and saves 2
+ * bytes for every instruction that refers to it, so every large word that
+ * occurs at least three times is in it, the most frequent first. Branches,
+ * jumps and the parts of code addresses change with the layout and stay
+ * large, like the branches that don't reach their target with v2.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "../common/v2_instr.h"
+#include "../common/dict_instr.h"
+#include "../common/elf_file.h"
+#include "converter.h"
+
+/* the least number of uses that makes an entry smaller than the words */
+#define MIN_USES 3
+
+/* "sll $0, $0, 0" */
+#define CODE_NOP (0x00000000)
+
+struct dict_word {
+	uint32_t word;
+	size_t uses;
+};
+
+static int cmp_word(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static int cmp_uses(const void *a, const void *b)
+{
+	const struct dict_word *x = a;
+	const struct dict_word *y = b;
+
+	if (x->uses != y->uses)
+		return x->uses < y->uses ? 1 : -1;
+	return (x->word > y->word) - (x->word < y->word);
+}
+
+static bool fixed_word(size_t index)
+{
+	enum operation op = prog[index].op;
+	return !is_branch(op) && op != J && op != JAL && !attr[index].code_ref;
+}
+
+void build_dictionary(void)
+{
+	uint32_t *words = alloc(num_instr, sizeof(*words));
+	size_t num_words = 0;
+
+	for (size_t i = 0; i < num_instr; i++) {
+		if (!fixed_word(i))
+			continue;
+
+		struct instr large = prog[i];
+		large.compressed = false;
+		write_instr_v2(&large, &words[num_words++]);
+	}
+
+	qsort(words, num_words, sizeof(*words), cmp_word);
+
+	struct dict_word *cands = alloc(num_words, sizeof(*cands));
+	size_t num_cands = 0;
+	for (size_t i = 0; i < num_words; ) {
+		size_t k = i;
+		while (k < num_words && words[k] == words[i])
+			k++;
+
+		/* the padding of the alignment needs a small NOP */
+		bool nop = options.align_width > 0 && words[i] == CODE_NOP;
+		if (k - i >= MIN_USES || nop)
+			cands[num_cands++] = (struct dict_word) {words[i], k - i};
+		i = k;
+	}
+
+	qsort(cands, num_cands, sizeof(*cands), cmp_uses);
+	if (num_cands > DICT_MAX_ENTRIES)
+		num_cands = DICT_MAX_ENTRIES;
+
+	bool has_nop = false;
+	for (size_t i = 0; i < num_cands; i++) {
+		words[i] = cands[i].word;
+		has_nop |= cands[i].word == CODE_NOP;
+	}
+
+	if (options.align_width > 0 && !has_nop) {
+		/* the least used entry makes room for the NOP */
+		if (num_cands == DICT_MAX_ENTRIES)
+			num_cands--;
+		words[num_cands++] = CODE_NOP;
+	}
+
+	use_dictionary(words, num_cands);
+
+	size_t num_small = 0;
+	for (size_t i = 0; i < num_instr; i++) {
+		prog[i].compressed = fixed_word(i) && is_compressible_simple(&prog[i]);
+		num_small += prog[i].compressed;
+	}
+
+	uint8_t *out = alloc(num_cands, 4);
+	for (size_t i = 0; i < num_cands; i++) {
+		elf_write32(out + 4 * i, words[i]);
+	}
+	write_file(options.dict_path, out, 4 * num_cands);
+
+	fprintf(stderr, "dictionary: %zu entries (%zu bytes), %zu of %zu instructions are indices\n",
+		num_cands, 4 * num_cands, num_small, num_instr);
+
+	free(out);
+	free(cands);
+	free(words);
+}
@@ -0,0 +1,351 @@
+/**
+ * @file elf_conv.c
+ * @date 2026-10-18
+ * Converts the text section of a linked ELF file. The relocations that the
+ * linker kept with --emit-relocs tell where code addresses are stored, so
+ * that they can be updated after the conversion. Instructions are updated
+ * by the converter itself, this file finds the HI16/LO16 pairs and updates
+ * data words, symbols and the headers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "../common/elf_file.h"
+#include "converter.h"
+
+struct hi16 {
+	size_t index;
+	uint32_t sym;
+};
+
+static uint32_t text_addr = 0;
+static uint32_t text_size = 0;
+static uint32_t new_text_size = 0;
+
+/*
+ * Pairs the HI16 and LO16 relocations of the text section. Several HI16
+ * can be followed by one LO16 and GCC reuses one HI16 for several LO16 of
+ * the same symbol.
+ */
+static void find_code_refs(struct elf_file *elf, size_t rel, const uint8_t *code)
+{
+	size_t num_syms = elf_num_entries(elf, elf->shdr[rel].sh_link);
+	ssize_t *last_hi = alloc(num_syms + 1, sizeof(*last_hi));
+	struct hi16 *pending = alloc(elf_num_entries(elf, rel), sizeof(*pending));
+	size_t num_pending = 0;
+
+	for (size_t i = 0; i <= num_syms; i++) {
+		last_hi[i] = -1;
+	}
+
+	const uint8_t *entry = elf_section_data(elf, rel);
+	for (size_t i = 0; i < elf_num_entries(elf, rel); i++, entry += sizeof(Elf32_Rel)) {
+		uint32_t offset = elf_read32(entry + offsetof(Elf32_Rel, r_offset));
+		uint32_t info = elf_read32(entry + offsetof(Elf32_Rel, r_info));
+		uint32_t sym = ELF32_R_SYM(info);
+
+		if (offset < text_addr || offset - text_addr >= text_size || sym > num_syms) {
+			fprintf(stderr, "Invalid relocation at 0x%8.8X\n", offset);
+			exit(EXIT_FAILURE);
+		}
+
+		size_t index = (offset - text_addr) / 4;
+
+		switch (ELF32_R_TYPE(info)) {
+		case R_MIPS_HI16:
+			pending[num_pending++] = (struct hi16) {index, sym};
+			break;
+
+		case R_MIPS_LO16: {
+			size_t num_left = 0;
+			for (size_t j = 0; j < num_pending; j++) {
+				if (pending[j].sym == sym) {
+					add_code_ref(code, pending[j].index, index);
+					last_hi[sym] = pending[j].index;
+				} else {
+					pending[num_left++] = pending[j];
+				}
+			}
+
+			if (num_left == num_pending && last_hi[sym] >= 0) {
+				add_code_ref(code, last_hi[sym], index);
+			}
+
+			num_pending = num_left;
+			break;
+		}
+
+		case R_MIPS_32:
+			fprintf(stderr, "Data in the text section at 0x%8.8X isn't supported\n", offset);
+			exit(EXIT_FAILURE);
+
+		default:
+			/* jumps and branches are handled by the converter */
+			break;
+		}
+	}
+
+	for (size_t j = 0; j < num_pending; j++) {
+		fprintf(stderr, "Warning: HI16 relocation at 0x%8.8X without LO16\n",
+			text_addr + (uint32_t)pending[j].index * 4);
+	}
+
+	free(last_hi);
+	free(pending);
+}
+
+static void find_data_refs(struct elf_file *elf, size_t rel)
+{
+	const uint8_t *entry = elf_section_data(elf, rel);
+
+	if (elf->shdr[rel].sh_info >= elf->ehdr.e_shnum)
+		return;
+
+	Elf32_Shdr *target = &elf->shdr[elf->shdr[rel].sh_info];
+	if (target->sh_type == SHT_NOBITS || target->sh_size < 4)
+		return;
+
+	for (size_t i = 0; i < elf_num_entries(elf, rel); i++, entry += sizeof(Elf32_Rel)) {
+		uint32_t offset = elf_read32(entry + offsetof(Elf32_Rel, r_offset));
+		uint32_t info = elf_read32(entry + offsetof(Elf32_Rel, r_info));
+
+		if (ELF32_R_TYPE(info) != R_MIPS_32 || offset < target->sh_addr ||
+			offset - target->sh_addr > target->sh_size - 4)
+			continue;
+
+		mark_addr_taken(elf_read32(elf->data + target->sh_offset + (offset - target->sh_addr)));
+	}
+}
+
+static bool has_name(struct elf_file *elf, Elf32_Shdr *strtab, uint32_t name, const char *str)
+{
+	if (name >= strtab->sh_size)
+		return false;
+
+	const char *sym_name = (const char *)elf->data + strtab->sh_offset + name;
+	return memchr(sym_name, '\0', strtab->sh_size - name) != NULL && strcmp(sym_name, str) == 0;
+}
+
+/* the symbols to keep are reached like code addresses in data */
+static void keep_symbols(struct elf_file *elf)
+{
+	for (size_t k = 0; k < options.num_keep_syms; k++) {
+		bool found = false;
+
+		for (size_t i = 1; i < elf->ehdr.e_shnum && !found; i++) {
+			if (elf->shdr[i].sh_type != SHT_SYMTAB || elf->shdr[i].sh_link >= elf->ehdr.e_shnum)
+				continue;
+
+			const uint8_t *sym = elf_section_data(elf, i);
+			Elf32_Shdr *strtab = &elf->shdr[elf->shdr[i].sh_link];
+
+			for (size_t s = 0; s < elf_num_entries(elf, i); s++, sym += sizeof(Elf32_Sym)) {
+				uint32_t name = elf_read32(sym + offsetof(Elf32_Sym, st_name));
+				if (!has_name(elf, strtab, name, options.keep_syms[k]))
+					continue;
+
+				uint32_t value = elf_read32(sym + offsetof(Elf32_Sym, st_value));
+				if (!in_text(value)) {
+					fprintf(stderr, "The symbol '%s' to keep isn't in the text section\n", options.keep_syms[k]);
+					exit(EXIT_FAILURE);
+				}
+
+				mark_addr_taken(value);
+				found = true;
+				break;
+			}
+		}
+
+		if (!found) {
+			fprintf(stderr, "The symbol '%s' to keep isn't defined\n", options.keep_syms[k]);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/* updates the code addresses in the data words and the relocations itself */
+static void update_relocs(struct elf_file *elf, size_t rel, size_t text)
+{
+	Elf32_Shdr *target = &elf->shdr[elf->shdr[rel].sh_info];
+	uint8_t *entry = elf_section_data(elf, rel);
+
+	for (size_t i = 0; i < elf_num_entries(elf, rel); i++, entry += sizeof(Elf32_Rel)) {
+		uint32_t offset = elf_read32(entry + offsetof(Elf32_Rel, r_offset));
+		uint32_t info = elf_read32(entry + offsetof(Elf32_Rel, r_info));
+
+		if (elf->shdr[rel].sh_info == text) {
+			/* the relocations of deleted instructions don't apply anymore */
+			if (in_text(offset) && addr_removed(offset))
+				elf_write32(entry + offsetof(Elf32_Rel, r_info), ELF32_R_INFO(ELF32_R_SYM(info), R_MIPS_NONE));
+			elf_write32(entry + offsetof(Elf32_Rel, r_offset), map_addr(offset));
+			continue;
+		}
+
+		if (ELF32_R_TYPE(info) != R_MIPS_32 || target->sh_type == SHT_NOBITS)
+			continue;
+
+		if (offset < target->sh_addr || offset - target->sh_addr > target->sh_size - 4) {
+			fprintf(stderr, "Invalid relocation at 0x%8.8X\n", offset);
+			exit(EXIT_FAILURE);
+		}
+
+		uint8_t *word = elf->data + target->sh_offset + (offset - target->sh_addr);
+		if (in_text(elf_read32(word))) {
+			elf_write32(word, map_addr(elf_read32(word)));
+		}
+	}
+}
+
+/* the end of the instructions in [addr, end) after they were moved */
+static uint32_t map_end(uint32_t addr, uint32_t end)
+{
+	size_t first = (addr - text_addr) / 4;
+	size_t last = (end - text_addr) / 4;
+	uint32_t new_end = map_addr(addr);
+
+	for (size_t i = first; i < last; i++) {
+		if (addr_removed(text_addr + 4 * i) || index_map[i] >= num_instr)
+			continue;
+
+		size_t k = index_map[i];
+		uint32_t instr_end = text_addr + attr[k].new_addr + (prog[k].compressed ? 2 : 4);
+		if (instr_end > new_end)
+			new_end = instr_end;
+	}
+
+	return new_end;
+}
+
+static void update_symbols(struct elf_file *elf, size_t symtab, size_t text)
+{
+	uint8_t *sym = elf_section_data(elf, symtab);
+
+	for (size_t i = 0; i < elf_num_entries(elf, symtab); i++, sym += sizeof(Elf32_Sym)) {
+		uint32_t value = elf_read32(sym + offsetof(Elf32_Sym, st_value));
+		uint32_t size = elf_read32(sym + offsetof(Elf32_Sym, st_size));
+
+		if (elf_read16(sym + offsetof(Elf32_Sym, st_shndx)) != text || !in_text(value))
+			continue;
+
+		uint32_t new_value = map_addr(value);
+		elf_write32(sym + offsetof(Elf32_Sym, st_value), new_value);
+
+		if (in_text(value + size) && size % 4 == 0) {
+			elf_write32(sym + offsetof(Elf32_Sym, st_size), map_end(value, value + size) - new_value);
+		}
+	}
+}
+
+void convert_elf(uint8_t *data, size_t size, const char *out_path)
+{
+	struct elf_file elf;
+	elf_parse(&elf, data, size);
+
+	if (elf.ehdr.e_type != ET_EXEC) {
+		fprintf(stderr, "Only linked executables can be converted\n");
+		exit(EXIT_FAILURE);
+	}
+
+	size_t text = 0;
+	bool has_relocs = false;
+	for (size_t i = 1; i < elf.ehdr.e_shnum; i++) {
+		Elf32_Shdr *shdr = &elf.shdr[i];
+
+		if ((shdr->sh_flags & SHF_EXECINSTR) && shdr->sh_size > 0) {
+			if (text != 0) {
+				fprintf(stderr, "Only one text section is supported\n");
+				exit(EXIT_FAILURE);
+			}
+			text = i;
+		}
+
+		if (shdr->sh_type == SHT_RELA) {
+			fprintf(stderr, "RELA relocations aren't supported\n");
+			exit(EXIT_FAILURE);
+		}
+
+		if (shdr->sh_type == SHT_REL) {
+			has_relocs = true;
+		}
+	}
+
+	if (text == 0 || elf.shdr[text].sh_type != SHT_PROGBITS) {
+		fprintf(stderr, "No text section found\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (!has_relocs) {
+		fprintf(stderr, "Warning: no relocations found, link with --emit-relocs to update the "
+			"code addresses in data\n");
+	}
+
+	text_addr = elf.shdr[text].sh_addr;
+	text_size = elf.shdr[text].sh_size;
+	text_base = text_addr;
+	code_refs_init(text_addr, text_size);
+
+	uint8_t *code = elf_section_data(&elf, text);
+	parse_code(code, text_size);
+
+	for (size_t i = 1; i < elf.ehdr.e_shnum; i++) {
+		if (elf.shdr[i].sh_type == SHT_REL && elf.shdr[i].sh_info == text) {
+			find_code_refs(&elf, i, code);
+		} else if (elf.shdr[i].sh_type == SHT_REL) {
+			find_data_refs(&elf, i);
+		}
+	}
+
+	mark_addr_taken(elf.ehdr.e_entry);
+	keep_symbols(&elf);
+
+	optimize();
+
+	new_text_size = code_size();
+
+	if (new_text_size > text_size) {
+		fprintf(stderr, "The converted code doesn't fit into the text section\n");
+		exit(EXIT_FAILURE);
+	}
+
+	update_code_refs();
+
+	/* the converted code stays at the same place */
+	encode_code(code);
+	memset(code + new_text_size, 0, text_size - new_text_size);
+
+	for (size_t i = 1; i < elf.ehdr.e_shnum; i++) {
+		if (elf.shdr[i].sh_type == SHT_REL) {
+			update_relocs(&elf, i, text);
+		} else if (elf.shdr[i].sh_type == SHT_SYMTAB || elf.shdr[i].sh_type == SHT_DYNSYM) {
+			update_symbols(&elf, i, text);
+		}
+	}
+
+	if (in_text(elf.ehdr.e_entry)) {
+		elf.ehdr.e_entry = map_addr(elf.ehdr.e_entry);
+	}
+
+	/* shrink the segment if the text section is at its end */
+	uint32_t text_end = text_addr + text_size;
+	for (size_t i = 0; i < elf.ehdr.e_phnum; i++) {
+		Elf32_Phdr *phdr = &elf.phdr[i];
+		if (phdr->p_vaddr > text_addr || phdr->p_vaddr + phdr->p_memsz < text_end)
+			continue;
+
+		if (phdr->p_vaddr + phdr->p_filesz == text_end)
+			phdr->p_filesz -= text_size - new_text_size;
+		if (phdr->p_vaddr + phdr->p_memsz == text_end)
+			phdr->p_memsz -= text_size - new_text_size;
+	}
+
+	elf.shdr[text].sh_size = new_text_size;
+	elf_update(&elf);
+
+	write_file(out_path, elf.data, elf.size);
+	elf_free(&elf);
+	free_code_refs();
+}
@@ -0,0 +1,350 @@
+/**
+ * @file func_order.c
+ * @date 2026-10-18
+ * Places functions next to the functions they call, so that more J and JAL
+ * are in the range of the compressed B and BAL. The call graph is weighted
+ * with one per call site plus the calls in the profile, which are the bytes
+ * a compressed call saves in size and in fetches. Clusters of functions are
+ * merged along the heaviest edges (Pettis and Hansen) and placed next to
+ * the clusters they are most connected with. The first function stays at
+ * the start and functions that fall through into the next one stay with it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "converter.h"
+#include "cfg.h"
+
+#define NONE SIZE_MAX
+
+/* the range of B and BAL */
+#define SHORT_MIN (-1024)
+#define SHORT_MAX (1022)
+
+/* functions that have to stay together */
+struct unit {
+	size_t first;
+	size_t last;
+	uint32_t size;
+	size_t next; /* the next unit in the cluster */
+	size_t cluster; /* the first unit of the cluster */
+};
+
+struct call_edge {
+	size_t src;
+	size_t dst;
+	uint64_t weight;
+};
+
+static struct unit *units = NULL;
+static size_t num_units = 0;
+static size_t *unit_of = NULL;
+/* the estimated offset of every instruction in its unit */
+static uint32_t *unit_offs = NULL;
+
+static struct call_edge *edges = NULL;
+static size_t num_edges = 0;
+
+static bool is_jump(enum operation op)
+{
+	return op == J || op == JAL || op == B || op == BAL;
+}
+
+static uint32_t instr_size(size_t index)
+{
+	/* jumps start short in the relaxation */
+	return prog[index].compressed || is_jump(prog[index].op) ? 2 : 4;
+}
+
+/* does the code end with a jump or return, so that nothing falls out? */
+static bool ends_closed(size_t last)
+{
+	if (last == 0)
+		return false;
+
+	enum operation op = prog[last - 1].op;
+	return op == J || op == B || op == JR;
+}
+
+static void find_units(struct cfg *cfg)
+{
+	units = alloc(cfg->num_funcs, sizeof(*units));
+	unit_of = alloc(num_instr, sizeof(*unit_of));
+	unit_offs = alloc(num_instr, sizeof(*unit_offs));
+	num_units = 0;
+
+	for (size_t f = 0; f < cfg->num_funcs; f++) {
+		struct function *func = &cfg->funcs[f];
+
+		/* the previous function falls through into this one */
+		if (num_units > 0 && !ends_closed(units[num_units - 1].last)) {
+			units[num_units - 1].last = func->last;
+		} else {
+			units[num_units] = (struct unit) {func->first, func->last, 0, NONE, num_units};
+			num_units++;
+		}
+	}
+
+	for (size_t u = 0; u < num_units; u++) {
+		for (size_t i = units[u].first; i <= units[u].last; i++) {
+			unit_of[i] = u;
+			unit_offs[i] = units[u].size;
+			units[u].size += instr_size(i);
+		}
+	}
+}
+
+static int cmp_pair(const void *left, const void *right)
+{
+	const struct call_edge *l = left;
+	const struct call_edge *r = right;
+
+	if (l->src != r->src)
+		return l->src < r->src ? -1 : 1;
+	return l->dst < r->dst ? -1 : (l->dst > r->dst);
+}
+
+static int cmp_weight(const void *left, const void *right)
+{
+	const struct call_edge *l = left;
+	const struct call_edge *r = right;
+
+	if (l->weight != r->weight)
+		return l->weight < r->weight ? 1 : -1;
+	return cmp_pair(left, right);
+}
+
+/* the undirected edges between the units, heaviest first */
+static void find_edges(void)
+{
+	edges = alloc(num_instr, sizeof(*edges));
+	num_edges = 0;
+
+	for (size_t i = 0; i < num_instr; i++) {
+		ssize_t target = attr[i].target_index;
+		if (!is_jump(prog[i].op) || target < 0 || (size_t)target >= num_instr)
+			continue;
+
+		size_t src = unit_of[i];
+		size_t dst = unit_of[target];
+		if (src == dst)
+			continue;
+
+		edges[num_edges++] = (struct call_edge) {
+			src < dst ? src : dst, src < dst ? dst : src, 1 + attr[i].exec_count
+		};
+	}
+
+	qsort(edges, num_edges, sizeof(*edges), cmp_pair);
+
+	size_t num = 0;
+	for (size_t k = 0; k < num_edges; k++) {
+		if (num > 0 && edges[num - 1].src == edges[k].src && edges[num - 1].dst == edges[k].dst) {
+			edges[num - 1].weight += edges[k].weight;
+		} else {
+			edges[num++] = edges[k];
+		}
+	}
+	num_edges = num;
+
+	qsort(edges, num_edges, sizeof(*edges), cmp_weight);
+}
+
+static size_t cluster_tail(size_t head)
+{
+	while (units[head].next != NONE) {
+		head = units[head].next;
+	}
+	return head;
+}
+
+/* the distance from the start of the cluster to the middle of the unit */
+static uint32_t unit_offset(size_t head, size_t u)
+{
+	uint32_t offset = 0;
+	for (size_t v = head; v != u; v = units[v].next) {
+		offset += units[v].size;
+	}
+	return offset + units[u].size / 2;
+}
+
+static uint32_t cluster_size(size_t head)
+{
+	uint32_t size = 0;
+	for (size_t v = head; v != NONE; v = units[v].next) {
+		size += units[v].size;
+	}
+	return size;
+}
+
+static void append_cluster(size_t head, size_t other)
+{
+	units[cluster_tail(head)].next = other;
+	for (size_t v = other; v != NONE; v = units[v].next) {
+		units[v].cluster = head;
+	}
+}
+
+/* merges the clusters of the edge so that its units are close together */
+static void merge_clusters(struct call_edge *edge)
+{
+	size_t a = units[edge->src].cluster;
+	size_t b = units[edge->dst].cluster;
+
+	if (a == b)
+		return;
+
+	/* the cluster of the first unit has to stay first */
+	if (b == 0) {
+		append_cluster(b, a);
+		return;
+	}
+
+	if (a == 0) {
+		append_cluster(a, b);
+		return;
+	}
+
+	uint32_t ab = cluster_size(a) - unit_offset(a, edge->src) + unit_offset(b, edge->dst);
+	uint32_t ba = cluster_size(b) - unit_offset(b, edge->dst) + unit_offset(a, edge->src);
+
+	if (ab <= ba) {
+		append_cluster(a, b);
+	} else {
+		append_cluster(b, a);
+	}
+}
+
+/* the order of the units, starting with the cluster of the first one */
+static size_t order_clusters(size_t *order)
+{
+	uint64_t *conn = alloc(num_units, sizeof(*conn));
+	bool *placed = alloc(num_units, sizeof(*placed));
+	size_t num = 0;
+	size_t head = 0;
+
+	while (head != NONE) {
+		for (size_t u = head; u != NONE; u = units[u].next) {
+			order[num++] = u;
+			placed[u] = true;
+		}
+
+		for (size_t k = 0; k < num_edges; k++) {
+			size_t src = edges[k].src;
+			size_t dst = edges[k].dst;
+
+			if (placed[src] != placed[dst])
+				conn[units[placed[src] ? dst : src].cluster] += edges[k].weight;
+		}
+
+		/* the most connected cluster, then the first one */
+		head = NONE;
+		for (size_t u = 0; u < num_units; u++) {
+			if (units[u].cluster != u || placed[u])
+				continue;
+
+			if (head == NONE || conn[u] > conn[head])
+				head = u;
+		}
+
+		for (size_t u = 0; u < num_units; u++) {
+			conn[u] = 0;
+		}
+	}
+
+	free(conn);
+	free(placed);
+	return num;
+}
+
+/* the weight of the calls that reach their target with B or BAL */
+static uint64_t short_calls(const size_t *order)
+{
+	uint32_t *start = alloc(num_units, sizeof(*start));
+	uint64_t weight = 0;
+
+	uint32_t addr = 0;
+	for (size_t k = 0; k < num_units; k++) {
+		start[order[k]] = addr;
+		addr += units[order[k]].size;
+	}
+
+	for (size_t i = 0; i < num_instr; i++) {
+		ssize_t target = attr[i].target_index;
+		if (!is_jump(prog[i].op) || target < 0 || (size_t)target >= num_instr)
+			continue;
+
+		/* the offset is relative to the delay slot */
+		int64_t from = start[unit_of[i]] + unit_offs[i] + 2;
+		int64_t to = start[unit_of[target]] + unit_offs[target];
+
+		if (SHORT_MIN <= to - from && to - from <= SHORT_MAX)
+			weight += 1 + attr[i].exec_count;
+	}
+
+	free(start);
+	return weight;
+}
+
+void order_functions(void)
+{
+	struct cfg cfg;
+	cfg_build(&cfg);
+
+	find_units(&cfg);
+	find_edges();
+
+	for (size_t k = 0; k < num_edges; k++) {
+		merge_clusters(&edges[k]);
+	}
+
+	size_t *order = alloc(num_units, sizeof(*order));
+	size_t *orig = alloc(num_units, sizeof(*orig));
+	size_t num = order_clusters(order);
+
+	for (size_t u = 0; u < num_units; u++) {
+		orig[u] = u;
+	}
+
+	uint64_t before = num > 0 ? short_calls(orig) : 0;
+	uint64_t after = num > 0 ? short_calls(order) : 0;
+	uint32_t moved = 0;
+
+	/* keep the order of the linker unless more calls become short */
+	if (after > before) {
+		size_t *instrs = alloc(num_instr, sizeof(*instrs));
+		size_t num_instrs = 0;
+
+		for (size_t k = 0; k < num; k++) {
+			moved += order[k] != k;
+			for (size_t i = units[order[k]].first; i <= units[order[k]].last; i++) {
+				instrs[num_instrs++] = i;
+			}
+		}
+
+		reorder_instrs(instrs, num_instrs);
+		free(instrs);
+	} else {
+		after = before;
+	}
+
+	fprintf(stderr, "function order: %u of %zu functions moved, short call weight %" PRIu64
+		" -> %" PRIu64 "\n", moved, num_units, before, after);
+
+	free(order);
+	free(orig);
+	free(units);
+	free(unit_of);
+	free(unit_offs);
+	free(edges);
+	units = NULL;
+	unit_of = NULL;
+	unit_offs = NULL;
+	edges = NULL;
+	cfg_free(&cfg);
+}
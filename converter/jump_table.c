@@ -0,0 +1,222 @@
+/**
+ * @file jump_table.c
+ * @date 2026-10-18
+ * Finds the jump tables of switch statements in raw images and updates
+ * the code addresses in them. GCC creates the following dispatch code:
+ *
+ *	sltiu	rc, ri, N
+ *	beqz	rc, default
+ *	sll	rx, ri, 2
+ *	lui	rb, %hi(table)
+ *	addiu	rb, rb, %lo(table)
+ *	addu	rx, rx, rb
+ *	lw	rx, 0(rx)
+ *	jr	rx
+ *
+ * The order of the instructions differs and the %lo part may also be the
+ * offset of the LW.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "../common/elf_file.h"
+#include "converter.h"
+
+/* how far the dispatch code is searched backwards from the JR */
+#define JT_WINDOW 16
+
+struct jump_table {
+	uint32_t addr;
+	uint32_t num_entries;
+};
+
+static struct jump_table *tables = NULL;
+static size_t num_tables = 0;
+static size_t max_tables = 0;
+
+static bool is_code_addr(uint32_t addr)
+{
+	return addr >= text_base && addr - text_base < num_instr * 4 && addr % 4 == 0;
+}
+
+/* the last instruction before index that writes reg */
+static ssize_t find_def(size_t index, uint8_t reg)
+{
+	size_t first = index > JT_WINDOW ? index - JT_WINDOW : 0;
+
+	for (size_t i = index; i > first; i--) {
+		if (get_dest_reg(&prog[i - 1]) == reg)
+			return i - 1;
+	}
+
+	return -1;
+}
+
+static bool const_value(size_t index, uint8_t reg, uint32_t *value)
+{
+	if (reg == 0) {
+		*value = 0;
+		return true;
+	}
+
+	ssize_t def = find_def(index, reg);
+	if (def < 0)
+		return false;
+
+	struct instr *instr = &prog[def];
+	switch (instr->op) {
+	case LUI:
+		*value = instr->imm << 16;
+		return true;
+
+	case ADDIU:
+		if (!const_value(def, instr->rs, value))
+			return false;
+		*value += instr->simm;
+		return true;
+
+	case ORI:
+		if (!const_value(def, instr->rs, value))
+			return false;
+		*value |= instr->imm;
+		return true;
+
+	case MOV:
+		return const_value(def, instr->rt, value);
+
+	case LSI:
+		*value = instr->simm;
+		return true;
+
+	case CLEAR:
+		*value = 0;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/* is reg the index register multiplied by 4? */
+static ssize_t scaled_index(size_t index, uint8_t reg, uint8_t *index_reg)
+{
+	ssize_t def = find_def(index, reg);
+
+	if (def < 0 || prog[def].op != SLL || prog[def].shamt != 2)
+		return -1;
+
+	*index_reg = prog[def].rt;
+	return def;
+}
+
+/* the number of entries from the bound check or -1 */
+static int32_t table_bound(size_t index, uint8_t index_reg)
+{
+	size_t first = index > JT_WINDOW ? index - JT_WINDOW : 0;
+
+	for (size_t i = index; i > first; i--) {
+		struct instr *instr = &prog[i - 1];
+
+		if (instr->op == SLTIU && instr->rs == index_reg)
+			return instr->imm;
+		if (get_dest_reg(instr) == index_reg)
+			break;
+	}
+
+	return -1;
+}
+
+static void add_table(size_t jr, uint32_t addr, int32_t bound,
+	const uint8_t *data, size_t size, uint32_t data_base)
+{
+	if (addr < data_base || addr % 4 != 0 || addr - data_base >= size)
+		return;
+
+	for (size_t i = 0; i < num_tables; i++) {
+		if (tables[i].addr == addr)
+			return;
+	}
+
+	size_t max_entries = (size - (addr - data_base)) / 4;
+	const uint8_t *entry = data + (addr - data_base);
+	uint32_t num = 0;
+
+	if (bound >= 0) {
+		if ((uint32_t)bound > max_entries)
+			return;
+
+		for (num = 0; num < (uint32_t)bound; num++) {
+			if (!is_code_addr(elf_read32(entry + 4 * num))) {
+				fprintf(stderr, "Warning: jump table at 0x%8.8X for the JR at 0x%8.8zX "
+					"contains a non-code address\n", addr, jr * 4);
+				return;
+			}
+		}
+	} else {
+		/* without a bound check the table ends at the first non-code address */
+		while (num < max_entries && is_code_addr(elf_read32(entry + 4 * num))) {
+			num++;
+		}
+	}
+
+	if (num == 0)
+		return;
+
+	tables = grow(tables, num_tables, &max_tables, sizeof(*tables));
+	tables[num_tables++] = (struct jump_table) {addr, num};
+
+	for (uint32_t i = 0; i < num; i++) {
+		attr[(elf_read32(entry + 4 * i) - text_base) / 4].addr_taken = true;
+	}
+}
+
+void find_jump_tables(const uint8_t *data, size_t size, uint32_t data_base)
+{
+	for (size_t i = 0; i < num_instr; i++) {
+		if (prog[i].op != JR || prog[i].rs == 31)
+			continue;
+
+		ssize_t load = find_def(i, prog[i].rs);
+		if (load < 0 || prog[load].op != LW)
+			continue;
+
+		ssize_t add = find_def(load, prog[load].rs);
+		if (add < 0 || prog[add].op != ADDU)
+			continue;
+
+		/* one operand of the ADDU is the scaled index, the other one the table */
+		uint8_t ops[2] = {prog[add].rs, prog[add].rt};
+		for (int j = 0; j < 2; j++) {
+			uint8_t index_reg;
+			uint32_t base;
+			ssize_t shift = scaled_index(add, ops[j], &index_reg);
+
+			if (shift < 0 || !const_value(add, ops[1 - j], &base))
+				continue;
+
+			add_table(i, base + prog[load].simm, table_bound(shift, index_reg),
+				data, size, data_base);
+			break;
+		}
+	}
+}
+
+void update_jump_tables(uint8_t *data, uint32_t data_base)
+{
+	for (size_t i = 0; i < num_tables; i++) {
+		uint8_t *entry = data + (tables[i].addr - data_base);
+
+		for (uint32_t j = 0; j < tables[i].num_entries; j++, entry += 4) {
+			uint32_t addr = elf_read32(entry);
+			elf_write32(entry, text_base + attr[index_map[(addr - text_base) / 4]].new_addr);
+		}
+	}
+
+	free(tables);
+	tables = NULL;
+	num_tables = 0;
+	max_tables = 0;
+}
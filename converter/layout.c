@@ -0,0 +1,447 @@
+/**
+ * @file layout.c
+ * @date 2026-10-18
+ * Profile-guided layout of the basic blocks in every function. The blocks
+ * are merged into chains along the hottest forward edges (Pettis and
+ * Hansen) so that hot edges fall through. Back edges aren't merged, as that
+ * would need a jump in the loop. The chains are then placed next to the
+ * chains they are most connected to, which keeps hot branches short
+ * enough for the compressed formats. Conditional branches are inverted
+ * if their target follows them, jumps to the next block are removed and
+ * a jump is added where a fall through edge is broken. A function keeps its
+ * order unless the new one fetches fewer jumps.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "converter.h"
+#include "cfg.h"
+
+#define NONE SIZE_MAX
+
+/* fetched bytes of a compressed jump and its delay slot */
+#define JUMP_COST (4)
+
+/* "beq $0, $0, 0" and "sll $0, $0, 0" */
+#define CODE_B (0x10000000)
+#define CODE_NOP (0x00000000)
+
+struct edge {
+	size_t src;
+	size_t dst;
+	uint64_t count;
+};
+
+struct layout_stat {
+	uint32_t funcs;
+	uint32_t inverted;
+	uint32_t removed;
+	uint32_t inserted;
+	uint64_t cost_before;
+	uint64_t cost_after;
+};
+
+/* the number of instructions without the added jumps */
+static size_t num_code = 0;
+static size_t *chain_next = NULL;
+static size_t *chain_prev = NULL;
+static size_t *chain_of = NULL;
+static uint64_t *conn = NULL;
+static bool *placed = NULL;
+
+static bool is_cond_branch(enum operation op)
+{
+	return op == BEQ || op == BNE || op == BEQZ || op == BNEZ || op == BLTZ ||
+		op == BGEZ || op == BLEZ || op == BGTZ;
+}
+
+static bool is_control(enum operation op)
+{
+	return is_branch(op) || op == J || op == JAL || op == JR || op == JALR;
+}
+
+static enum operation invert(enum operation op)
+{
+	switch (op) {
+	case BEQ:  return BNE;
+	case BNE:  return BEQ;
+	case BEQZ: return BNEZ;
+	case BNEZ: return BEQZ;
+	case BLTZ: return BGEZ;
+	case BGEZ: return BLTZ;
+	case BLEZ: return BGTZ;
+	case BGTZ: return BLEZ;
+	default:   return INVALID_OP;
+	}
+}
+
+/* the control transfer at the end of the block or NONE */
+static size_t block_ct(struct block *block)
+{
+	if (block->last == block->first)
+		return NONE;
+
+	enum operation op = prog[block->last - 1].op;
+	if (is_cond_branch(op) || op == B || op == J || op == JR)
+		return block->last - 1;
+
+	return NONE;
+}
+
+static size_t fall_block(struct cfg *cfg, struct block *block)
+{
+	return block->last + 1 < num_code ? cfg->block_of[block->last + 1] : NONE;
+}
+
+static size_t target_block(struct cfg *cfg, size_t ct)
+{
+	ssize_t target = attr[ct].target_index;
+	if (target < 0 || (size_t)target >= num_code)
+		return NONE;
+
+	return cfg->block_of[target];
+}
+
+/* the edges that can fall through and their execution counts */
+static int block_edges(struct cfg *cfg, size_t b, struct edge edges[2])
+{
+	struct block *block = &cfg->blocks[b];
+	size_t ct = block_ct(block);
+	int num = 0;
+
+	if (ct == NONE) {
+		edges[num++] = (struct edge) {b, fall_block(cfg, block), attr[block->last].exec_count};
+	} else if (is_cond_branch(prog[ct].op)) {
+		uint64_t taken = attr[ct].taken_count;
+		uint64_t exec = attr[ct].exec_count;
+
+		edges[num++] = (struct edge) {b, target_block(cfg, ct), taken};
+		edges[num++] = (struct edge) {b, fall_block(cfg, block), exec > taken ? exec - taken : 0};
+	} else if (prog[ct].op != JR) {
+		edges[num++] = (struct edge) {b, target_block(cfg, ct), attr[ct].exec_count};
+	}
+
+	return num;
+}
+
+/* can the blocks of the function be rearranged? */
+static bool can_reorder(struct cfg *cfg, struct function *func)
+{
+	size_t first = cfg->block_of[func->first];
+	size_t last = cfg->block_of[func->last];
+
+	if (attr[func->first].exec_count == 0)
+		return false;
+
+	for (size_t b = first; b <= last; b++) {
+		struct block *block = &cfg->blocks[b];
+		size_t ct = block_ct(block);
+
+		/* a delay slot in another block or a branch into the middle of a block */
+		if (is_control(prog[block->last].op))
+			return false;
+
+		if (ct != NONE && prog[ct].op != JR) {
+			size_t target = target_block(cfg, ct);
+			if (target == NONE || cfg->blocks[target].first != (size_t)attr[ct].target_index)
+				return false;
+		}
+
+		if (ct == NONE || is_cond_branch(prog[ct].op)) {
+			if (fall_block(cfg, block) == NONE)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static int cmp_edge(const void *left, const void *right)
+{
+	const struct edge *l = left;
+	const struct edge *r = right;
+
+	if (l->count != r->count)
+		return l->count < r->count ? 1 : -1;
+	if (l->src != r->src)
+		return l->src < r->src ? -1 : 1;
+	return l->dst < r->dst ? -1 : (l->dst > r->dst);
+}
+
+static size_t chain_head(size_t b)
+{
+	while (chain_prev[b] != NONE) {
+		b = chain_prev[b];
+	}
+	return b;
+}
+
+static void build_chains(struct cfg *cfg, size_t first, size_t last)
+{
+	size_t max_edges = 2 * (last - first + 1);
+	struct edge *edges = alloc(max_edges, sizeof(*edges));
+	size_t num_edges = 0;
+
+	for (size_t b = first; b <= last; b++) {
+		struct edge e[2];
+		int num = block_edges(cfg, b, e);
+
+		for (int i = 0; i < num; i++) {
+			if (e[i].dst > b && e[i].dst <= last)
+				edges[num_edges++] = e[i];
+		}
+	}
+
+	qsort(edges, num_edges, sizeof(*edges), cmp_edge);
+
+	for (size_t i = 0; i < num_edges; i++) {
+		size_t src = edges[i].src;
+		size_t dst = edges[i].dst;
+
+		if (chain_next[src] != NONE || chain_prev[dst] != NONE || chain_head(src) == dst)
+			continue;
+
+		chain_next[src] = dst;
+		chain_prev[dst] = src;
+	}
+
+	free(edges);
+}
+
+/* adds the edges between the chain and the others to their connection */
+static void connect_chain(struct cfg *cfg, size_t head, size_t first, size_t last)
+{
+	for (size_t b = head; b != NONE; b = chain_next[b]) {
+		struct edge e[2];
+		int num = block_edges(cfg, b, e);
+
+		for (int i = 0; i < num; i++) {
+			if (e[i].dst >= first && e[i].dst <= last)
+				conn[chain_of[e[i].dst]] += e[i].count;
+		}
+
+		struct block *block = &cfg->blocks[b];
+		for (size_t p = 0; p < block->num_pred; p++) {
+			size_t pred = block->pred[p];
+			if (pred < first || pred > last)
+				continue;
+
+			num = block_edges(cfg, pred, e);
+			for (int i = 0; i < num; i++) {
+				if (e[i].dst == b)
+					conn[chain_of[pred]] += e[i].count;
+			}
+		}
+	}
+}
+
+/* the order of the blocks, starting with the entry block */
+static size_t order_chains(struct cfg *cfg, size_t first, size_t last, size_t *order)
+{
+	for (size_t b = first; b <= last; b++) {
+		chain_of[b] = chain_head(b);
+		conn[b] = 0;
+		placed[b] = false;
+	}
+
+	size_t num = 0;
+	size_t head = first;
+
+	while (head != NONE) {
+		placed[head] = true;
+		for (size_t b = head; b != NONE; b = chain_next[b]) {
+			order[num++] = b;
+		}
+		connect_chain(cfg, head, first, last);
+
+		/* the most connected chain, then the hottest one, then the first one */
+		head = NONE;
+		for (size_t b = first; b <= last; b++) {
+			if (chain_prev[b] != NONE || placed[b])
+				continue;
+
+			if (head == NONE || conn[b] > conn[head] || (conn[b] == conn[head] &&
+				attr[cfg->blocks[b].first].exec_count > attr[cfg->blocks[head].first].exec_count))
+				head = b;
+		}
+	}
+
+	return num;
+}
+
+/* the bytes that the jumps fetch if the blocks have this order and the
+ * block after is behind them */
+static uint64_t jump_cost(struct cfg *cfg, const size_t *blocks, size_t num, size_t after)
+{
+	uint64_t cost = 0;
+
+	for (size_t k = 0; k < num; k++) {
+		size_t next = k + 1 < num ? blocks[k + 1] : after;
+		struct block *block = &cfg->blocks[blocks[k]];
+		size_t ct = block_ct(block);
+		struct edge e[2];
+		int n = block_edges(cfg, blocks[k], e);
+
+		if (ct != NONE && !is_cond_branch(prog[ct].op)) {
+			/* a jump that isn't removed */
+			if (n > 0 && e[0].dst != next)
+				cost += e[0].count * JUMP_COST;
+		} else if (n > 0 && e[0].dst != next && e[n - 1].dst != next) {
+			/* the fall through edge needs a new jump */
+			cost += e[n - 1].count * JUMP_COST;
+		}
+	}
+
+	return cost;
+}
+
+/* appends the instructions of the block in the new order and fixes the end */
+static void emit_block(struct cfg *cfg, struct layout_stat *stat, size_t b, size_t next,
+	size_t *order, size_t *num)
+{
+	struct block *block = &cfg->blocks[b];
+	size_t ct = block_ct(block);
+	size_t fall = NONE;
+	size_t skip = NONE;
+
+	if (ct == NONE) {
+		fall = fall_block(cfg, block);
+	} else if (is_cond_branch(prog[ct].op)) {
+		fall = fall_block(cfg, block);
+
+		if (next != fall && next == target_block(cfg, ct)) {
+			prog[ct].op = invert(prog[ct].op);
+			attr[ct].target_index = cfg->blocks[fall].first;
+			attr[ct].taken_count = attr[ct].exec_count - attr[ct].taken_count;
+			fall = next;
+			stat->inverted++;
+		}
+	} else if ((prog[ct].op == J || prog[ct].op == B) && next == target_block(cfg, ct)) {
+		skip = ct;
+		stat->removed++;
+	}
+
+	for (size_t i = block->first; i <= block->last; i++) {
+		if (i == skip || (skip != NONE && i == skip + 1 && prog[i].op == NOP))
+			continue;
+		order[(*num)++] = i;
+	}
+
+	if (fall == NONE || fall == next)
+		return;
+
+	uint64_t count = attr[block->last].exec_count;
+	if (ct != NONE)
+		count = attr[ct].exec_count - attr[ct].taken_count;
+
+	size_t jump = append_instr(CODE_B);
+	attr[jump].target_index = cfg->blocks[fall].first;
+	attr[jump].exec_count = count;
+	attr[jump].taken_count = count;
+	order[(*num)++] = jump;
+
+	size_t slot = append_instr(CODE_NOP);
+	attr[slot].exec_count = count;
+	order[(*num)++] = slot;
+	stat->inserted++;
+}
+
+void layout_blocks(void)
+{
+	if (!has_profile()) {
+		fprintf(stderr, "The block layout needs a profile (-p)\n");
+		exit(EXIT_FAILURE);
+	}
+
+	struct cfg cfg;
+	cfg_build(&cfg);
+	num_code = num_instr;
+
+	size_t num_blocks = cfg.num_blocks;
+	size_t *blocks = alloc(num_blocks + 1, sizeof(*blocks));
+	size_t *orig = alloc(num_blocks + 1, sizeof(*orig));
+	/* every block may get a jump and a delay slot */
+	size_t *order = alloc(num_instr + 2 * num_blocks + 1, sizeof(*order));
+	chain_next = alloc(num_blocks + 1, sizeof(*chain_next));
+	chain_prev = alloc(num_blocks + 1, sizeof(*chain_prev));
+	chain_of = alloc(num_blocks + 1, sizeof(*chain_of));
+	conn = alloc(num_blocks + 1, sizeof(*conn));
+	placed = alloc(num_blocks + 1, sizeof(*placed));
+
+	for (size_t b = 0; b < num_blocks; b++) {
+		chain_next[b] = NONE;
+		chain_prev[b] = NONE;
+	}
+
+	struct layout_stat stat = {0, 0, 0, 0, 0, 0};
+	size_t num = 0;
+
+	/* the functions cover all instructions and keep their order */
+	for (size_t f = 0; f < cfg.num_funcs; f++) {
+		struct function *func = &cfg.funcs[f];
+		size_t first = cfg.block_of[func->first];
+		size_t last = cfg.block_of[func->last];
+
+		if (!can_reorder(&cfg, func)) {
+			for (size_t i = func->first; i <= func->last; i++) {
+				order[num++] = i;
+			}
+			continue;
+		}
+
+		build_chains(&cfg, first, last);
+		size_t num_func_blocks = order_chains(&cfg, first, last, blocks);
+
+		for (size_t b = first; b <= last; b++) {
+			orig[b - first] = b;
+		}
+
+		/* the last block of the function continues behind it */
+		size_t after = last + 1 < num_blocks ? last + 1 : NONE;
+		uint64_t cost_before = jump_cost(&cfg, orig, num_func_blocks, after);
+		uint64_t cost_after = jump_cost(&cfg, blocks, num_func_blocks, after);
+
+		if (cost_after >= cost_before) {
+			for (size_t i = func->first; i <= func->last; i++) {
+				order[num++] = i;
+			}
+			continue;
+		}
+
+		stat.cost_before += cost_before;
+		stat.cost_after += cost_after;
+		stat.funcs++;
+
+		for (size_t k = 0; k < num_func_blocks; k++) {
+			size_t next = k + 1 < num_func_blocks ? blocks[k + 1] : after;
+			emit_block(&cfg, &stat, blocks[k], next, order, &num);
+		}
+	}
+
+	fprintf(stderr, "block layout: %u functions changed, %u branches inverted, %u jumps removed, "
+		"%u jumps added, jumps fetch about %" PRIu64 " bytes less\n",
+		stat.funcs, stat.inverted, stat.removed, stat.inserted,
+		stat.cost_before - stat.cost_after);
+
+	reorder_instrs(order, num);
+
+	free(blocks);
+	free(orig);
+	free(order);
+	free(chain_next);
+	free(chain_prev);
+	free(chain_of);
+	free(conn);
+	free(placed);
+	chain_next = NULL;
+	chain_prev = NULL;
+	chain_of = NULL;
+	conn = NULL;
+	placed = NULL;
+	cfg_free(&cfg);
+}
@@ -0,0 +1,150 @@
+/**
+ * @file main.c
+ * @date 2026-10-18
+ * The command line of the converter. The linker shares the rest of the
+ * converter and has its own.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "../common/elf_file.h"
+#include "converter.h"
+
+static char *program_name = "converter";
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: %s [-GwrsOF3] [-k SYMBOL]... [-a WIDTH] [-j THREADS] [-p PROFILE [-L]] [-X DICT-OUT] [-d DATA-IN -D DATA-OUT] [-M MAP-OUT] IN-FILE OUT-FILE\n", program_name);
+	fprintf(stderr, "IN-FILE is either the raw text section or an ELF file that was linked\n"
+		"with --emit-relocs. The output has the same format as the input.\n");
+	fprintf(stderr, "\t-d\tRaw data image of the program. The jump tables in it are updated\n");
+	fprintf(stderr, "\t-D\tOutput file for the updated data image\n");
+	fprintf(stderr, "\t-M\tWrite the new address of every instruction for the lockstep mode of\n"
+		"\t\tthe simulator (-l, raw images only)\n");
+	fprintf(stderr, "\t-G\tRemove the code that can't be reached from the entry point (ELF only)\n");
+	fprintf(stderr, "\t-k\tSymbol of code that is kept by -G, can be repeated\n");
+	fprintf(stderr, "\t-w\tRewrite instructions into compressible equivalents\n");
+	fprintf(stderr, "\t-r\tRename scratch registers so that more instructions can be compressed\n");
+	fprintf(stderr, "\t-s\tFill the delay slots and remove the NOPs in them\n");
+	fprintf(stderr, "\t-O\tOutline repeated instruction sequences into subroutines\n");
+	fprintf(stderr, "\t-F\tPlace functions next to their callers, weighted by the profile if there is one\n");
+	fprintf(stderr, "\t-3\tUse the experimental v3 encoding with 3 bit register fields\n");
+	fprintf(stderr, "\t-a\tAlign branch targets to WIDTH (4 or 8) bytes, loop heads without a profile\n");
+	fprintf(stderr, "\t-j\tNumber of threads that decode and encode the instructions\n");
+	fprintf(stderr, "\t-p\tExecution profile of IN-FILE from the simulator (-P)\n");
+	fprintf(stderr, "\t-L\tArrange the basic blocks of every function after the profile\n");
+	fprintf(stderr, "\t-X\tUse the dictionary encoding and write the dictionary to DICT-OUT\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 0)
+		program_name = argv[0];
+
+	const char *data_in_path = NULL;
+	const char *data_out_path = NULL;
+	const char *map_path = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "d:D:M:" CONV_OPTIONS)) != -1) {
+		switch (opt) {
+		case 'd':
+			data_in_path = optarg;
+			break;
+
+		case 'D':
+			data_out_path = optarg;
+			break;
+
+		case 'M':
+			map_path = optarg;
+			break;
+
+		default:
+			if (!set_conv_option(opt, optarg))
+				usage();
+		}
+	}
+	
+	if (argc - optind != 2 || (data_in_path == NULL) != (data_out_path == NULL))
+		usage();
+
+	const char *in_path = argv[optind];
+	const char *out_path = argv[optind + 1];
+	
+	size_t in_size;
+	uint8_t *in = map_file(in_path, &in_size);
+
+	if (is_elf(in, in_size)) {
+		if (data_in_path != NULL) {
+			fprintf(stderr, "The data of ELF files is converted with the relocations\n");
+			exit(EXIT_FAILURE);
+		}
+
+		if (map_path != NULL) {
+			fprintf(stderr, "The address map is only written for raw images\n");
+			exit(EXIT_FAILURE);
+		}
+
+		convert_elf(in, in_size, out_path);
+
+		unmap_file(in, in_size);
+		free(prog);
+		free(attr);
+		free(index_map);
+		free(options.keep_syms);
+		return 0;
+	}
+
+	if (options.num_keep_syms > 0) {
+		fprintf(stderr, "Symbols can only be kept in ELF files\n");
+		exit(EXIT_FAILURE);
+	}
+
+	parse_code(in, in_size);
+	unmap_file(in, in_size);
+
+	uint8_t *data = NULL;
+	size_t data_size = 0;
+	if (data_in_path != NULL) {
+		data = map_file(data_in_path, &data_size);
+		find_jump_tables(data, data_size, DEFAULT_DATA_BASE);
+	}
+
+	if (map_path != NULL)
+		addr_map_init();
+
+	optimize();
+
+	size_t out_size = code_size();
+	uint8_t *out = malloc(out_size > 0 ? out_size : 1);
+	if (out == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	encode_code(out);
+	write_file(out_path, out, out_size);
+	free(out);
+
+	if (map_path != NULL)
+		write_addr_map(map_path);
+
+	/* an empty data image is written too, the simulator expects the file */
+	if (data_in_path != NULL) {
+		update_jump_tables(data, DEFAULT_DATA_BASE);
+		write_file(data_out_path, data, data_size);
+		unmap_file(data, data_size);
+	}
+
+	free(prog);
+	free(attr);
+	free(index_map);
+	free(options.keep_syms);
+
+	return 0;
+}
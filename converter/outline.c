@@ -0,0 +1,678 @@
+/**
+ * @file outline.c
+ * @date 2026-10-18
+ * Procedural abstraction (-O). Repeated instruction sequences are found
+ * with a suffix array over the instructions and moved into subroutines at
+ * the end of the program. Every occurrence becomes a JAL with the first
+ * instruction of the sequence in its delay slot, the subroutine returns
+ * with JR $ra and the last instruction in the delay slot. If $ra is live
+ * at an occurrence it is kept in a dead register around the call. With a
+ * profile occurrences that run more often than the average instruction
+ * stay inline.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "converter.h"
+#include "cfg.h"
+
+#define NONE SIZE_MAX
+
+/* longer sequences are outlined in parts of this length */
+#define MAX_LEN 64
+
+#define CODE_JAL (0x0C000000)
+#define CODE_JR_RA (0x03E00008)
+#define CODE_NOP (0x00000000)
+/* ADDU rd, $0, rt */
+#define CODE_MOV(rd, rt) (((uint32_t)(rt) << 16) | ((uint32_t)(rd) << 11) | 0x21)
+
+/* a call is estimated with the 32-bit JAL, the saving of $ra costs two MOVs */
+#define CALL_SIZE 4
+#define SAVE_SIZE 4
+#define RETURN_SIZE 2
+
+/* registers that never keep $ra: $0, $k0, $k1, $gp, $sp and $ra itself */
+#define REG_RESERVED (REG_MASK(0) | REG_MASK(26) | REG_MASK(27) | REG_MASK(28) \
+	| REG_MASK(29) | REG_MASK(31))
+
+/* a repeated sequence of len instructions, SA[lb..rb] are its positions */
+struct candidate {
+	size_t len;
+	size_t lb;
+	size_t rb;
+	int64_t gain;
+};
+
+struct site {
+	size_t first;
+	uint8_t save_reg; /* keeps $ra during the call, 0 if $ra is dead */
+};
+
+struct outline {
+	size_t len;
+	size_t first_site;
+	size_t num_sites;
+	size_t entry;
+};
+
+struct outline_stat {
+	uint32_t bytes;
+	uint64_t fetched_bytes;
+};
+
+static struct cfg cfg;
+/* the number of instructions from an instruction that can be outlined */
+static size_t *run = NULL;
+static bool *used = NULL;
+static uint64_t hot_count = 0;
+
+static struct site *sites = NULL;
+static size_t num_sites = 0;
+
+static struct outline *outlines = NULL;
+static size_t num_outlines = 0;
+
+static bool is_control(enum operation op)
+{
+	return is_branch(op) || op == J || op == JAL || op == JR || op == JALR;
+}
+
+static int instr_size(size_t index)
+{
+	return prog[index].compressed ? 2 : 4;
+}
+
+/* instructions that can be moved into a subroutine, the call changes $ra */
+static bool can_outline(size_t index)
+{
+	enum operation op = prog[index].op;
+
+	if (is_control(op) || op == BREAK || op == SYSCALL)
+		return false;
+	if (attr[index].code_ref)
+		return false;
+
+	return ((instr_uses(index) | instr_defs(index)) & REG_MASK(31)) == 0;
+}
+
+static int cmp_instr(const struct instr *a, const struct instr *b)
+{
+	if (a->op != b->op)
+		return a->op < b->op ? -1 : 1;
+	if (a->rs != b->rs)
+		return a->rs < b->rs ? -1 : 1;
+	if (a->rt != b->rt)
+		return a->rt < b->rt ? -1 : 1;
+	if (a->rd != b->rd)
+		return a->rd < b->rd ? -1 : 1;
+	if (a->shamt != b->shamt)
+		return a->shamt < b->shamt ? -1 : 1;
+	if (a->imm != b->imm)
+		return a->imm < b->imm ? -1 : 1;
+	if (a->simm != b->simm)
+		return a->simm < b->simm ? -1 : 1;
+	if (a->compressed != b->compressed)
+		return a->compressed ? 1 : -1;
+	return 0;
+}
+
+static int cmp_index(const void *a, const void *b)
+{
+	size_t i = *(const size_t *)a;
+	size_t k = *(const size_t *)b;
+	int rc = cmp_instr(&prog[i], &prog[k]);
+
+	if (rc != 0)
+		return rc;
+	return i < k ? -1 : (i > k);
+}
+
+/*
+ * Equal instructions get the same token. Every instruction that can't be
+ * outlined gets its own token, so that no repeated sequence contains it.
+ * Returns the number of tokens.
+ */
+static size_t make_tokens(uint32_t *tokens)
+{
+	size_t *order = alloc(num_instr, sizeof(*order));
+	size_t num = 0;
+	size_t num_tokens = 0;
+
+	for (size_t i = 0; i < num_instr; i++) {
+		if (can_outline(i))
+			order[num++] = i;
+	}
+
+	qsort(order, num, sizeof(*order), cmp_index);
+
+	for (size_t k = 0; k < num; k++) {
+		if (k > 0 && cmp_instr(&prog[order[k - 1]], &prog[order[k]]) != 0)
+			num_tokens++;
+		tokens[order[k]] = num_tokens;
+	}
+	if (num > 0)
+		num_tokens++;
+
+	for (size_t i = 0; i < num_instr; i++) {
+		if (!can_outline(i))
+			tokens[i] = num_tokens++;
+	}
+
+	free(order);
+	return num_tokens;
+}
+
+/*
+ * Sorts the suffixes by prefix doubling. Every round sorts the suffixes by
+ * the rank of their first and second half with two counting sorts.
+ */
+static size_t *suffix_array(const uint32_t *tokens, size_t n, size_t num_tokens)
+{
+	size_t *sa = alloc(n, sizeof(*sa));
+	size_t *tmp = alloc(n, sizeof(*tmp));
+	size_t *rank = alloc(n, sizeof(*rank));
+	size_t *new_rank = alloc(n, sizeof(*new_rank));
+	size_t num_buckets = (n > num_tokens ? n : num_tokens) + 1;
+	size_t *count = alloc(num_buckets, sizeof(*count));
+
+	for (size_t i = 0; i < n; i++) {
+		rank[i] = tokens[i];
+		count[rank[i] + 1]++;
+	}
+	for (size_t r = 1; r < num_buckets; r++) {
+		count[r] += count[r - 1];
+	}
+	for (size_t i = 0; i < n; i++) {
+		sa[count[rank[i]]++] = i;
+	}
+
+	for (size_t k = 1; k < n; k *= 2) {
+		/* by the second half, suffixes without one come first */
+		size_t num = 0;
+		for (size_t i = n - k; i < n; i++) {
+			tmp[num++] = i;
+		}
+		for (size_t j = 0; j < n; j++) {
+			if (sa[j] >= k)
+				tmp[num++] = sa[j] - k;
+		}
+
+		/* stable by the first half */
+		for (size_t r = 0; r < num_buckets; r++) {
+			count[r] = 0;
+		}
+		for (size_t i = 0; i < n; i++) {
+			count[rank[i] + 1]++;
+		}
+		for (size_t r = 1; r < num_buckets; r++) {
+			count[r] += count[r - 1];
+		}
+		for (size_t j = 0; j < n; j++) {
+			sa[count[rank[tmp[j]]]++] = tmp[j];
+		}
+
+		size_t r = 0;
+		new_rank[sa[0]] = 0;
+		for (size_t j = 1; j < n; j++) {
+			size_t a = sa[j - 1];
+			size_t b = sa[j];
+			size_t ra = a + k < n ? rank[a + k] + 1 : 0;
+			size_t rb = b + k < n ? rank[b + k] + 1 : 0;
+			if (rank[a] != rank[b] || ra != rb)
+				r++;
+			new_rank[b] = r;
+		}
+
+		size_t *swap = rank;
+		rank = new_rank;
+		new_rank = swap;
+
+		if (r == n - 1)
+			break;
+	}
+
+	free(tmp);
+	free(rank);
+	free(new_rank);
+	free(count);
+	return sa;
+}
+
+/* lcp[j] is the common prefix of the suffixes sa[j - 1] and sa[j] (Kasai) */
+static size_t *lcp_array(const uint32_t *tokens, const size_t *sa, size_t n)
+{
+	size_t *lcp = alloc(n, sizeof(*lcp));
+	size_t *inv = alloc(n, sizeof(*inv));
+
+	for (size_t j = 0; j < n; j++) {
+		inv[sa[j]] = j;
+	}
+
+	size_t h = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (inv[i] == 0) {
+			h = 0;
+			continue;
+		}
+
+		size_t k = sa[inv[i] - 1];
+		while (i + h < n && k + h < n && tokens[i + h] == tokens[k + h])
+			h++;
+
+		lcp[inv[i]] = h;
+		if (h > 0)
+			h--;
+	}
+
+	free(inv);
+	return lcp;
+}
+
+/* the bytes that move into the subroutine, the first instruction stays */
+static uint32_t body_size(size_t first, size_t len)
+{
+	uint32_t size = 0;
+
+	for (size_t i = first + 1; i < first + len; i++) {
+		size += instr_size(i);
+	}
+	return size;
+}
+
+static void add_candidate(struct candidate **cands, size_t *num, size_t *max,
+	const size_t *sa, size_t len, size_t lb, size_t rb)
+{
+	int64_t body = body_size(sa[lb], len);
+	int64_t gain = (int64_t)(rb - lb + 1) * (body - CALL_SIZE) - (body + RETURN_SIZE);
+
+	if (gain <= 0)
+		return;
+
+	if (*num == *max) {
+		*max = *max > 0 ? 2 * *max : 64;
+		*cands = realloc(*cands, *max * sizeof(**cands));
+		if (*cands == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	(*cands)[(*num)++] = (struct candidate) {len, lb, rb, gain};
+}
+
+/*
+ * Every interval of the LCP array is a repeated sequence. Sequences longer
+ * than MAX_LEN are shortened, only the largest interval of them is kept.
+ */
+static struct candidate *find_candidates(const size_t *sa, const size_t *lcp, size_t n,
+	size_t *num_cands)
+{
+	struct candidate *cands = NULL;
+	size_t num = 0;
+	size_t max = 0;
+
+	size_t *stack_lcp = alloc(n + 1, sizeof(*stack_lcp));
+	size_t *stack_lb = alloc(n + 1, sizeof(*stack_lb));
+	size_t top = 0;
+	stack_lcp[0] = 0;
+	stack_lb[0] = 0;
+
+	for (size_t j = 1; j <= n; j++) {
+		size_t cur = j < n ? lcp[j] : 0;
+		size_t lb = j - 1;
+
+		while (cur < stack_lcp[top]) {
+			size_t len = stack_lcp[top];
+			lb = stack_lb[top];
+			top--;
+
+			size_t parent = cur > stack_lcp[top] ? cur : stack_lcp[top];
+			if (len >= 2 && (len <= MAX_LEN || parent < MAX_LEN)) {
+				add_candidate(&cands, &num, &max, sa,
+					len < MAX_LEN ? len : MAX_LEN, lb, j - 1);
+			}
+		}
+
+		if (cur > stack_lcp[top]) {
+			top++;
+			stack_lcp[top] = cur;
+			stack_lb[top] = lb;
+		}
+	}
+
+	free(stack_lcp);
+	free(stack_lb);
+	*num_cands = num;
+	return cands;
+}
+
+static int cmp_candidate(const void *a, const void *b)
+{
+	const struct candidate *ca = a;
+	const struct candidate *cb = b;
+
+	if (ca->gain != cb->gain)
+		return ca->gain > cb->gain ? -1 : 1;
+	if (ca->len != cb->len)
+		return ca->len > cb->len ? -1 : 1;
+	return ca->lb < cb->lb ? -1 : (ca->lb > cb->lb);
+}
+
+static int cmp_size(const void *a, const void *b)
+{
+	size_t x = *(const size_t *)a;
+	size_t y = *(const size_t *)b;
+	return x < y ? -1 : (x > y);
+}
+
+/* the register that keeps $ra around the call, 0 if $ra is dead, -1 if
+ * there is none */
+static int save_reg(size_t first, size_t len)
+{
+	size_t last = first + len - 1;
+	uint32_t live = cfg.live_out[last];
+
+	if ((live & REG_MASK(31)) == 0)
+		return 0;
+
+	uint32_t busy = live | REG_RESERVED;
+	/* the save can't be written while a load into it is pending */
+	if (first > 0 && is_load(prog[first - 1].op))
+		busy |= instr_defs(first - 1);
+	for (size_t i = first; i <= last; i++) {
+		busy |= instr_uses(i) | instr_defs(i);
+	}
+
+	for (int reg = 1; reg < 32; reg++) {
+		if ((busy & REG_MASK(reg)) == 0)
+			return reg;
+	}
+	return -1;
+}
+
+static bool can_start(size_t index, size_t len)
+{
+	if (run[index] < len)
+		return false;
+	/* the call can't be in a delay slot */
+	if (index > 0 && is_control(prog[index - 1].op))
+		return false;
+	/* the save of $ra or the call would be in the delay slot of a load of $ra */
+	if (index > 0 && load_hazard(index - 1, REG_MASK(31)))
+		return false;
+	/* without a profile or executions hot_count is 0 */
+	if (hot_count > 0 && attr[index].exec_count > hot_count)
+		return false;
+
+	for (size_t i = index; i < index + len; i++) {
+		if (used[i])
+			return false;
+	}
+	return true;
+}
+
+/* chooses the occurrences of the candidate and outlines it if it saves bytes */
+static void try_candidate(const struct candidate *cand, const size_t *sa, size_t *pos,
+	struct outline_stat *stat)
+{
+	size_t num = cand->rb - cand->lb + 1;
+	size_t len = cand->len;
+
+	for (size_t k = 0; k < num; k++) {
+		pos[k] = sa[cand->lb + k];
+	}
+	qsort(pos, num, sizeof(*pos), cmp_size);
+
+	int64_t body = body_size(pos[0], len);
+	int64_t gain = -(body + RETURN_SIZE);
+	size_t first_site = num_sites;
+	size_t next = 0;
+
+	for (size_t k = 0; k < num; k++) {
+		size_t p = pos[k];
+		if (p < next || !can_start(p, len))
+			continue;
+
+		int reg = save_reg(p, len);
+		if (reg < 0)
+			continue;
+
+		int64_t cost = CALL_SIZE + (reg > 0 ? SAVE_SIZE : 0);
+		if (body <= cost)
+			continue;
+
+		sites[num_sites++] = (struct site) {p, reg};
+		gain += body - cost;
+		next = p + len;
+	}
+
+	if (gain <= 0) {
+		num_sites = first_site;
+		return;
+	}
+
+	for (size_t s = first_site; s < num_sites; s++) {
+		for (size_t i = sites[s].first; i < sites[s].first + len; i++) {
+			used[i] = true;
+		}
+
+		uint64_t count = attr[sites[s].first].exec_count;
+		int extra = CALL_SIZE + RETURN_SIZE + (sites[s].save_reg > 0 ? SAVE_SIZE : 0);
+		stat->fetched_bytes += count * extra;
+	}
+
+	outlines[num_outlines++] = (struct outline) {len, first_site, num_sites - first_site, NONE};
+	stat->bytes += gain;
+}
+
+static size_t append_copy(size_t index, uint64_t count)
+{
+	struct instr instr = prog[index];
+	size_t copy = append_instr(CODE_NOP);
+
+	prog[copy] = instr;
+	attr[copy].exec_count = count;
+	return copy;
+}
+
+static size_t append_code(uint32_t code, uint64_t count)
+{
+	size_t index = append_instr(code);
+
+	attr[index].exec_count = count;
+	return index;
+}
+
+/* the subroutine: the sequence without its first instruction and the
+ * return with the last instruction in the delay slot */
+static void append_subroutine(struct outline *out)
+{
+	size_t first = sites[out->first_site].first;
+	uint64_t count = 0;
+
+	for (size_t s = out->first_site; s < out->first_site + out->num_sites; s++) {
+		count += attr[sites[s].first].exec_count;
+	}
+
+	out->entry = num_instr;
+	for (size_t i = first + 1; i + 1 < first + out->len; i++) {
+		append_copy(i, count);
+	}
+
+	size_t ret = append_code(CODE_JR_RA, count);
+	attr[ret].taken_count = count;
+	append_copy(first + out->len - 1, count);
+}
+
+/* the call replaces the first instruction, which keeps the branches to it */
+static void replace_instr(size_t index, uint32_t code)
+{
+	struct instr instr;
+
+	parse_instr(code, &instr);
+	conv_to_pseudo(&instr);
+	instr.compressed = is_compressible_simple(&instr);
+	prog[index] = instr;
+	attr[index].target_index = -1;
+}
+
+static size_t add_call(size_t *order, size_t num_order, struct site *site, size_t entry)
+{
+	size_t first = site->first;
+	uint64_t count = attr[first].exec_count;
+	size_t slot = append_copy(first, count);
+
+	if (site->save_reg > 0) {
+		replace_instr(first, CODE_MOV(site->save_reg, 31));
+		order[num_order++] = first;
+
+		size_t call = append_code(CODE_JAL, count);
+		attr[call].target_index = entry;
+		attr[call].taken_count = count;
+		order[num_order++] = call;
+	} else {
+		replace_instr(first, CODE_JAL);
+		attr[first].target_index = entry;
+		attr[first].taken_count = count;
+		order[num_order++] = first;
+	}
+
+	order[num_order++] = slot;
+
+	if (site->save_reg > 0)
+		order[num_order++] = append_code(CODE_MOV(31, site->save_reg), count);
+
+	return num_order;
+}
+
+void outline_sequences(void)
+{
+	size_t n = num_instr;
+	if (n == 0)
+		return;
+
+	cfg_build(&cfg);
+	cfg_liveness(&cfg);
+
+	bool *target = alloc(n, sizeof(*target));
+	for (size_t i = 0; i < n; i++) {
+		ssize_t t = attr[i].target_index;
+		if (0 <= t && t < (ssize_t)n)
+			target[t] = true;
+		if (attr[i].addr_taken)
+			target[i] = true;
+	}
+
+	/* only the first instruction of a sequence can be jumped to */
+	run = alloc(n, sizeof(*run));
+	for (size_t i = n; i > 0; i--) {
+		size_t k = i - 1;
+		if (!can_outline(k))
+			run[k] = 0;
+		else
+			run[k] = 1 + (i < n && !target[i] ? run[i] : 0);
+	}
+	free(target);
+
+	if (has_profile()) {
+		uint64_t total = 0;
+		for (size_t i = 0; i < n; i++) {
+			total += attr[i].exec_count;
+		}
+		hot_count = total / n;
+	}
+
+	uint32_t *tokens = alloc(n, sizeof(*tokens));
+	size_t num_tokens = make_tokens(tokens);
+	size_t *sa = suffix_array(tokens, n, num_tokens);
+	size_t *lcp = lcp_array(tokens, sa, n);
+	free(tokens);
+
+	size_t num_cands;
+	struct candidate *cands = find_candidates(sa, lcp, n, &num_cands);
+	free(lcp);
+	qsort(cands, num_cands, sizeof(*cands), cmp_candidate);
+
+	used = alloc(n, sizeof(*used));
+	sites = alloc(n, sizeof(*sites));
+	outlines = alloc(n, sizeof(*outlines));
+	size_t *pos = alloc(n, sizeof(*pos));
+	struct outline_stat stat = {0, 0};
+
+	for (size_t c = 0; c < num_cands; c++) {
+		try_candidate(&cands[c], sa, pos, &stat);
+	}
+
+	free(pos);
+	free(cands);
+	free(sa);
+	cfg_free(&cfg);
+
+	if (num_outlines > 0) {
+		for (size_t o = 0; o < num_outlines; o++) {
+			append_subroutine(&outlines[o]);
+		}
+
+		size_t *site_of = alloc(n, sizeof(*site_of));
+		size_t *outline_of = alloc(n, sizeof(*outline_of));
+		for (size_t i = 0; i < n; i++) {
+			site_of[i] = NONE;
+		}
+		for (size_t o = 0; o < num_outlines; o++) {
+			for (size_t s = outlines[o].first_site; s < outlines[o].first_site + outlines[o].num_sites; s++) {
+				site_of[sites[s].first] = s;
+				outline_of[sites[s].first] = o;
+			}
+		}
+
+		/* every site adds at most three instructions */
+		size_t num_body = num_instr - n;
+		size_t *order = alloc(n + num_body + 3 * num_sites, sizeof(*order));
+		size_t num_order = 0;
+
+		for (size_t i = 0; i < n; i++) {
+			if (site_of[i] == NONE) {
+				order[num_order++] = i;
+				continue;
+			}
+
+			struct outline *out = &outlines[outline_of[i]];
+			num_order = add_call(order, num_order, &sites[site_of[i]], out->entry);
+			i += out->len - 1;
+		}
+
+		for (size_t i = n; i < n + num_body; i++) {
+			order[num_order++] = i;
+		}
+
+		reorder_instrs(order, num_order);
+		free(order);
+		free(site_of);
+		free(outline_of);
+	}
+
+	fprintf(stderr, "outlining: %zu sequences at %zu places, about %u bytes smaller",
+		num_outlines, num_sites, stat.bytes);
+	if (has_profile()) {
+		fprintf(stderr, ", about %" PRIu64 " bytes more fetched", stat.fetched_bytes);
+	}
+	fprintf(stderr, "\n");
+
+	free(run);
+	free(used);
+	free(sites);
+	free(outlines);
+	run = NULL;
+	used = NULL;
+	sites = NULL;
+	outlines = NULL;
+	num_sites = 0;
+	num_outlines = 0;
+	hot_count = 0;
+}
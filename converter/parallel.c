@@ -0,0 +1,71 @@
+/**
+ * @file parallel.c
+ * @date 2026-10-18
+ * Splits the work on independent instructions across threads (-j). Every
+ * thread gets one contiguous part of the instructions, the first part runs
+ * on the calling thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "converter.h"
+
+/* smaller parts aren't worth a thread */
+#define MIN_PART_SIZE (16 * 1024)
+
+struct part {
+	pthread_t thread;
+	size_t index;
+	size_t first;
+	size_t end;
+	part_fn fn;
+	void *arg;
+};
+
+static void *run_part(void *arg)
+{
+	struct part *part = arg;
+	part->fn(part->index, part->first, part->end, part->arg);
+	return NULL;
+}
+
+size_t parallel_parts(size_t num)
+{
+	size_t parts = num / MIN_PART_SIZE;
+
+	if (parts > options.num_threads)
+		parts = options.num_threads;
+
+	return parts > 0 ? parts : 1;
+}
+
+void parallel_for(size_t num, part_fn fn, void *arg)
+{
+	size_t num_parts = parallel_parts(num);
+	struct part parts[MAX_THREADS];
+
+	for (size_t p = 0; p < num_parts; p++) {
+		parts[p] = (struct part) {
+			.index = p,
+			.first = num * p / num_parts,
+			.end = num * (p + 1) / num_parts,
+			.fn = fn,
+			.arg = arg
+		};
+	}
+
+	for (size_t p = 1; p < num_parts; p++) {
+		if (pthread_create(&parts[p].thread, NULL, run_part, &parts[p]) != 0) {
+			fprintf(stderr, "Couldn't create thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	run_part(&parts[0]);
+
+	for (size_t p = 1; p < num_parts; p++) {
+		pthread_join(parts[p].thread, NULL);
+	}
+}
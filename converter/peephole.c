@@ -0,0 +1,151 @@
+/**
+ * @file peephole.c
+ * @date 2026-10-18
+ * Rewrites single instructions into equivalent instructions that can be
+ * compressed (-w). The rules are a table of an operation, conditions on its
+ * operands and the equivalent operation. A rule is only applied if the
+ * result is compressible. The pseudo instructions already cover the common
+ * cases, e.g. ADDU with $0 is a MOV, and ADDU, OR and XOR are commuted when
+ * they are encoded. The rules catch the remaining forms, e.g. the trapping
+ * instructions that can't overflow or instructions with the same source
+ * register twice.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../common/instr.h"
+#include "converter.h"
+
+/* conditions on the operands, all of them have to hold */
+#define RS_ZERO (1 << 0)
+#define RT_ZERO (1 << 1)
+#define RS_EQ_RT (1 << 2)
+#define IMM_ZERO (1 << 3)
+/* the immediate is the same as a signed immediate */
+#define IMM_SIGNED (1 << 4)
+
+/* how the operands of the new operation are taken from the old one */
+enum operands {
+	SAME, /* only the operation changes */
+	RS_TO_RT, /* rs becomes the source rt of MOV or NOT */
+	RT_TO_RD, /* the destination rt of an I-type becomes rd */
+	IMM_TO_SIMM /* the zero extended immediate becomes signed */
+};
+
+struct rule {
+	const char *name;
+	enum operation op;
+	unsigned cond;
+	enum operation new_op;
+	enum operands operands;
+};
+
+static const struct rule rules[] = {
+	/* can't overflow, so the trap doesn't matter */
+	{"addi rt, $0, k -> addiu", ADDI, RS_ZERO, ADDIU, SAME},
+	{"addi rt, rs, 0 -> addiu", ADDI, IMM_ZERO, ADDIU, SAME},
+	{"add rd, $0, rt -> addu", ADD, RS_ZERO, ADDU, SAME},
+	{"add rd, rs, $0 -> addu", ADD, RT_ZERO, ADDU, SAME},
+	{"sub rd, rs, $0 -> subu", SUB, RT_ZERO, SUBU, SAME},
+
+	/* loads of small constants */
+	{"ori rt, $0, k -> addiu", ORI, RS_ZERO | IMM_SIGNED, ADDIU, IMM_TO_SIMM},
+	{"xori rt, $0, k -> addiu", XORI, RS_ZERO | IMM_SIGNED, ADDIU, IMM_TO_SIMM},
+
+	/* the same source twice */
+	{"or rd, rs, rs -> mov", OR, RS_EQ_RT, MOV, RS_TO_RT},
+	{"and rd, rs, rs -> mov", AND, RS_EQ_RT, MOV, RS_TO_RT},
+	{"nor rd, rs, rs -> not", NOR, RS_EQ_RT, NOT, RS_TO_RT},
+	{"xor rd, rs, rs -> clear", XOR, RS_EQ_RT, CLEAR, SAME},
+	{"subu rd, rs, rs -> clear", SUBU, RS_EQ_RT, CLEAR, SAME},
+	{"slt rd, rs, rs -> clear", SLT, RS_EQ_RT, CLEAR, SAME},
+	{"sltu rd, rs, rs -> clear", SLTU, RS_EQ_RT, CLEAR, SAME},
+
+	/* constant results */
+	{"sltiu rt, rs, 0 -> clear", SLTIU, IMM_ZERO, CLEAR, RT_TO_RD},
+	{"sll rd, $0, sa -> clear", SLL, RT_ZERO, CLEAR, SAME},
+	{"srl rd, $0, sa -> clear", SRL, RT_ZERO, CLEAR, SAME},
+	{"sra rd, $0, sa -> clear", SRA, RT_ZERO, CLEAR, SAME},
+};
+
+#define NUM_RULES (sizeof(rules) / sizeof(rules[0]))
+
+static bool matches(const struct rule *rule, const struct instr *instr)
+{
+	unsigned cond = rule->cond;
+
+	if (instr->op != rule->op)
+		return false;
+	if ((cond & RS_ZERO) && instr->rs != 0)
+		return false;
+	if ((cond & RT_ZERO) && instr->rt != 0)
+		return false;
+	if ((cond & RS_EQ_RT) && instr->rs != instr->rt)
+		return false;
+	if ((cond & IMM_ZERO) && (instr->imm & 0xFFFF) != 0)
+		return false;
+	if ((cond & IMM_SIGNED) && (instr->imm & 0xFFFF) > 0x7FFF)
+		return false;
+
+	return true;
+}
+
+static void apply(const struct rule *rule, struct instr *instr)
+{
+	instr->op = rule->new_op;
+
+	switch (rule->operands) {
+	case SAME:
+		break;
+
+	case RS_TO_RT:
+		instr->rt = instr->rs;
+		break;
+
+	case RT_TO_RD:
+		instr->rd = instr->rt;
+		break;
+
+	case IMM_TO_SIMM:
+		instr->simm = instr->imm & 0xFFFF;
+		break;
+	}
+
+	/* e.g. an ADDIU from $0 becomes LSI */
+	conv_to_pseudo(instr);
+}
+
+void rewrite_instrs(void)
+{
+	uint32_t hits[NUM_RULES] = {0};
+	uint32_t total = 0;
+
+	for (size_t i = 0; i < num_instr; i++) {
+		/* code addresses keep their instructions */
+		if (prog[i].compressed || attr[i].code_ref)
+			continue;
+
+		for (size_t r = 0; r < NUM_RULES; r++) {
+			if (!matches(&rules[r], &prog[i]))
+				continue;
+
+			struct instr instr = prog[i];
+			apply(&rules[r], &instr);
+
+			if (is_compressible_simple(&instr)) {
+				instr.compressed = true;
+				prog[i] = instr;
+				hits[r]++;
+				total++;
+				break;
+			}
+		}
+	}
+
+	fprintf(stderr, "peephole: %u instructions rewritten, %u bytes smaller\n", total, 2 * total);
+	for (size_t r = 0; r < NUM_RULES; r++) {
+		if (hits[r] > 0)
+			fprintf(stderr, "\t%-26s %u\n", rules[r].name, hits[r]);
+	}
+}
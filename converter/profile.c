@@ -0,0 +1,62 @@
+/**
+ * @file profile.c
+ * @date 2026-10-18
+ * Reads the execution profile that the simulator writes with -P. Every line
+ * holds the address, the execution count and the taken count of one
+ * executed instruction of the uncompressed program.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "converter.h"
+
+static bool profile_loaded = false;
+
+bool has_profile(void)
+{
+	return profile_loaded;
+}
+
+void read_profile(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t addr;
+	uint64_t exec;
+	uint64_t taken;
+	size_t line = 0;
+	int rc;
+
+	while ((rc = fscanf(file, "%" SCNx32 " %" SCNu64 " %" SCNu64, &addr, &exec, &taken)) == 3) {
+		line++;
+
+		if (addr < text_base || (addr - text_base) / 4 >= num_input_instr) {
+			fprintf(stderr, "Warning: profile address 0x%8.8X is outside of the code\n", addr);
+			continue;
+		}
+
+		if ((addr - text_base) % 4 != 0) {
+			fprintf(stderr, "The profile in '%s' isn't from the uncompressed program (line %zu)\n",
+				path, line);
+			exit(EXIT_FAILURE);
+		}
+
+		struct instr_attr *a = &attr[index_map[(addr - text_base) / 4]];
+		a->exec_count = exec;
+		a->taken_count = taken;
+	}
+
+	if (rc != EOF) {
+		fprintf(stderr, "Invalid profile '%s' after line %zu\n", path, line);
+		exit(EXIT_FAILURE);
+	}
+
+	fclose(file);
+	profile_loaded = true;
+}
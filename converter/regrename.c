@@ -0,0 +1,258 @@
+/**
+ * @file regrename.c
+ * @date 2026-10-18
+ * Renames scratch registers so that more instructions can be compressed.
+ * An instruction like "addu $t2, $t0, $t1" is compressible if it writes
+ * $t0 instead. This is possible if $t0 is dead afterwards, the value in
+ * $t2 is only used where this definition reaches and $t0 is neither live
+ * nor changed there. All uses of the value are then renamed to $t0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "converter.h"
+#include "cfg.h"
+
+#define MAX_RENAME_PASSES 4
+
+/* instructions where the renamed value is live, marked by a stamp */
+static uint32_t *stamp = NULL;
+static uint32_t cur_stamp = 0;
+static size_t *region = NULL;
+static size_t region_len = 0;
+static size_t *work = NULL;
+
+static bool is_sdi_op(enum operation op)
+{
+	return is_branch(op) || op == J || op == JAL;
+}
+
+/* can the compressed flag be changed by renaming? */
+static bool compressible(struct instr *instr, size_t index)
+{
+	if (attr[index].code_ref || is_sdi_op(instr->op))
+		return prog[index].compressed;
+
+	return is_compressible_simple(instr);
+}
+
+static void replace_src(struct instr *instr, uint8_t old_reg, uint8_t new_reg)
+{
+	uint8_t *regs[2];
+	int num = get_src_regs(instr, regs);
+
+	for (int i = 0; i < num; i++) {
+		if (*regs[i] == old_reg)
+			*regs[i] = new_reg;
+	}
+}
+
+/* returns false if there is an exit where the value may still be used */
+static bool push_succ(struct cfg *cfg, size_t index, uint32_t mask, size_t *num_work)
+{
+	struct block *block = &cfg->blocks[cfg->block_of[index]];
+
+	if (index != block->last) {
+		work[(*num_work)++] = index + 1;
+		return true;
+	}
+
+	if (block->exits && (block->exit_live & mask))
+		return false;
+
+	for (int s = 0; s < block->num_succ; s++) {
+		work[(*num_work)++] = cfg->blocks[block->succ[s]].first;
+	}
+
+	return true;
+}
+
+/*
+ * Collects the instructions where the value of old_reg from def is live.
+ * Fails if new_reg can't hold the value there or other definitions of
+ * old_reg reach these instructions.
+ */
+static bool find_region(struct cfg *cfg, size_t def, uint8_t old_reg, uint8_t new_reg)
+{
+	uint32_t old_mask = REG_MASK(old_reg);
+	uint32_t new_mask = REG_MASK(new_reg);
+	size_t num_work = 0;
+
+	cur_stamp++;
+	region_len = 0;
+
+	if (!push_succ(cfg, def, old_mask, &num_work))
+		return false;
+
+	while (num_work > 0) {
+		size_t j = work[--num_work];
+
+		if (stamp[j] == cur_stamp || !(cfg->live_in[j] & old_mask))
+			continue;
+
+		if (j == def || (cfg->live_in[j] & new_mask) || is_delay_slot_of_call(j))
+			return false;
+
+		stamp[j] = cur_stamp;
+		region[region_len++] = j;
+
+		/* the value ends here or old_reg gets a new value */
+		if (!(cfg->live_out[j] & old_mask) || (instr_defs(j) & old_mask))
+			continue;
+
+		if (instr_defs(j) & new_mask)
+			return false;
+
+		if (!push_succ(cfg, j, old_mask, &num_work))
+			return false;
+	}
+
+	/* no other definition may reach the region */
+	for (size_t k = 0; k < region_len; k++) {
+		size_t j = region[k];
+		struct block *block = &cfg->blocks[cfg->block_of[j]];
+
+		if (j != block->first)
+			continue;
+
+		if (block->entry)
+			return false;
+
+		for (size_t p = 0; p < block->num_pred; p++) {
+			size_t last = cfg->blocks[block->pred[p]].last;
+
+			if ((cfg->live_out[last] & old_mask) && stamp[last] != cur_stamp && last != def)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/* change in the number of compressed instructions */
+static int rename_gain(size_t def, uint8_t old_reg, uint8_t new_reg)
+{
+	struct instr instr = prog[def];
+	*get_dest_field(&instr) = new_reg;
+	int gain = compressible(&instr, def) - prog[def].compressed;
+
+	for (size_t k = 0; k < region_len; k++) {
+		size_t j = region[k];
+		instr = prog[j];
+		replace_src(&instr, old_reg, new_reg);
+		gain += compressible(&instr, j) - prog[j].compressed;
+	}
+
+	return gain;
+}
+
+static void apply_rename(struct cfg *cfg, size_t def, uint8_t old_reg, uint8_t new_reg)
+{
+	uint32_t old_mask = REG_MASK(old_reg);
+	uint32_t new_mask = REG_MASK(new_reg);
+
+	*get_dest_field(&prog[def]) = new_reg;
+	prog[def].compressed = compressible(&prog[def], def);
+	cfg->live_out[def] = (cfg->live_out[def] & ~old_mask) | new_mask;
+
+	for (size_t k = 0; k < region_len; k++) {
+		size_t j = region[k];
+
+		replace_src(&prog[j], old_reg, new_reg);
+		prog[j].compressed = compressible(&prog[j], j);
+
+		cfg->live_in[j] = (cfg->live_in[j] & ~old_mask) | new_mask;
+		if ((cfg->live_out[j] & old_mask) && !(instr_defs(j) & old_mask))
+			cfg->live_out[j] = (cfg->live_out[j] & ~old_mask) | new_mask;
+	}
+}
+
+static bool try_rename(struct cfg *cfg, size_t index)
+{
+	struct instr *instr = &prog[index];
+	uint8_t *dest = get_dest_field(instr);
+
+	if (instr->compressed || attr[index].code_ref || dest == NULL ||
+		is_call(instr->op) || is_delay_slot_of_call(index))
+		return false;
+
+	uint8_t old_reg = *dest;
+	if (old_reg == 0 || !(REG_SCRATCH & REG_MASK(old_reg)))
+		return false;
+
+	uint8_t *regs[2];
+	int num = get_src_regs(instr, regs);
+
+	for (int i = 0; i < num; i++) {
+		uint8_t new_reg = *regs[i];
+
+		if (new_reg == old_reg || !(REG_SCRATCH & REG_MASK(new_reg)) ||
+			(cfg->live_out[index] & REG_MASK(new_reg)))
+			continue;
+
+		struct instr renamed = *instr;
+		*get_dest_field(&renamed) = new_reg;
+		if (!is_compressible_simple(&renamed))
+			continue;
+
+		if (!find_region(cfg, index, old_reg, new_reg) || rename_gain(index, old_reg, new_reg) <= 0)
+			continue;
+
+		apply_rename(cfg, index, old_reg, new_reg);
+		return true;
+	}
+
+	return false;
+}
+
+void rename_registers(void)
+{
+	struct cfg cfg;
+	cfg_build(&cfg);
+	cfg_liveness(&cfg);
+
+	stamp = alloc(num_instr + 1, sizeof(*stamp));
+	region = alloc(num_instr + 1, sizeof(*region));
+	/* every instruction is pushed at most once per predecessor */
+	work = alloc(2 * num_instr + 2, sizeof(*work));
+
+	size_t compressed_before = 0;
+	for (size_t i = 0; i < num_instr; i++) {
+		compressed_before += prog[i].compressed;
+	}
+
+	uint32_t num_renamed = 0;
+	for (int pass = 0; pass < MAX_RENAME_PASSES; pass++) {
+		uint32_t num = 0;
+
+		for (size_t i = 0; i < num_instr; i++) {
+			num += try_rename(&cfg, i);
+		}
+
+		num_renamed += num;
+		if (num == 0)
+			break;
+	}
+
+	size_t compressed_after = 0;
+	for (size_t i = 0; i < num_instr; i++) {
+		compressed_after += prog[i].compressed;
+	}
+
+	fprintf(stderr, "register renaming: %u values renamed, %zd more compressed instructions, "
+		"%zd bytes smaller\n", num_renamed,
+		(ssize_t)(compressed_after - compressed_before),
+		2 * (ssize_t)(compressed_after - compressed_before));
+
+	free(stamp);
+	free(region);
+	free(work);
+	stamp = NULL;
+	region = NULL;
+	work = NULL;
+	cfg_free(&cfg);
+}
@@ -17,14 +17,18 @@
 
 #include "../common/instr.h"
 #include "../common/v2_instr.h"
+#include "../common/v3_instr.h"
+#include "../common/dict_instr.h"
 #include "../common/print_instr.h"
 
 static char *program_name = "disas";
 
 static void usage(void)
 {
-	fprintf(stderr, "Usage: %s [-c] [-p] [-l] IN-FILE \n", program_name);
+	fprintf(stderr, "Usage: %s [-c] [-3] [-X DICT] [-p] [-l] IN-FILE \n", program_name);
 	fprintf(stderr, "\t-c\tcompressed instruction format\n");
+	fprintf(stderr, "\t-3\texperimental v3 compressed instruction format\n");
+	fprintf(stderr, "\t-X\tdictionary encoding with the dictionary of the converter\n");
 	fprintf(stderr, "\t-p\tconvert to pseudo instructions if possible\n");
 	fprintf(stderr, "\t-l\tprint address of instructions\n");
 	exit(EXIT_FAILURE);
@@ -57,12 +61,22 @@ int main(int argc, char *argv[])
 
 	int opt = 0;
 
-	while ((opt = getopt(argc, argv, "cpl")) != -1) {
+	while ((opt = getopt(argc, argv, "c3X:pl")) != -1) {
 		switch(opt) {
 		case 'c':
 			v2 = true;
 			break;
 
+		case '3':
+			v2 = true;
+			use_v3_encodings();
+			break;
+
+		case 'X':
+			v2 = true;
+			read_dictionary(optarg);
+			break;
+
 		case 'p':
 			conv = true;
 			break;
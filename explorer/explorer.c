@@ -0,0 +1,578 @@
+/**
+ * @file explorer.c
+ * @date 2026-10-18
+ * Searches the set of 16-bit instructions that saves the most bytes on a
+ * corpus of uncompressed programs. A candidate is one opcode, that are the
+ * consecutive entries with the same name in the table of the current
+ * encoding (common/v2_instr.c) or in the table of extra candidates below.
+ * The search starts with the current set, adds the best candidates while
+ * opcodes are free and then swaps candidates as long as the savings grow.
+ * Every step evaluates all its candidate sets in parallel (-j).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "../common/v2_instr.h"
+
+#define MAX_OPCODES (32)
+#define MAX_GROUPS  (64)
+#define MAX_THREADS (64)
+
+/* the simulator writes the profile with the addresses of the text section */
+#define PC_START (0x40000000)
+
+static char *program_name = "explorer";
+
+/* Candidates that aren't part of the current encoding, their opcode is
+ * assigned when they are chosen. */
+static const struct c_encoding extra_encodings[] = {
+	/* name    opcode format       op     rd          rs          rt          imm          commutative */
+	{ "and",   0x00, C_FORMAT_R, AND,   C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,  true  },
+	{ "slt",   0x00, C_FORMAT_R, SLT,   C_REG_RDS,  C_REG_RDS,  C_REG_RT,   C_IMM_NONE,  false },
+	{ "snez",  0x00, C_FORMAT_R, SNEZ,  C_REG_RDS,  C_REG_NONE, C_REG_RT,   C_IMM_NONE,  false },
+	{ "seqz",  0x00, C_FORMAT_R, SEQZ,  C_REG_NONE, C_REG_RT,   C_REG_RDS,  C_IMM_NONE,  false },
+	{ "sllv",  0x00, C_FORMAT_R, SLLV,  C_REG_RDS,  C_REG_RT,   C_REG_RDS,  C_IMM_NONE,  false },
+	{ "srlv",  0x00, C_FORMAT_R, SRLV,  C_REG_RDS,  C_REG_RT,   C_REG_RDS,  C_IMM_NONE,  false },
+	{ "mfhi",  0x00, C_FORMAT_R, MFHI,  C_REG_RDS,  C_REG_NONE, C_REG_NONE, C_IMM_NONE,  false },
+	{ "mflo",  0x00, C_FORMAT_R, MFLO,  C_REG_RDS,  C_REG_NONE, C_REG_NONE, C_IMM_NONE,  false },
+	{ "ori",   0x00, C_FORMAT_I, ORI,   C_REG_NONE, C_REG_RDS,  C_REG_RDS,  C_IMM_U5,    false },
+	{ "xori",  0x00, C_FORMAT_I, XORI,  C_REG_NONE, C_REG_RDS,  C_REG_RDS,  C_IMM_U5,    false },
+	{ "lbu0",  0x00, C_FORMAT_R, LBU,   C_REG_NONE, C_REG_RT,   C_REG_RDS,  C_IMM_ZERO,  false },
+	{ "sb0",   0x00, C_FORMAT_R, SB,    C_REG_NONE, C_REG_RT,   C_REG_RDS,  C_IMM_ZERO,  false },
+};
+
+#define NUM_EXTRA (sizeof(extra_encodings) / sizeof(extra_encodings[0]))
+
+/* consecutive entries of the pool with the same name */
+struct group {
+	size_t first;
+	size_t num;
+	bool current; /* part of the current encoding */
+};
+
+/* the instructions that can use exactly the candidates in mask */
+struct class {
+	uint64_t mask;
+	uint64_t count;
+	uint64_t fetched;
+};
+
+static struct c_encoding pool[MAX_GROUPS * 4];
+static size_t pool_size = 0;
+static struct group groups[MAX_GROUPS];
+static size_t num_groups = 0;
+
+static struct class *classes = NULL;
+static size_t num_classes = 0;
+
+static unsigned num_threads = 1;
+static bool dynamic = false;
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: %s [-d] [-j THREADS] [-n NUM] FILE[:PROFILE]...\n", program_name);
+	fprintf(stderr, "\tFILE is the text section of an uncompressed program, PROFILE\n");
+	fprintf(stderr, "\tits execution profile from the simulator (-P)\n");
+	fprintf(stderr, "\t-d\tMaximize the fetched bytes saved instead of the size, needs all profiles\n");
+	fprintf(stderr, "\t-j\tNumber of threads\n");
+	fprintf(stderr, "\t-n\tMaximum number of opcodes (1-%d, default %d)\n", MAX_OPCODES, MAX_OPCODES);
+	exit(EXIT_FAILURE);
+}
+
+static void add_pool(const struct c_encoding *table, size_t num, bool current)
+{
+	for (size_t i = 0; i < num; i++) {
+		if (num_groups == 0 || strcmp(pool[pool_size - 1].name, table[i].name) != 0) {
+			if (num_groups == MAX_GROUPS) {
+				fprintf(stderr, "More than %d candidates\n", MAX_GROUPS);
+				exit(EXIT_FAILURE);
+			}
+			groups[num_groups++] = (struct group) { pool_size, 0, current };
+		}
+		if (pool_size == sizeof(pool) / sizeof(pool[0])) {
+			fprintf(stderr, "Too many encodings\n");
+			exit(EXIT_FAILURE);
+		}
+		pool[pool_size++] = table[i];
+		groups[num_groups - 1].num++;
+	}
+}
+
+static uint64_t current_set(void)
+{
+	uint64_t set = 0;
+	for (size_t g = 0; g < num_groups; g++) {
+		if (groups[g].current)
+			set |= UINT64_C(1) << g;
+	}
+	return set;
+}
+
+static uint32_t to_instr4(uint8_t bytes[4])
+{
+	uint32_t instr = bytes[0];
+	instr = (instr << 8) | bytes[1];
+	instr = (instr << 8) | bytes[2];
+	instr = (instr << 8) | bytes[3];
+	return instr;
+}
+
+/*
+ * The candidates that can encode the instruction at pc. Branch offsets are
+ * taken from the uncompressed program, which overestimates them, and jumps
+ * count as B and BAL like in the converter.
+ */
+static uint64_t instr_mask(uint32_t code, uint32_t pc)
+{
+	struct instr instr;
+	memset(&instr, 0, sizeof(instr));
+	parse_instr(code, &instr);
+	conv_to_pseudo(&instr);
+
+	if (instr.op == INVALID_OP)
+		return 0;
+
+	if (instr.op == J || instr.op == JAL) {
+		instr.simm = instr.addr - ((PC_START + pc + 4) & 0x0FFFFFFF);
+		instr.op = instr.op == J ? B : BAL;
+	}
+
+	uint64_t mask = 0;
+	for (size_t g = 0; g < num_groups; g++) {
+		if (match_encoding(&pool[groups[g].first], groups[g].num, &instr) != NULL)
+			mask |= UINT64_C(1) << g;
+	}
+	return mask;
+}
+
+/* one program of the corpus */
+struct program {
+	const char *path;
+	const char *profile;
+	struct class *classes;
+	size_t num_classes;
+	uint64_t num_instr;
+	uint64_t fetched;
+};
+
+static void read_profile(struct program *prog, size_t num, uint64_t exec[num])
+{
+	FILE *file = fopen(prog->profile, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open file '%s'\n", prog->profile);
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t addr;
+	uint64_t count;
+	uint64_t taken;
+	size_t line = 0;
+	int rc;
+
+	while ((rc = fscanf(file, "%" SCNx32 " %" SCNu64 " %" SCNu64, &addr, &count, &taken)) == 3) {
+		line++;
+
+		if (addr < PC_START || (addr - PC_START) / 4 >= num) {
+			fprintf(stderr, "Warning: profile address 0x%8.8X is outside of the code\n", addr);
+			continue;
+		}
+
+		if ((addr - PC_START) % 4 != 0) {
+			fprintf(stderr, "The profile in '%s' isn't from the uncompressed program (line %zu)\n",
+				prog->profile, line);
+			exit(EXIT_FAILURE);
+		}
+
+		exec[(addr - PC_START) / 4] = count;
+	}
+
+	if (rc != EOF) {
+		fprintf(stderr, "Invalid profile '%s' after line %zu\n", prog->profile, line);
+		exit(EXIT_FAILURE);
+	}
+
+	fclose(file);
+}
+
+static int cmp_class(const void *a, const void *b)
+{
+	uint64_t x = ((const struct class *)a)->mask;
+	uint64_t y = ((const struct class *)b)->mask;
+	return (x > y) - (x < y);
+}
+
+/* sorts the classes and merges the ones with the same mask */
+static size_t merge_classes(struct class *list, size_t num)
+{
+	qsort(list, num, sizeof(*list), cmp_class);
+
+	size_t out = 0;
+	for (size_t i = 0; i < num; i++) {
+		if (out > 0 && list[out - 1].mask == list[i].mask) {
+			list[out - 1].count += list[i].count;
+			list[out - 1].fetched += list[i].fetched;
+		} else {
+			list[out++] = list[i];
+		}
+	}
+	return out;
+}
+
+static void analyze_program(struct program *prog)
+{
+	FILE *file = fopen(prog->path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open file '%s'\n", prog->path);
+		exit(EXIT_FAILURE);
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	rewind(file);
+
+	size_t num = size > 0 ? size / 4 : 0;
+	uint64_t *exec = alloc(num, sizeof(*exec));
+	if (prog->profile != NULL)
+		read_profile(prog, num, exec);
+
+	prog->classes = alloc(num, sizeof(*prog->classes));
+	prog->num_instr = num;
+	prog->fetched = 0;
+
+	uint8_t bytes[4];
+	for (size_t i = 0; i < num; i++) {
+		if (fread(bytes, sizeof(bytes), 1, file) != 1) {
+			fprintf(stderr, "Couldn't read file '%s'\n", prog->path);
+			exit(EXIT_FAILURE);
+		}
+
+		prog->classes[i] = (struct class) {
+			.mask = instr_mask(to_instr4(bytes), i * 4),
+			.count = 1,
+			.fetched = exec[i]
+		};
+		prog->fetched += 4 * exec[i];
+	}
+
+	prog->num_classes = merge_classes(prog->classes, num);
+
+	free(exec);
+	fclose(file);
+}
+
+/* runs fn for every index with up to num_threads threads */
+typedef void (*part_fn)(size_t first, size_t end, void *arg);
+
+struct part {
+	pthread_t thread;
+	size_t first;
+	size_t end;
+	part_fn fn;
+	void *arg;
+};
+
+static void *run_part(void *arg)
+{
+	struct part *part = arg;
+	part->fn(part->first, part->end, part->arg);
+	return NULL;
+}
+
+static void parallel_for(size_t num, part_fn fn, void *arg)
+{
+	size_t num_parts = num < num_threads ? num : num_threads;
+	struct part parts[MAX_THREADS];
+
+	if (num_parts == 0)
+		return;
+
+	for (size_t p = 0; p < num_parts; p++) {
+		parts[p] = (struct part) {
+			.first = num * p / num_parts,
+			.end = num * (p + 1) / num_parts,
+			.fn = fn,
+			.arg = arg
+		};
+	}
+
+	for (size_t p = 1; p < num_parts; p++) {
+		if (pthread_create(&parts[p].thread, NULL, run_part, &parts[p]) != 0) {
+			fprintf(stderr, "Couldn't create a thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	run_part(&parts[0]);
+
+	for (size_t p = 1; p < num_parts; p++) {
+		pthread_join(parts[p].thread, NULL);
+	}
+}
+
+static void analyze_part(size_t first, size_t end, void *arg)
+{
+	struct program *progs = arg;
+	for (size_t i = first; i < end; i++) {
+		analyze_program(&progs[i]);
+	}
+}
+
+/* the bytes saved by the set, 2 for every compressed instruction */
+static uint64_t saved(uint64_t set, bool fetched)
+{
+	uint64_t sum = 0;
+	for (size_t c = 0; c < num_classes; c++) {
+		if ((classes[c].mask & set) != 0)
+			sum += fetched ? classes[c].fetched : classes[c].count;
+	}
+	return 2 * sum;
+}
+
+struct candidates {
+	uint64_t *sets;
+	uint64_t *savings;
+};
+
+static void evaluate_part(size_t first, size_t end, void *arg)
+{
+	struct candidates *cand = arg;
+	for (size_t i = first; i < end; i++) {
+		cand->savings[i] = saved(cand->sets[i], dynamic);
+	}
+}
+
+/* returns the best of the sets, ties go to the first */
+static uint64_t best_set(uint64_t *sets, size_t num, uint64_t *best_savings)
+{
+	uint64_t savings[MAX_GROUPS * MAX_GROUPS + MAX_GROUPS];
+	struct candidates cand = { sets, savings };
+	parallel_for(num, evaluate_part, &cand);
+
+	size_t best = 0;
+	for (size_t i = 1; i < num; i++) {
+		if (savings[i] > savings[best])
+			best = i;
+	}
+	*best_savings = savings[best];
+	return sets[best];
+}
+
+static unsigned popcount(uint64_t set)
+{
+	unsigned count = 0;
+	for (; set != 0; set &= set - 1)
+		count++;
+	return count;
+}
+
+static uint64_t search(uint64_t set, unsigned max_opcodes)
+{
+	uint64_t sets[MAX_GROUPS * MAX_GROUPS + MAX_GROUPS];
+	uint64_t value;
+
+	/* drop the least useful opcodes */
+	while (popcount(set) > max_opcodes) {
+		size_t num = 0;
+		for (size_t g = 0; g < num_groups; g++) {
+			if (set & (UINT64_C(1) << g))
+				sets[num++] = set & ~(UINT64_C(1) << g);
+		}
+		set = best_set(sets, num, &value);
+	}
+
+	uint64_t current = saved(set, dynamic);
+	for (;;) {
+		size_t num = 0;
+		for (size_t a = 0; a < num_groups; a++) {
+			uint64_t add = UINT64_C(1) << a;
+			if (set & add)
+				continue;
+
+			if (popcount(set) < max_opcodes)
+				sets[num++] = set | add;
+
+			for (size_t r = 0; r < num_groups; r++) {
+				uint64_t remove = UINT64_C(1) << r;
+				if (set & remove)
+					sets[num++] = (set & ~remove) | add;
+			}
+		}
+
+		if (num == 0)
+			break;
+
+		uint64_t next = best_set(sets, num, &value);
+		if (value <= current)
+			break;
+
+		set = next;
+		current = value;
+	}
+	return set;
+}
+
+static void print_set(const char *title, uint64_t set, uint64_t num_instr, uint64_t fetched)
+{
+	uint64_t size = saved(set, false);
+	printf("%s: %u opcodes, %" PRIu64 " bytes smaller (%.1f %%)", title, popcount(set), size,
+		100.0 * size / (4 * num_instr));
+	if (fetched > 0) {
+		uint64_t less = saved(set, true);
+		printf(", %" PRIu64 " bytes less fetched (%.1f %%)", less, 100.0 * less / fetched);
+	}
+	printf("\n");
+}
+
+/* current opcodes keep their number, the others get the free ones */
+static void print_opcodes(uint64_t set, uint64_t start)
+{
+	bool used[MAX_OPCODES] = { false };
+	uint8_t opcode[MAX_GROUPS];
+
+	for (size_t g = 0; g < num_groups; g++) {
+		if ((set & (UINT64_C(1) << g)) && groups[g].current) {
+			opcode[g] = pool[groups[g].first].opcode;
+			used[opcode[g]] = true;
+		}
+	}
+
+	uint8_t next = 0;
+	for (size_t g = 0; g < num_groups; g++) {
+		if ((set & (UINT64_C(1) << g)) && !groups[g].current) {
+			while (used[next])
+				next++;
+			opcode[g] = next;
+			used[next] = true;
+		}
+	}
+
+	printf("opcode | name  | bytes saved only by it\n");
+	for (uint8_t op = 0; op < MAX_OPCODES; op++) {
+		for (size_t g = 0; g < num_groups; g++) {
+			uint64_t bit = UINT64_C(1) << g;
+			if ((set & bit) && opcode[g] == op) {
+				uint64_t loss = saved(set, dynamic) - saved(set & ~bit, dynamic);
+				printf("  0x%2.2X | %-5s | %8" PRIu64 "%s\n", op, pool[groups[g].first].name,
+					loss, (start & bit) ? "" : " (new)");
+			}
+		}
+	}
+
+	for (size_t g = 0; g < num_groups; g++) {
+		uint64_t bit = UINT64_C(1) << g;
+		if ((start & bit) && !(set & bit))
+			printf("     - | %-5s | removed\n", pool[groups[g].first].name);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 0)
+		program_name = argv[0];
+
+	unsigned max_opcodes = MAX_OPCODES;
+	int opt = 0;
+
+	while ((opt = getopt(argc, argv, "dj:n:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dynamic = true;
+			break;
+
+		case 'j':
+			num_threads = strtoul(optarg, NULL, 0);
+			if (num_threads < 1 || num_threads > MAX_THREADS) {
+				fprintf(stderr, "The number of threads has to be between 1 and %d\n", MAX_THREADS);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'n':
+			max_opcodes = strtoul(optarg, NULL, 0);
+			if (max_opcodes < 1 || max_opcodes > MAX_OPCODES) {
+				fprintf(stderr, "The number of opcodes has to be between 1 and %d\n", MAX_OPCODES);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case '?':
+		default:
+			usage();
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "missing binary file\n");
+		usage();
+	}
+
+	add_pool(v2_encodings, num_v2_encodings, true);
+	add_pool(extra_encodings, NUM_EXTRA, false);
+
+	size_t num_progs = argc - optind;
+	struct program *progs = alloc(num_progs, sizeof(*progs));
+
+	for (size_t i = 0; i < num_progs; i++) {
+		char *path = argv[optind + i];
+		char *colon = strchr(path, ':');
+
+		progs[i].path = path;
+		progs[i].profile = NULL;
+		if (colon != NULL) {
+			*colon = '\0';
+			progs[i].profile = colon + 1;
+		}
+
+		if (dynamic && progs[i].profile == NULL) {
+			fprintf(stderr, "-d needs a profile for '%s'\n", path);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	parallel_for(num_progs, analyze_part, progs);
+
+	uint64_t num_instr = 0;
+	uint64_t fetched = 0;
+	size_t total_classes = 0;
+	for (size_t i = 0; i < num_progs; i++) {
+		num_instr += progs[i].num_instr;
+		fetched += progs[i].fetched;
+		total_classes += progs[i].num_classes;
+	}
+
+	classes = alloc(total_classes, sizeof(*classes));
+	for (size_t i = 0; i < num_progs; i++) {
+		memcpy(&classes[num_classes], progs[i].classes,
+			progs[i].num_classes * sizeof(*classes));
+		num_classes += progs[i].num_classes;
+		free(progs[i].classes);
+	}
+	num_classes = merge_classes(classes, num_classes);
+
+	printf("corpus: %zu programs, %" PRIu64 " instructions, %" PRIu64 " bytes", num_progs,
+		num_instr, 4 * num_instr);
+	if (fetched > 0)
+		printf(", %" PRIu64 " bytes fetched", fetched);
+	printf("\n");
+
+	uint64_t start = current_set();
+	uint64_t best = search(start, max_opcodes);
+
+	print_set("current", start, num_instr, fetched);
+	print_set("best", best, num_instr, fetched);
+	print_opcodes(best, start);
+
+	free(classes);
+	free(progs);
+
+	return 0;
+}
@@ -0,0 +1,1037 @@
+/**
+ * @file linker.c
+ * @date 2026-10-18
+ * Links relocatable MIPS-I objects and archives directly into the images
+ * of the compressed program. The sections are placed like
+ * bench/common/linker.ld places them and only the sections that are reached
+ * from the entry point are kept. The relocations are applied to the
+ * uncompressed code, which the converter then compresses while it relaxes
+ * the branches. The relocations also tell exactly which HI16/LO16 pairs and
+ * data words hold code addresses, so they are updated without guessing.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "../common/instr.h"
+#include "../common/alloc.h"
+#include "../common/elf_file.h"
+#include "../converter/converter.h"
+
+#define TEXT_BASE DEFAULT_TEXT_BASE
+#define DATA_BASE DEFAULT_DATA_BASE
+/* the stack grows down from the end of the RAM */
+#define STACK_START (0x4000)
+
+#define NONE SIZE_MAX
+
+#define AR_MAGIC "!<arch>\n"
+#define AR_HDR_SIZE 60
+
+static char *program_name = "linker";
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: %s [-GwrsOF3u] [-k SYMBOL]... [-a WIDTH] [-j THREADS] [-p PROFILE [-L]] [-X DICT-OUT] [-e ENTRY] -o TEXT-OUT -D DATA-OUT FILE...\n", program_name);
+	fprintf(stderr, "FILE is a relocatable object or an archive of them. The members of an\n"
+		"archive are linked if they define an undefined symbol.\n");
+	fprintf(stderr, "\t-o\tOutput file for the raw text section\n");
+	fprintf(stderr, "\t-D\tOutput file for the raw data image\n");
+	fprintf(stderr, "\t-e\tEntry symbol, whose section is placed first (default _start)\n");
+	fprintf(stderr, "\t-u\tWrite the uncompressed program, e.g. to create a profile\n");
+	fprintf(stderr, "\t-G\tRemove the code that can't be reached from the entry point\n");
+	fprintf(stderr, "\t-k\tSymbol of code that is kept by -G and the section GC, can be repeated\n");
+	fprintf(stderr, "\t-w\tRewrite instructions into compressible equivalents\n");
+	fprintf(stderr, "\t-r\tRename scratch registers so that more instructions can be compressed\n");
+	fprintf(stderr, "\t-s\tFill the delay slots and remove the NOPs in them\n");
+	fprintf(stderr, "\t-O\tOutline repeated instruction sequences into subroutines\n");
+	fprintf(stderr, "\t-F\tPlace functions next to their callers, weighted by the profile if there is one\n");
+	fprintf(stderr, "\t-3\tUse the experimental v3 encoding with 3 bit register fields\n");
+	fprintf(stderr, "\t-a\tAlign branch targets to WIDTH (4 or 8) bytes, loop heads without a profile\n");
+	fprintf(stderr, "\t-j\tNumber of threads that decode and encode the instructions\n");
+	fprintf(stderr, "\t-p\tExecution profile of the uncompressed program (-u) from the simulator (-P)\n");
+	fprintf(stderr, "\t-L\tArrange the basic blocks of every function after the profile\n");
+	fprintf(stderr, "\t-X\tUse the dictionary encoding and write the dictionary to DICT-OUT\n");
+	exit(EXIT_FAILURE);
+}
+
+/* the order of the sections in the output, like in the linker script */
+enum sect_kind {
+	KIND_NONE,
+	KIND_TEXT,
+	KIND_DATA,
+	KIND_SDATA,
+	KIND_RODATA,
+	KIND_BSS,
+	KIND_SBSS,
+	NUM_KINDS
+};
+
+struct section {
+	enum sect_kind kind;
+	size_t rel; /* the relocations of the section or 0 */
+	bool keep;
+	uint32_t addr;
+};
+
+struct object {
+	char *name;
+	struct elf_file elf;
+	struct section *sects;
+	size_t num_syms;
+	const uint8_t *syms;
+	const char *strtab;
+	size_t strtab_size;
+	size_t *globals; /* the global symbol of every symbol or NONE */
+	bool loaded;
+	bool from_archive;
+};
+
+struct symbol {
+	const char *name;
+	struct object *obj; /* the object that defines it */
+	uint16_t shndx; /* SHN_UNDEF until it is defined */
+	uint32_t value;
+	uint32_t size; /* of COMMON symbols */
+	uint32_t align;
+	bool weak;
+	bool referenced; /* by a symbol that isn't weak */
+	bool used; /* COMMON symbols that are reached */
+};
+
+/* a code address in the data image */
+struct data_ref {
+	uint32_t offset;
+	uint32_t addr;
+};
+
+/* the loaded objects in the order of the command line */
+static struct object **objects = NULL;
+static size_t num_objects = 0;
+static size_t max_objects = 0;
+/* the members of the archives that aren't loaded yet */
+static struct object **members = NULL;
+static size_t num_members = 0;
+static size_t max_members = 0;
+static size_t num_from_archives = 0;
+
+static struct symbol *symbols = NULL;
+static size_t num_symbols = 0;
+static size_t max_symbols = 0;
+/* open addressing with the symbol index plus one */
+static size_t *hash_table = NULL;
+static size_t hash_size = 0;
+
+static uint8_t *text = NULL;
+static uint32_t text_size = 0;
+static uint8_t *data = NULL;
+static uint32_t data_size = 0;
+static uint32_t gp = 0;
+
+/* HI16/LO16 pairs in the text, as instruction indices */
+static size_t (*code_pairs)[2] = NULL;
+static size_t num_code_pairs = 0;
+static struct data_ref *data_refs = NULL;
+static size_t num_data_refs = 0;
+
+static void link_error(struct object *obj, const char *msg, const char *arg)
+{
+	fprintf(stderr, "%s: ", obj->name);
+	fprintf(stderr, msg, arg);
+	fprintf(stderr, "\n");
+	exit(EXIT_FAILURE);
+}
+
+static bool has_prefix(const char *str, const char *prefix)
+{
+	return strncmp(str, prefix, strlen(prefix)) == 0;
+}
+
+static uint32_t align_up(uint32_t addr, uint32_t align)
+{
+	if (align <= 1)
+		return addr;
+	return (addr + align - 1) / align * align;
+}
+
+static uint32_t hash_name(const char *name)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+	for (; *name != '\0'; name++) {
+		hash = (hash ^ (uint8_t)*name) * 16777619u;
+	}
+	return hash;
+}
+
+static void rehash(void)
+{
+	free(hash_table);
+	hash_size = hash_size > 0 ? 2 * hash_size : 1024;
+	hash_table = alloc(hash_size, sizeof(*hash_table));
+
+	for (size_t i = 0; i < num_symbols; i++) {
+		size_t h = hash_name(symbols[i].name) & (hash_size - 1);
+		while (hash_table[h] != 0) {
+			h = (h + 1) & (hash_size - 1);
+		}
+		hash_table[h] = i + 1;
+	}
+}
+
+/* returns the index of the global symbol, or NONE if it doesn't exist and
+ * shouldn't be created */
+static size_t find_symbol(const char *name, bool create)
+{
+	if (2 * (num_symbols + 1) > hash_size)
+		rehash();
+
+	size_t h = hash_name(name) & (hash_size - 1);
+	while (hash_table[h] != 0) {
+		if (strcmp(symbols[hash_table[h] - 1].name, name) == 0)
+			return hash_table[h] - 1;
+		h = (h + 1) & (hash_size - 1);
+	}
+
+	if (!create)
+		return NONE;
+
+	symbols = grow(symbols, num_symbols, &max_symbols, sizeof(*symbols));
+	symbols[num_symbols] = (struct symbol) {
+		.name = name,
+		.obj = NULL,
+		.shndx = SHN_UNDEF,
+		.value = 0,
+		.size = 0,
+		.align = 1,
+		.weak = false,
+		.referenced = false,
+		.used = false
+	};
+	hash_table[h] = num_symbols + 1;
+	return num_symbols++;
+}
+
+static void read_sym(struct object *obj, size_t index, Elf32_Sym *sym)
+{
+	const uint8_t *p = obj->syms + index * sizeof(Elf32_Sym);
+
+	sym->st_name = elf_read32(p + offsetof(Elf32_Sym, st_name));
+	sym->st_value = elf_read32(p + offsetof(Elf32_Sym, st_value));
+	sym->st_size = elf_read32(p + offsetof(Elf32_Sym, st_size));
+	sym->st_info = p[offsetof(Elf32_Sym, st_info)];
+	sym->st_other = p[offsetof(Elf32_Sym, st_other)];
+	sym->st_shndx = elf_read16(p + offsetof(Elf32_Sym, st_shndx));
+
+	/* GCC puts small common symbols into .scommon, they go to the data too */
+	if (sym->st_shndx == SHN_MIPS_SCOMMON)
+		sym->st_shndx = SHN_COMMON;
+
+	if (sym->st_name >= obj->strtab_size)
+		link_error(obj, "invalid symbol name%s", "");
+
+	if (sym->st_shndx >= obj->elf.ehdr.e_shnum && sym->st_shndx != SHN_ABS &&
+		sym->st_shndx != SHN_COMMON)
+		link_error(obj, "unsupported section index of symbol '%s'", obj->strtab + sym->st_name);
+}
+
+static enum sect_kind section_kind(struct object *obj, size_t index)
+{
+	Elf32_Shdr *shdr = &obj->elf.shdr[index];
+	const char *name = elf_section_name(&obj->elf, index);
+
+	/* .reginfo and .MIPS.abiflags only describe the object */
+	if (!(shdr->sh_flags & SHF_ALLOC) ||
+		(shdr->sh_type != SHT_PROGBITS && shdr->sh_type != SHT_NOBITS))
+		return KIND_NONE;
+
+	if (shdr->sh_flags & SHF_EXECINSTR) {
+		if (shdr->sh_type != SHT_PROGBITS || shdr->sh_size % 4 != 0)
+			link_error(obj, "invalid text section '%s'", name);
+		return KIND_TEXT;
+	}
+
+	if (shdr->sh_type == SHT_NOBITS)
+		return has_prefix(name, ".sbss") ? KIND_SBSS : KIND_BSS;
+
+	if (has_prefix(name, ".sdata"))
+		return KIND_SDATA;
+
+	return (shdr->sh_flags & SHF_WRITE) ? KIND_DATA : KIND_RODATA;
+}
+
+static struct object *read_object(char *name, uint8_t *file, size_t size)
+{
+	struct object *obj = alloc(1, sizeof(*obj));
+	obj->name = name;
+
+	elf_parse(&obj->elf, file, size);
+	if (obj->elf.ehdr.e_type != ET_REL)
+		link_error(obj, "not a relocatable object%s", "");
+
+	struct elf_file *elf = &obj->elf;
+	obj->sects = alloc(elf->ehdr.e_shnum, sizeof(*obj->sects));
+
+	for (size_t i = 1; i < elf->ehdr.e_shnum; i++) {
+		Elf32_Shdr *shdr = &elf->shdr[i];
+		obj->sects[i].kind = section_kind(obj, i);
+
+		if (shdr->sh_type == SHT_RELA)
+			link_error(obj, "RELA relocations aren't supported%s", "");
+
+		if (shdr->sh_type == SHT_REL) {
+			if (shdr->sh_info >= elf->ehdr.e_shnum || shdr->sh_entsize != sizeof(Elf32_Rel))
+				link_error(obj, "invalid relocation section%s", "");
+			obj->sects[shdr->sh_info].rel = i;
+		}
+
+		if (shdr->sh_type == SHT_SYMTAB) {
+			if (obj->syms != NULL || shdr->sh_entsize != sizeof(Elf32_Sym) ||
+				shdr->sh_link >= elf->ehdr.e_shnum)
+				link_error(obj, "invalid symbol table%s", "");
+
+			obj->syms = elf_section_data(elf, i);
+			obj->num_syms = elf_num_entries(elf, i);
+			obj->strtab = (const char *)elf_section_data(elf, shdr->sh_link);
+			obj->strtab_size = elf->shdr[shdr->sh_link].sh_size;
+
+			if (obj->strtab_size == 0 || obj->strtab[obj->strtab_size - 1] != '\0')
+				link_error(obj, "invalid string table%s", "");
+		}
+	}
+
+	return obj;
+}
+
+/* adds the global symbols of the object to the symbol table */
+static void load_object(struct object *obj)
+{
+	obj->loaded = true;
+	obj->globals = alloc(obj->num_syms, sizeof(*obj->globals));
+
+	objects = grow(objects, num_objects, &max_objects, sizeof(*objects));
+	objects[num_objects++] = obj;
+
+	for (size_t i = 0; i < obj->num_syms; i++) {
+		Elf32_Sym sym;
+		read_sym(obj, i, &sym);
+
+		obj->globals[i] = NONE;
+		if (i == 0 || ELF32_ST_BIND(sym.st_info) == STB_LOCAL)
+			continue;
+
+		const char *name = obj->strtab + sym.st_name;
+		bool weak = ELF32_ST_BIND(sym.st_info) == STB_WEAK;
+		size_t index = find_symbol(name, true);
+		struct symbol *s = &symbols[index];
+		obj->globals[i] = index;
+
+		if (sym.st_shndx == SHN_UNDEF) {
+			s->referenced |= !weak;
+			continue;
+		}
+
+		if (sym.st_shndx == SHN_COMMON) {
+			if (s->shndx != SHN_UNDEF && s->shndx != SHN_COMMON)
+				continue;
+
+			s->shndx = SHN_COMMON;
+			s->size = sym.st_size > s->size ? sym.st_size : s->size;
+			s->align = sym.st_value > s->align ? sym.st_value : s->align;
+			continue;
+		}
+
+		bool defined = s->shndx != SHN_UNDEF && s->shndx != SHN_COMMON;
+		if (defined && !s->weak && !weak)
+			link_error(obj, "multiple definition of '%s'", name);
+
+		if (defined && (weak || !s->weak))
+			continue;
+
+		s->obj = obj;
+		s->shndx = sym.st_shndx;
+		s->value = sym.st_value;
+		s->weak = weak;
+	}
+}
+
+/* does the member define a symbol that is still undefined? */
+static bool defines_undefined(struct object *obj)
+{
+	for (size_t i = 1; i < obj->num_syms; i++) {
+		Elf32_Sym sym;
+		read_sym(obj, i, &sym);
+
+		if (ELF32_ST_BIND(sym.st_info) == STB_LOCAL || sym.st_shndx == SHN_UNDEF ||
+			sym.st_shndx == SHN_COMMON)
+			continue;
+
+		size_t index = find_symbol(obj->strtab + sym.st_name, false);
+		if (index != NONE && symbols[index].shndx == SHN_UNDEF && symbols[index].referenced)
+			return true;
+	}
+
+	return false;
+}
+
+/* loads archive members until they don't define undefined symbols anymore */
+static void load_members(void)
+{
+	bool changed = true;
+
+	while (changed) {
+		changed = false;
+
+		for (size_t i = 0; i < num_members; i++) {
+			if (!members[i]->loaded && defines_undefined(members[i])) {
+				load_object(members[i]);
+				num_from_archives++;
+				changed = true;
+			}
+		}
+	}
+}
+
+static char *member_name(const char *path, const char *name, size_t len)
+{
+	char *str = alloc(strlen(path) + len + 3, 1);
+	sprintf(str, "%s(%.*s)", path, (int)len, name);
+	return str;
+}
+
+/* reads the members of a System V or GNU archive */
+static void read_archive(const char *path, uint8_t *file, size_t size)
+{
+	const char *long_names = NULL;
+	size_t long_size = 0;
+	size_t pos = strlen(AR_MAGIC);
+
+	while (pos + 1 < size) {
+		const char *hdr = (const char *)file + pos;
+		char size_field[11];
+
+		if (size - pos < AR_HDR_SIZE || hdr[58] != '`' || hdr[59] != '\n') {
+			fprintf(stderr, "Invalid archive '%s'\n", path);
+			exit(EXIT_FAILURE);
+		}
+
+		memcpy(size_field, hdr + 48, 10);
+		size_field[10] = '\0';
+		size_t member_size = strtoul(size_field, NULL, 10);
+		pos += AR_HDR_SIZE;
+
+		if (member_size > size - pos) {
+			fprintf(stderr, "Invalid archive '%s'\n", path);
+			exit(EXIT_FAILURE);
+		}
+
+		uint8_t *member = file + pos;
+		pos += member_size + (member_size & 1);
+
+		const char *name = hdr;
+		size_t len = 0;
+
+		if (strncmp(hdr, "// ", 3) == 0) {
+			long_names = (const char *)member;
+			long_size = member_size;
+			continue;
+		}
+
+		/* the symbol index isn't needed, the members are searched */
+		if (strncmp(hdr, "/ ", 2) == 0 || strncmp(hdr, "/SYM64/ ", 8) == 0)
+			continue;
+
+		if (hdr[0] == '/' && isdigit((unsigned char)hdr[1])) {
+			size_t offset = strtoul(hdr + 1, NULL, 10);
+			if (long_names == NULL || offset >= long_size) {
+				fprintf(stderr, "Invalid member name in archive '%s'\n", path);
+				exit(EXIT_FAILURE);
+			}
+
+			name = long_names + offset;
+			while (offset + len < long_size && name[len] != '/' && name[len] != '\n') {
+				len++;
+			}
+		} else if (strncmp(hdr, "#1/", 3) == 0) {
+			fprintf(stderr, "BSD archives like '%s' aren't supported\n", path);
+			exit(EXIT_FAILURE);
+		} else {
+			while (len < 16 && name[len] != '/' && name[len] != ' ') {
+				len++;
+			}
+		}
+
+		if (!is_elf(member, member_size))
+			continue;
+
+		members = grow(members, num_members, &max_members, sizeof(*members));
+		members[num_members] = read_object(member_name(path, name, len), member, member_size);
+		members[num_members++]->from_archive = true;
+	}
+}
+
+static void free_object(struct object *obj)
+{
+	if (obj->from_archive)
+		free(obj->name);
+	elf_free(&obj->elf);
+	free(obj->sects);
+	free(obj->globals);
+	free(obj);
+}
+
+static void read_file(char *path, uint8_t *file, size_t size)
+{
+	if (size >= strlen(AR_MAGIC) && memcmp(file, AR_MAGIC, strlen(AR_MAGIC)) == 0) {
+		read_archive(path, file, size);
+	} else if (is_elf(file, size)) {
+		load_object(read_object(path, file, size));
+	} else {
+		fprintf(stderr, "'%s' is neither an object nor an archive\n", path);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* the sections that are reached from the entry point, like --gc-sections */
+struct sect_ref {
+	struct object *obj;
+	size_t index;
+};
+
+static struct sect_ref *worklist = NULL;
+static size_t num_work = 0;
+static size_t max_work = 0;
+
+static void keep_section(struct object *obj, size_t index)
+{
+	if (index == SHN_UNDEF || index >= obj->elf.ehdr.e_shnum)
+		return;
+
+	struct section *sect = &obj->sects[index];
+	if (sect->kind == KIND_NONE || sect->keep)
+		return;
+
+	sect->keep = true;
+	worklist = grow(worklist, num_work, &max_work, sizeof(*worklist));
+	worklist[num_work++] = (struct sect_ref) {obj, index};
+}
+
+static void keep_reached(struct object *entry_obj, size_t entry_sect)
+{
+	keep_section(entry_obj, entry_sect);
+
+	while (num_work > 0) {
+		struct sect_ref ref = worklist[--num_work];
+		struct object *obj = ref.obj;
+		size_t rel = obj->sects[ref.index].rel;
+		if (rel == 0)
+			continue;
+
+		const uint8_t *entry = elf_section_data(&obj->elf, rel);
+		for (size_t i = 0; i < elf_num_entries(&obj->elf, rel); i++, entry += sizeof(Elf32_Rel)) {
+			uint32_t index = ELF32_R_SYM(elf_read32(entry + offsetof(Elf32_Rel, r_info)));
+			if (index >= obj->num_syms)
+				link_error(obj, "invalid relocation%s", "");
+
+			if (obj->globals[index] == NONE) {
+				Elf32_Sym sym;
+				read_sym(obj, index, &sym);
+				keep_section(obj, sym.st_shndx);
+				continue;
+			}
+
+			struct symbol *s = &symbols[obj->globals[index]];
+			if (s->shndx == SHN_COMMON)
+				s->used = true;
+			else if (s->obj != NULL)
+				keep_section(s->obj, s->shndx);
+		}
+	}
+
+	free(worklist);
+	worklist = NULL;
+	max_work = 0;
+}
+
+static uint32_t place_sections(enum sect_kind kind, uint32_t addr)
+{
+	for (size_t o = 0; o < num_objects; o++) {
+		struct object *obj = objects[o];
+
+		for (size_t i = 1; i < obj->elf.ehdr.e_shnum; i++) {
+			if (obj->sects[i].kind != kind || !obj->sects[i].keep || obj->sects[i].addr != 0)
+				continue;
+
+			addr = align_up(addr, obj->elf.shdr[i].sh_addralign);
+			obj->sects[i].addr = addr;
+			addr += obj->elf.shdr[i].sh_size;
+		}
+	}
+
+	return addr;
+}
+
+static void define_symbol(const char *name, uint32_t value)
+{
+	size_t index = find_symbol(name, false);
+
+	if (index != NONE && symbols[index].shndx == SHN_UNDEF) {
+		symbols[index].shndx = SHN_ABS;
+		symbols[index].value = value;
+	}
+}
+
+/* the text starts with the section of the entry point, the data is placed
+ * from the start of the RAM and _gp points to its end */
+static void layout(struct object *entry_obj, size_t entry_sect)
+{
+	entry_obj->sects[entry_sect].addr = TEXT_BASE;
+	text_size = entry_obj->elf.shdr[entry_sect].sh_size;
+
+	/* the alignment of the code is lost in the compression anyway */
+	for (size_t o = 0; o < num_objects; o++) {
+		struct object *obj = objects[o];
+
+		for (size_t i = 1; i < obj->elf.ehdr.e_shnum; i++) {
+			if (obj->sects[i].kind != KIND_TEXT || !obj->sects[i].keep || obj->sects[i].addr != 0)
+				continue;
+
+			obj->sects[i].addr = TEXT_BASE + text_size;
+			text_size += obj->elf.shdr[i].sh_size;
+		}
+	}
+
+	uint32_t addr = DATA_BASE;
+	for (enum sect_kind kind = KIND_DATA; kind < NUM_KINDS; kind++) {
+		addr = place_sections(kind, addr);
+	}
+
+	for (size_t i = 0; i < num_symbols; i++) {
+		struct symbol *s = &symbols[i];
+		if (s->shndx != SHN_COMMON || !s->used)
+			continue;
+
+		addr = align_up(addr, s->align);
+		s->value = addr;
+		addr += s->size;
+	}
+
+	gp = addr;
+	data_size = addr - DATA_BASE;
+
+	if (addr > STACK_START) {
+		fprintf(stderr, "The data doesn't fit below the stack at 0x%X\n", STACK_START);
+		exit(EXIT_FAILURE);
+	}
+
+	define_symbol("_gp", gp);
+	define_symbol("__stack_start", STACK_START);
+
+	text = alloc(text_size, 1);
+	data = alloc(data_size, 1);
+
+	for (size_t o = 0; o < num_objects; o++) {
+		struct object *obj = objects[o];
+
+		for (size_t i = 1; i < obj->elf.ehdr.e_shnum; i++) {
+			struct section *sect = &obj->sects[i];
+			Elf32_Shdr *shdr = &obj->elf.shdr[i];
+			if (!sect->keep || shdr->sh_type == SHT_NOBITS)
+				continue;
+
+			uint8_t *out = sect->kind == KIND_TEXT ? text + (sect->addr - TEXT_BASE) :
+				data + (sect->addr - DATA_BASE);
+			memcpy(out, elf_section_data(&obj->elf, i), shdr->sh_size);
+		}
+	}
+}
+
+/* the address of a symbol of the object */
+static uint32_t symbol_addr(struct object *obj, size_t index)
+{
+	Elf32_Sym sym;
+	read_sym(obj, index, &sym);
+
+	if (obj->globals[index] == NONE) {
+		if (sym.st_shndx == SHN_ABS || sym.st_shndx == SHN_UNDEF)
+			return sym.st_value;
+
+		if (!obj->sects[sym.st_shndx].keep)
+			link_error(obj, "relocation against the discarded section '%s'",
+				elf_section_name(&obj->elf, sym.st_shndx));
+
+		return obj->sects[sym.st_shndx].addr + sym.st_value;
+	}
+
+	struct symbol *s = &symbols[obj->globals[index]];
+	switch (s->shndx) {
+	case SHN_UNDEF:
+		if (s->referenced)
+			link_error(obj, "undefined reference to '%s'", s->name);
+		/* undefined weak symbols are zero */
+		return 0;
+
+	case SHN_ABS:
+	case SHN_COMMON:
+		return s->value;
+
+	default:
+		if (!s->obj->sects[s->shndx].keep)
+			link_error(s->obj, "symbol '%s' isn't in a section of the program", s->name);
+		return s->obj->sects[s->shndx].addr + s->value;
+	}
+}
+
+static void add_code_pair(size_t hi, size_t lo)
+{
+	static size_t max_pairs = 0;
+	code_pairs = grow(code_pairs, num_code_pairs, &max_pairs, sizeof(*code_pairs));
+	code_pairs[num_code_pairs][0] = hi;
+	code_pairs[num_code_pairs][1] = lo;
+	num_code_pairs++;
+}
+
+static void add_data_ref(uint32_t offset, uint32_t addr)
+{
+	static size_t max_refs = 0;
+	data_refs = grow(data_refs, num_data_refs, &max_refs, sizeof(*data_refs));
+	data_refs[num_data_refs++] = (struct data_ref) {offset, addr};
+}
+
+/* the addend of the HI16 relocation i is completed by the next LO16 */
+static int16_t lo16_addend(struct object *obj, size_t rel, size_t i, const uint8_t *out)
+{
+	const uint8_t *entries = elf_section_data(&obj->elf, rel);
+	uint32_t sym = ELF32_R_SYM(elf_read32(entries + i * sizeof(Elf32_Rel) + offsetof(Elf32_Rel, r_info)));
+
+	for (size_t j = i + 1; j < elf_num_entries(&obj->elf, rel); j++) {
+		const uint8_t *entry = entries + j * sizeof(Elf32_Rel);
+		uint32_t offset = elf_read32(entry + offsetof(Elf32_Rel, r_offset));
+		uint32_t info = elf_read32(entry + offsetof(Elf32_Rel, r_info));
+
+		if (ELF32_R_TYPE(info) == R_MIPS_LO16 && ELF32_R_SYM(info) == sym)
+			return elf_read32(out + offset) & 0xFFFF;
+	}
+
+	link_error(obj, "HI16 relocation without LO16%s", "");
+	return 0;
+}
+
+/*
+ * Applies the relocations of the section. The HI16/LO16 pairs of the text
+ * are paired like the converter pairs them in linked ELF files: several
+ * HI16 can be followed by one LO16 and one HI16 can be reused by several
+ * LO16 of the same symbol.
+ */
+static void relocate(struct object *obj, size_t index)
+{
+	struct section *sect = &obj->sects[index];
+	Elf32_Shdr *shdr = &obj->elf.shdr[index];
+	size_t rel = sect->rel;
+	bool is_text = sect->kind == KIND_TEXT;
+	uint8_t *out = is_text ? text + (sect->addr - TEXT_BASE) : data + (sect->addr - DATA_BASE);
+
+	size_t num = elf_num_entries(&obj->elf, rel);
+	size_t *pending = alloc(num, sizeof(*pending));
+	size_t *last_hi = alloc(obj->num_syms, sizeof(*last_hi));
+	size_t num_pending = 0;
+
+	for (size_t i = 0; i < obj->num_syms; i++) {
+		last_hi[i] = NONE;
+	}
+
+	const uint8_t *entry = elf_section_data(&obj->elf, rel);
+	for (size_t i = 0; i < num; i++, entry += sizeof(Elf32_Rel)) {
+		uint32_t offset = elf_read32(entry + offsetof(Elf32_Rel, r_offset));
+		uint32_t info = elf_read32(entry + offsetof(Elf32_Rel, r_info));
+		uint32_t type = ELF32_R_TYPE(info);
+		uint32_t sym = ELF32_R_SYM(info);
+
+		if (shdr->sh_type == SHT_NOBITS || shdr->sh_size < 4 || offset > shdr->sh_size - 4 ||
+			sym >= obj->num_syms)
+			link_error(obj, "invalid relocation in '%s'", elf_section_name(&obj->elf, index));
+
+		uint8_t *loc = out + offset;
+		uint32_t p = sect->addr + offset;
+		uint32_t s = symbol_addr(obj, sym);
+		uint32_t word = elf_read32(loc);
+		size_t instr = (p - TEXT_BASE) / 4;
+
+		if (type != R_MIPS_NONE && type != R_MIPS_32 && type != R_MIPS_GPREL32 && !is_text)
+			link_error(obj, "instruction relocation in the data section '%s'",
+				elf_section_name(&obj->elf, index));
+
+		switch (type) {
+		case R_MIPS_NONE:
+			break;
+
+		case R_MIPS_32:
+			if (is_text)
+				link_error(obj, "data in the text section '%s' isn't supported",
+					elf_section_name(&obj->elf, index));
+
+			word += s;
+			if (in_text(word))
+				add_data_ref(p - DATA_BASE, word);
+			break;
+
+		case R_MIPS_GPREL32:
+			word += s - gp;
+			break;
+
+		case R_MIPS_26: {
+			uint32_t target = ((word & 0x03FFFFFF) << 2) + s;
+			if (((target ^ (p + 4)) & 0xF0000000) != 0)
+				link_error(obj, "jump target out of range in '%s'", elf_section_name(&obj->elf, index));
+			word = (word & 0xFC000000) | ((target >> 2) & 0x03FFFFFF);
+			break;
+		}
+
+		case R_MIPS_HI16: {
+			uint32_t value = s + (word << 16) + lo16_addend(obj, rel, i, out);
+			word = (word & 0xFFFF0000) | (((value + 0x8000) >> 16) & 0xFFFF);
+			pending[num_pending++] = i;
+			break;
+		}
+
+		case R_MIPS_LO16: {
+			uint32_t value = s + (int16_t)(word & 0xFFFF);
+			word = (word & 0xFFFF0000) | (value & 0xFFFF);
+
+			size_t num_left = 0;
+			for (size_t j = 0; j < num_pending; j++) {
+				const uint8_t *hi = elf_section_data(&obj->elf, rel) + pending[j] * sizeof(Elf32_Rel);
+				uint32_t hi_offset = elf_read32(hi + offsetof(Elf32_Rel, r_offset));
+
+				if (ELF32_R_SYM(elf_read32(hi + offsetof(Elf32_Rel, r_info))) == sym) {
+					last_hi[sym] = (sect->addr + hi_offset - TEXT_BASE) / 4;
+					if (is_text)
+						add_code_pair(last_hi[sym], instr);
+				} else {
+					pending[num_left++] = pending[j];
+				}
+			}
+
+			if (num_left == num_pending && last_hi[sym] != NONE && is_text)
+				add_code_pair(last_hi[sym], instr);
+
+			num_pending = num_left;
+			break;
+		}
+
+		case R_MIPS_PC16: {
+			int32_t target = s + (int32_t)((int16_t)(word & 0xFFFF) * 4) - p;
+			if (target % 4 != 0 || target / 4 < INT16_MIN || target / 4 > INT16_MAX)
+				link_error(obj, "branch target out of range in '%s'", elf_section_name(&obj->elf, index));
+			word = (word & 0xFFFF0000) | ((target / 4) & 0xFFFF);
+			break;
+		}
+
+		case R_MIPS_GPREL16: {
+			int32_t value = s + (int16_t)(word & 0xFFFF) - gp;
+			if (value < INT16_MIN || value > INT16_MAX)
+				link_error(obj, "GP relative address out of range in '%s'", elf_section_name(&obj->elf, index));
+			word = (word & 0xFFFF0000) | (value & 0xFFFF);
+			break;
+		}
+
+		default:
+			fprintf(stderr, "%s: unsupported relocation type %u\n", obj->name, type);
+			exit(EXIT_FAILURE);
+		}
+
+		elf_write32(loc, word);
+	}
+
+	free(pending);
+	free(last_hi);
+}
+
+static void relocate_all(void)
+{
+	code_refs_init(TEXT_BASE, text_size);
+
+	for (size_t o = 0; o < num_objects; o++) {
+		struct object *obj = objects[o];
+
+		for (size_t i = 1; i < obj->elf.ehdr.e_shnum; i++) {
+			if (obj->sects[i].keep && obj->sects[i].rel != 0)
+				relocate(obj, i);
+		}
+	}
+}
+
+/* compresses the code and updates the code addresses in it and the data */
+static uint8_t *convert(uint32_t *out_size)
+{
+	text_base = TEXT_BASE;
+	parse_code(text, text_size);
+
+	for (size_t i = 0; i < num_code_pairs; i++) {
+		add_code_ref(text, code_pairs[i][0], code_pairs[i][1]);
+	}
+
+	for (size_t i = 0; i < num_data_refs; i++) {
+		mark_addr_taken(data_refs[i].addr);
+	}
+
+	/* the symbols to keep can be reached from unknown places */
+	for (size_t k = 0; k < options.num_keep_syms; k++) {
+		struct symbol *s = &symbols[find_symbol(options.keep_syms[k], false)];
+		if (s->obj != NULL && s->shndx < s->obj->elf.ehdr.e_shnum &&
+			s->obj->sects[s->shndx].kind == KIND_TEXT)
+			mark_addr_taken(s->obj->sects[s->shndx].addr + s->value);
+	}
+
+	optimize();
+	update_code_refs();
+
+	for (size_t i = 0; i < num_data_refs; i++) {
+		elf_write32(data + data_refs[i].offset, map_addr(data_refs[i].addr));
+	}
+
+	*out_size = code_size();
+	uint8_t *out = alloc(*out_size, 1);
+	encode_code(out);
+	return out;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 0)
+		program_name = argv[0];
+
+	const char *text_path = NULL;
+	const char *data_path = NULL;
+	const char *entry = "_start";
+	bool uncompressed = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "o:D:e:u" CONV_OPTIONS)) != -1) {
+		switch (opt) {
+		case 'o':
+			text_path = optarg;
+			break;
+
+		case 'D':
+			data_path = optarg;
+			break;
+
+		case 'e':
+			entry = optarg;
+			break;
+
+		case 'u':
+			uncompressed = true;
+			break;
+
+		default:
+			if (!set_conv_option(opt, optarg))
+				usage();
+		}
+	}
+
+	if (optind == argc || text_path == NULL || data_path == NULL)
+		usage();
+
+	size_t num_files = argc - optind;
+	uint8_t **files = alloc(num_files, sizeof(*files));
+	size_t *sizes = alloc(num_files, sizeof(*sizes));
+
+	for (size_t i = 0; i < num_files; i++) {
+		files[i] = map_file(argv[optind + i], &sizes[i]);
+		read_file(argv[optind + i], files[i], sizes[i]);
+	}
+
+	/* the entry point pulls in the start file of an archive */
+	symbols[find_symbol(entry, true)].referenced = true;
+	for (size_t k = 0; k < options.num_keep_syms; k++) {
+		symbols[find_symbol(options.keep_syms[k], true)].referenced = true;
+	}
+	load_members();
+
+	for (size_t k = 0; k < options.num_keep_syms; k++) {
+		struct symbol *s = &symbols[find_symbol(options.keep_syms[k], false)];
+		if (s->shndx == SHN_UNDEF) {
+			fprintf(stderr, "The symbol '%s' to keep isn't defined\n", options.keep_syms[k]);
+			exit(EXIT_FAILURE);
+		}
+		if (s->obj != NULL)
+			keep_section(s->obj, s->shndx);
+	}
+
+	struct symbol *start = &symbols[find_symbol(entry, false)];
+	if (start->shndx == SHN_UNDEF) {
+		fprintf(stderr, "The entry symbol '%s' isn't defined\n", entry);
+		exit(EXIT_FAILURE);
+	}
+
+	if (start->obj == NULL || start->shndx >= start->obj->elf.ehdr.e_shnum ||
+		start->obj->sects[start->shndx].kind != KIND_TEXT || start->value != 0) {
+		fprintf(stderr, "The entry symbol '%s' has to be at the start of a text section\n", entry);
+		exit(EXIT_FAILURE);
+	}
+
+	keep_reached(start->obj, start->shndx);
+	layout(start->obj, start->shndx);
+	relocate_all();
+
+	size_t kept = 0;
+	size_t total = 0;
+	for (size_t o = 0; o < num_objects; o++) {
+		for (size_t i = 1; i < objects[o]->elf.ehdr.e_shnum; i++) {
+			kept += objects[o]->sects[i].keep;
+			total += objects[o]->sects[i].kind != KIND_NONE;
+		}
+	}
+
+	uint32_t out_size = text_size;
+	uint8_t *out = uncompressed ? text : convert(&out_size);
+
+	fprintf(stderr, "linker: %zu objects (%zu from archives), %zu of %zu sections kept, "
+		"text %u -> %u bytes, data %u bytes, %zu code addresses in data\n", num_objects,
+		num_from_archives, kept, total, text_size, out_size, data_size, num_data_refs);
+
+	write_file(text_path, out, out_size);
+	write_file(data_path, data, data_size);
+
+	if (out != text)
+		free(out);
+	free(text);
+	free(data);
+	free(code_pairs);
+	free(data_refs);
+	free_code_refs();
+	free(prog);
+	free(attr);
+	free(index_map);
+
+	for (size_t i = 0; i < num_objects; i++) {
+		if (!objects[i]->from_archive)
+			free_object(objects[i]);
+	}
+
+	for (size_t i = 0; i < num_members; i++) {
+		free_object(members[i]);
+	}
+
+	free(objects);
+	free(members);
+	free(symbols);
+	free(hash_table);
+	free(options.keep_syms);
+
+	for (size_t i = 0; i < num_files; i++) {
+		unmap_file(files[i], sizes[i]);
+	}
+	free(files);
+	free(sizes);
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file icache.c
+ * @date 2026-10-18
+ */
+
+#include "icache.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+static bool is_power_of_2(uint32_t value)
+{
+	return value != 0 && (value & (value - 1)) == 0;
+}
+
+void icache_init(struct icache *cache, uint32_t size, uint32_t line_size)
+{
+	assert(cache != NULL);
+
+	if (!is_power_of_2(line_size) || line_size < 4 || !is_power_of_2(size) || size < line_size) {
+		fprintf(stderr, "invalid cache geometry (%u bytes, %u bytes per line)\n", size, line_size);
+		exit(EXIT_FAILURE);
+	}
+
+	cache->line_size = line_size;
+	cache->num_lines = size / line_size;
+	cache->tags = calloc(cache->num_lines, sizeof(*cache->tags));
+	cache->valid = calloc(cache->num_lines, sizeof(*cache->valid));
+	cache->hits = 0;
+	cache->misses = 0;
+
+	if (cache->tags == NULL || cache->valid == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void icache_destroy(struct icache *cache)
+{
+	assert(cache != NULL);
+
+	free(cache->tags);
+	free(cache->valid);
+	cache->tags = NULL;
+	cache->valid = NULL;
+}
+
+static uint32_t access_line(struct icache *cache, uint32_t line)
+{
+	uint32_t index = line % cache->num_lines;
+	uint32_t tag = line / cache->num_lines;
+
+	if (cache->valid[index] && cache->tags[index] == tag) {
+		cache->hits++;
+		return 0;
+	}
+
+	cache->misses++;
+	cache->valid[index] = true;
+	cache->tags[index] = tag;
+	return cache->line_size;
+}
+
+uint32_t icache_access(struct icache *cache, uint32_t addr, uint32_t size)
+{
+	assert(cache != NULL);
+	assert(size > 0);
+
+	/* in the compressed format a 32-bit instruction can span two lines */
+	uint32_t first = addr / cache->line_size;
+	uint32_t last = (addr + size - 1) / cache->line_size;
+
+	uint32_t refill = access_line(cache, first);
+	if (last != first) {
+		refill += access_line(cache, last);
+	}
+
+	return refill;
+}
+
+bool icache_contains(const struct icache *cache, uint32_t addr)
+{
+	assert(cache != NULL);
+
+	uint32_t line = addr / cache->line_size;
+	uint32_t index = line % cache->num_lines;
+	return cache->valid[index] && cache->tags[index] == line / cache->num_lines;
+}
+
+void icache_fill(struct icache *cache, uint32_t addr, uint32_t size)
+{
+	assert(cache != NULL);
+
+	if (size == 0)
+		return;
+
+	uint32_t last = (addr + size - 1) / cache->line_size;
+	for (uint32_t line = addr / cache->line_size; line <= last; line++) {
+		uint32_t index = line % cache->num_lines;
+		cache->valid[index] = true;
+		cache->tags[index] = line / cache->num_lines;
+	}
+}
@@ -0,0 +1,36 @@
+/**
+ * @file icache.h
+ * @date 2026-10-18
+ * Direct mapped instruction cache model. Only the tags are kept, the
+ * instructions are still read from the instruction memory.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef ICACHE_H
+#define ICACHE_H
+
+#define ICACHE_DEFAULT_LINE_SIZE (16)
+
+struct icache {
+	uint32_t line_size;
+	uint32_t num_lines;
+	uint32_t *tags;
+	bool *valid;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+void icache_init(struct icache *cache, uint32_t size, uint32_t line_size);
+void icache_destroy(struct icache *cache);
+
+/* returns the number of bytes that are refilled from the memory */
+uint32_t icache_access(struct icache *cache, uint32_t addr, uint32_t size);
+/* is the line of addr in the cache? Doesn't count as an access */
+bool icache_contains(const struct icache *cache, uint32_t addr);
+/* puts the lines of the bytes [addr, addr + size) into the cache without
+ * counting them as accesses, e.g. the rest of a decompressed block */
+void icache_fill(struct icache *cache, uint32_t addr, uint32_t size);
+
+#endif
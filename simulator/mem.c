@@ -0,0 +1,113 @@
+/**
+ * @file mem.c
+ * @date 2026-10-18
+ */
+
+#include "mem.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#define MEM_L2_SIZE (1u << MEM_L2_BITS)
+
+void mem_init(struct mem *mem)
+{
+	assert(mem != NULL);
+	memset(mem, 0, sizeof(*mem));
+}
+
+void mem_destroy(struct mem *mem)
+{
+	assert(mem != NULL);
+
+	for (size_t i = 0; i < (1u << MEM_L1_BITS); i++) {
+		if (mem->dir[i] == NULL)
+			continue;
+
+		for (size_t j = 0; j < MEM_L2_SIZE; j++) {
+			free(mem->dir[i][j]);
+		}
+		free(mem->dir[i]);
+	}
+
+	memset(mem, 0, sizeof(*mem));
+}
+
+/* Installs a zeroed block of memory in *slot unless another thread was faster.
+ * Returns the installed block. */
+static void *install(void **slot, size_t size, bool *created)
+{
+	*created = false;
+
+	void *block = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	if (block != NULL)
+		return block;
+
+	void *new_block = calloc(1, size);
+	if (new_block == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (__atomic_compare_exchange_n(slot, &block, new_block, false,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		*created = true;
+		return new_block;
+	}
+
+	free(new_block);
+	return block;
+}
+
+uint8_t *mem_alloc_page(struct mem *mem, uint32_t addr)
+{
+	assert(mem != NULL);
+
+	bool created;
+	uint8_t **table = install((void **)&mem->dir[addr >> (MEM_PAGE_BITS + MEM_L2_BITS)],
+		MEM_L2_SIZE * sizeof(*table), &created);
+
+	uint8_t *page = install((void **)&table[(addr >> MEM_PAGE_BITS) & (MEM_L2_SIZE - 1)],
+		MEM_PAGE_SIZE, &created);
+	if (created) {
+		__atomic_fetch_add(&mem->num_pages, 1, __ATOMIC_RELAXED);
+	}
+
+	return page;
+}
+
+static bool is_zero(const uint8_t *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		if (data[i] != 0)
+			return false;
+	}
+	return true;
+}
+
+void mem_write_block(struct mem *mem, uint32_t addr, const uint8_t *data, size_t size)
+{
+	assert(mem != NULL);
+	assert(data != NULL || size == 0);
+
+	while (size > 0) {
+		uint32_t offset = addr & (MEM_PAGE_SIZE - 1);
+		size_t len = MEM_PAGE_SIZE - offset;
+		if (len > size)
+			len = size;
+
+		/* zero filled parts (e.g. .bss) don't need a page */
+		uint8_t *page = mem_page(mem, addr);
+		if (page != NULL || !is_zero(data, len)) {
+			if (page == NULL)
+				page = mem_alloc_page(mem, addr);
+			memcpy(&page[offset], data, len);
+		}
+
+		addr += len;
+		data += len;
+		size -= len;
+	}
+}
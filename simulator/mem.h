@@ -0,0 +1,120 @@
+/**
+ * @file mem.h
+ * @date 2026-10-18
+ * Sparse, demand-paged memory with a big-endian byte order.
+ *
+ * The 32-bit address space is split into 4 KiB pages that are reached over a
+ * two-level page directory. Pages are only allocated when they are written
+ * with a non-zero value, reading an untouched page returns zeros. Pages may be
+ * allocated concurrently by several threads that share the memory.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef MEM_H
+#define MEM_H
+
+#define MEM_PAGE_BITS (12)
+#define MEM_PAGE_SIZE (1u << MEM_PAGE_BITS)
+#define MEM_L2_BITS   (10)
+#define MEM_L1_BITS   (32 - MEM_PAGE_BITS - MEM_L2_BITS)
+
+struct mem {
+	uint8_t **dir[1u << MEM_L1_BITS];
+	size_t num_pages;
+};
+
+void mem_init(struct mem *mem);
+void mem_destroy(struct mem *mem);
+
+uint8_t *mem_alloc_page(struct mem *mem, uint32_t addr);
+void mem_write_block(struct mem *mem, uint32_t addr, const uint8_t *data, size_t size);
+
+/* returns the page that contains addr or NULL if it was never written */
+static inline uint8_t *mem_page(const struct mem *mem, uint32_t addr)
+{
+	uint8_t **table = __atomic_load_n(&mem->dir[addr >> (MEM_PAGE_BITS + MEM_L2_BITS)],
+		__ATOMIC_ACQUIRE);
+	if (table == NULL)
+		return NULL;
+	return __atomic_load_n(&table[(addr >> MEM_PAGE_BITS) & ((1u << MEM_L2_BITS) - 1)],
+		__ATOMIC_ACQUIRE);
+}
+
+static inline uint8_t mem_read8(const struct mem *mem, uint32_t addr)
+{
+	uint8_t *page = mem_page(mem, addr);
+	if (page == NULL)
+		return 0;
+	return page[addr & (MEM_PAGE_SIZE - 1)];
+}
+
+static inline void mem_write8(struct mem *mem, uint32_t addr, uint8_t value)
+{
+	uint8_t *page = mem_page(mem, addr);
+	if (page == NULL) {
+		if (value == 0)
+			return;
+		page = mem_alloc_page(mem, addr);
+	}
+	page[addr & (MEM_PAGE_SIZE - 1)] = value;
+}
+
+static inline uint16_t mem_read16(const struct mem *mem, uint32_t addr)
+{
+	uint32_t offset = addr & (MEM_PAGE_SIZE - 1);
+	if (offset > MEM_PAGE_SIZE - 2) {
+		/* crosses a page boundary */
+		return (mem_read8(mem, addr) << 8) | mem_read8(mem, addr + 1);
+	}
+
+	uint8_t *page = mem_page(mem, addr);
+	if (page == NULL)
+		return 0;
+	return (page[offset] << 8) | page[offset + 1];
+}
+
+static inline uint32_t mem_read32(const struct mem *mem, uint32_t addr)
+{
+	uint32_t offset = addr & (MEM_PAGE_SIZE - 1);
+	if (offset > MEM_PAGE_SIZE - 4) {
+		/* crosses a page boundary */
+		return ((uint32_t)mem_read16(mem, addr) << 16) | mem_read16(mem, addr + 2);
+	}
+
+	uint8_t *page = mem_page(mem, addr);
+	if (page == NULL)
+		return 0;
+
+	uint32_t value = page[offset];
+	value = (value << 8) | page[offset + 1];
+	value = (value << 8) | page[offset + 2];
+	value = (value << 8) | page[offset + 3];
+	return value;
+}
+
+static inline void mem_write16(struct mem *mem, uint32_t addr, uint16_t value)
+{
+	mem_write8(mem, addr, value >> 8);
+	mem_write8(mem, addr + 1, value & 0xFF);
+}
+
+static inline void mem_write32(struct mem *mem, uint32_t addr, uint32_t value)
+{
+	uint32_t offset = addr & (MEM_PAGE_SIZE - 1);
+	uint8_t *page = mem_page(mem, addr);
+
+	if (page == NULL || offset > MEM_PAGE_SIZE - 4) {
+		mem_write16(mem, addr, value >> 16);
+		mem_write16(mem, addr + 2, value & 0xFFFF);
+		return;
+	}
+
+	page[offset + 0] = (value >> 24) & 0xFF;
+	page[offset + 1] = (value >> 16) & 0xFF;
+	page[offset + 2] = (value >> 8) & 0xFF;
+	page[offset + 3] = value & 0xFF;
+}
+
+#endif
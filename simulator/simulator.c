@@ -13,40 +13,90 @@
 #include <string.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <stdarg.h>
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
 #include "../common/instr.h"
 #include "../common/v2_instr.h"
+#include "../common/v3_instr.h"
+#include "../common/dict_instr.h"
+#include "../common/block_image.h"
 #include "../common/print_instr.h"
+#include "mem.h"
+#include "icache.h"
 
 #define PC_START (0x40000000)
 #define DEFAULT_NUM_CYCLES (256)
 #define DEFAULT_IMEM_SIZE (16 * 1024)
 #define DEFAULT_DMEM_SIZE (16 * 1024)
+#define DEFAULT_BUS_WIDTH (4)
+#define DEFAULT_DICT_LATENCY (1)
+#define DEFAULT_BLOCK_THROUGHPUT (4)
+#define MAX_CORES (64)
 
 #define UART_STATUS (0xFFFFFFF8)
 #define UART_DATA (0xFFFFFFFC)
 
+/* memory mapped I/O lies above the data memory */
+#define MMIO_START (0xFFFFFFF0)
+
+/* COP0 registers */
+#define COP0_BADVADDR (8)
+#define COP0_STATUS (12)
+#define COP0_CAUSE (13)
+#define COP0_EPC (14)
+#define COP0_PRID (15)
+
+/* exception codes in the Cause register */
+#define EXC_OV (12)
+
+#define CAUSE_BD (0x80000000)
+#define CAUSE_EXC_MASK (0x7C)
+
 static char *program_name = "simulator";
 static bool debug = false;
-
-static uint64_t total_bandwidth = 0;
+static bool exc_vector_set = false;
+static uint32_t exc_vector = 0;
+/* cycles the fetch stage waits for an entry of the dictionary */
+static uint32_t dict_latency = DEFAULT_DICT_LATENCY;
+/* bytes per cycle that the decompressor of a block image writes into the cache */
+static uint32_t block_throughput = DEFAULT_BLOCK_THROUGHPUT;
 
 static void usage(void)
 {
-	fprintf(stderr, "Usage: %s [-i IMEM_SIZE] [-d DMEM_SIZE] [-n CYCLES] [-t TRACE_FILE] [-cxbr] BIN-FILE [DATA-FILE]\n", program_name);
+	fprintf(stderr, "Usage: %s [-i IMEM_SIZE] [-d DMEM_SIZE] [-n CYCLES] [-t TRACE_FILE] [-e VECTOR] [-l COMP-FILE[,COMP-DATA-FILE]] [-M MAP-FILE] [-P PROFILE] [-N CORES] [-C ICACHE[,LINE]] [-w BUS_WIDTH] [-X DICT[,LATENCY]] [-Z IMAGE[,THROUGHPUT]] [-cxbrfT3] BIN-FILE [DATA-FILE]\n", program_name);
 	fprintf(stderr, "\t-i\tSize in kiB of the instruction memory\n");
-	fprintf(stderr, "\t-d\tSize in kiB of the data memory\n");
+	fprintf(stderr, "\t-d\tSize in kiB of the data memory; 0: everything below the memory mapped I/O\n");
 	fprintf(stderr, "\t-n\tNumber of cycles to execute. Default: %d; 0: run forever until hitting an BREAK or SYSCALL\n",
 		DEFAULT_NUM_CYCLES);
 	fprintf(stderr, "\t-c\tUse compressed instruction format\n");
+	fprintf(stderr, "\t-3\tUse the experimental v3 compressed instruction format\n");
 	fprintf(stderr, "\t-x\tPrints every executed instruction\n");
 	fprintf(stderr, "\t-b\tPrints the total dynamic bandwidth of the instruction stream\n");
 	fprintf(stderr, "\t-t\tSave trace information to file\n");
+	fprintf(stderr, "\t-P\tSave the execution and taken count of every executed instruction to file\n");
 	fprintf(stderr, "\t-r\tPrint the register file to stderr at the end of execution\n");
+	fprintf(stderr, "\t-e\tAddress of the exception vector. Without it an exception stops the simulation\n");
+	fprintf(stderr, "\t-f\tStop at the first access outside of the data memory\n");
+	fprintf(stderr, "\t-l\tRun the converted program COMP-FILE with the data COMP-DATA-FILE (default: DATA-FILE)\n"
+		"\t\tin lockstep with BIN-FILE and stop at the first difference of the live registers or stores\n");
+	fprintf(stderr, "\t-M\tAddress map of the converter (-M) for the lockstep mode. Without it the converted\n"
+		"\t\tprogram must have the instructions of BIN-FILE in the same order. Programs with\n"
+		"\t\trenamed registers (converter -r) can't be compared\n");
+	fprintf(stderr, "\t-N\tNumber of cores that share the memories. The core number is in the PRId register\n");
+	fprintf(stderr, "\t-T\tRun every core in its own thread instead of interleaving them\n");
+	fprintf(stderr, "\t-C\tSize in kiB and line size in bytes (default: %d) of the instruction cache of each core\n",
+		ICACHE_DEFAULT_LINE_SIZE);
+	fprintf(stderr, "\t-w\tWidth in bytes of the shared instruction bus. Default: %d\n", DEFAULT_BUS_WIDTH);
+	fprintf(stderr, "\t-X\tUse the dictionary encoding with the dictionary of the converter (-X) and the\n"
+		"\t\tcycles of a lookup in the decompressing fetch stage (default: %d)\n", DEFAULT_DICT_LATENCY);
+	fprintf(stderr, "\t-Z\tRefill the instruction cache (-C) with the blocks of the block image of BIN-FILE\n"
+		"\t\tfrom blockpack, decompressed with THROUGHPUT bytes per cycle (default: %d)\n",
+		DEFAULT_BLOCK_THROUGHPUT);
 	exit(EXIT_FAILURE);
 }
 
@@ -98,49 +148,271 @@ static uint64_t str_to_uint64(const char *str)
 	return (uint64_t)res;
 }
 
-uint32_t u8to32(const uint8_t from[4]) {
-	uint32_t to = 0;
-	for (int i = 0; i < 4; i++) {
-		to = (to << 8) | from[i];
+static uint32_t str_to_addr(const char *str)
+{
+	char *endptr = NULL;
+	errno = 0;
+	unsigned long res = strtoul(str, &endptr, 0);
+
+	if (endptr == str || *endptr != '\0') {
+		fprintf(stderr, "invalid address '%s'\n", str);
+		usage();
+	}
+
+	if (errno != 0 || res > UINT32_MAX) {
+		fprintf(stderr, "address is too high\n");
+		exit(EXIT_FAILURE);
 	}
-	return to;
-}
 
-uint16_t u8to16(const uint8_t from[2]) {
-	uint32_t to = from[0];
-	to = (to << 8) | from[1];
-	return to;
+	return (uint32_t)res;
 }
 
-void load_file_bin(const char *path, uint8_t *data, uint32_t size)
+/* Loads the file to the address addr, the file must end below limit. Returns
+ * the size of the file. */
+uint32_t load_file_bin(const char *path, struct mem *mem, uint32_t addr, uint32_t limit)
 {
 	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Couldn't open file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
 	
 	struct stat stat;
 	fstat(fd, &stat);
 
-	if (stat.st_size > size) {
+	if (addr > limit || (uint64_t)stat.st_size > limit - addr) {
 		fprintf(stderr, "Not enough memory\n");
 		exit(EXIT_FAILURE);
 	}
 
-	read(fd, data, stat.st_size);
+	uint8_t buffer[MEM_PAGE_SIZE];
+	ssize_t len;
+	while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+		mem_write_block(mem, addr, buffer, len);
+		addr += len;
+	}
 	close(fd);
+
+	return stat.st_size;
 }
 
+struct store {
+	uint32_t addr;
+	uint32_t value;
+	uint8_t size;
+};
+
+/* the stores of the lockstep mode since the last comparison */
+struct store_log {
+	struct store *data;
+	size_t len;
+	size_t cap;
+};
+
+/* bytes that were read from the UART */
+struct uart_log {
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+};
+
 struct simulator {
 	uint32_t cur_pc;
 	uint32_t jump_addr;
 	bool jump;
+	/* the last instruction was a branch or jump, taken or not, so the next
+	 * one is in its delay slot */
+	bool branch;
 	uint32_t reg[32];
 	uint32_t hi;
 	uint32_t lo;
-	uint8_t *dmem;
-	uint8_t *imem;
+	uint32_t cop0[32];
+	struct mem *dmem; /* shared by all cores */
+	struct mem *imem;
 	uint32_t dmem_size;
 	uint32_t imem_size;
+	uint32_t pc; /* address of the executed instruction */
+	uint64_t step; /* number of executed instructions */
+	bool stop;
+	bool v2;
+	int trace_fd;
+	uint64_t bandwidth;
+	uint32_t branch_pc;
+	struct instr instr; /* the executed instruction */
+	struct store_log *stores; /* only in lockstep mode */
+	struct uart_log *uart_in;
+	size_t uart_pos;
+	/* the converted program of the lockstep mode: reads from uart_in, doesn't
+	 * print anything and leaves the accesses outside of the memory to the
+	 * original program */
+	bool shadow;
+	uint32_t exc_vector;
+	bool is_eof;
+	struct icache *icache;
+	uint32_t fetch_bytes; /* bytes the last instruction fetched from the memory */
+	uint64_t bus_bytes;
+	uint64_t stall_cycles;
+	uint32_t lookup_cycles; /* cycles the last instruction waited for the dictionary */
+	uint64_t dict_lookups;
+	const struct block_image *blocks; /* the instruction memory as stored, shared by all cores */
+	uint32_t refill_cycles; /* cycles the last instruction waited for the decompressor */
+	uint64_t block_refills;
+	uint64_t decomp_cycles;
+	bool running;
+	uint64_t ready; /* cycle of the next instruction in multicore_run */
+	/* profile, one counter per halfword of the instruction memory */
+	uint64_t *exec_count;
+	uint64_t *taken_count;
+};
+
+/* Accesses outside of the data memory are collected per instruction and
+ * address region instead of being reported one by one. */
+#define FAULT_REGION_BITS (12)
+#define FAULT_TABLE_INIT_SIZE (64)
+
+struct mem_fault {
+	uint32_t pc;
+	uint32_t region;
+	bool write;
+	bool used;
+	uint32_t min_addr;
+	uint32_t max_addr;
+	uint64_t count;
+	uint64_t first;
+	uint64_t last;
 };
 
+static struct mem_fault *fault_table = NULL;
+static size_t fault_table_size = 0;
+static size_t num_faults = 0;
+static bool stop_on_fault = false;
+static pthread_mutex_t fault_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t fault_hash(uint32_t pc, uint32_t region, bool write)
+{
+	uint32_t h = pc * 0x9E3779B1u;
+	h ^= (region + (write ? 0x85EBCA6Bu : 0)) * 0xC2B2AE35u;
+	return h ^ (h >> 16);
+}
+
+static struct mem_fault *find_fault(uint32_t pc, uint32_t region, bool write)
+{
+	size_t mask = fault_table_size - 1;
+	size_t i = fault_hash(pc, region, write) & mask;
+
+	while (fault_table[i].used) {
+		struct mem_fault *f = &fault_table[i];
+		if (f->pc == pc && f->region == region && f->write == write)
+			return f;
+		i = (i + 1) & mask;
+	}
+
+	return &fault_table[i];
+}
+
+static void grow_fault_table(void)
+{
+	struct mem_fault *old = fault_table;
+	size_t old_size = fault_table_size;
+
+	fault_table_size = old_size == 0 ? FAULT_TABLE_INIT_SIZE : 2 * old_size;
+	fault_table = calloc(fault_table_size, sizeof(*fault_table));
+	if (fault_table == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = 0; i < old_size; i++) {
+		if (!old[i].used)
+			continue;
+		*find_fault(old[i].pc, old[i].region, old[i].write) = old[i];
+	}
+
+	free(old);
+}
+
+static void record_fault(struct simulator *sim, uint32_t addr, bool write)
+{
+	if (sim->shadow) {
+		sim->stop |= stop_on_fault;
+		return;
+	}
+
+	pthread_mutex_lock(&fault_lock);
+
+	if (2 * (num_faults + 1) > fault_table_size) {
+		grow_fault_table();
+	}
+
+	uint32_t region = addr >> FAULT_REGION_BITS;
+	struct mem_fault *f = find_fault(sim->pc, region, write);
+
+	if (!f->used) {
+		*f = (struct mem_fault) {
+			.pc = sim->pc,
+			.region = region,
+			.write = write,
+			.used = true,
+			.min_addr = addr,
+			.max_addr = addr,
+			.first = sim->step
+		};
+		num_faults++;
+	}
+
+	if (addr < f->min_addr)
+		f->min_addr = addr;
+	if (addr > f->max_addr)
+		f->max_addr = addr;
+	f->count++;
+	f->last = sim->step;
+
+	if (stop_on_fault) {
+		sim->stop = true;
+	}
+
+	pthread_mutex_unlock(&fault_lock);
+}
+
+static int cmp_fault(const void *left, const void *right)
+{
+	const struct mem_fault *l = left;
+	const struct mem_fault *r = right;
+
+	if (l->count != r->count)
+		return l->count > r->count ? -1 : 1;
+	if (l->first != r->first)
+		return l->first < r->first ? -1 : 1;
+	return 0;
+}
+
+static void print_faults(uint32_t dmem_size)
+{
+	if (num_faults == 0)
+		return;
+
+	/* compact the used entries to the front and sort them by frequency */
+	size_t n = 0;
+	uint64_t total = 0;
+	for (size_t i = 0; i < fault_table_size; i++) {
+		if (fault_table[i].used) {
+			total += fault_table[i].count;
+			fault_table[n++] = fault_table[i];
+		}
+	}
+	qsort(fault_table, n, sizeof(*fault_table), cmp_fault);
+
+	fprintf(stderr, "Warning: %" PRIu64 " accesses outside of the data memory (max. addr. 0x%X)\n",
+		total, dmem_size);
+	fprintf(stderr, "      pc | access | address range         |      count |      first |       last\n");
+	for (size_t i = 0; i < n; i++) {
+		struct mem_fault *f = &fault_table[i];
+		fprintf(stderr, "%8.8X | %-6s | %8.8X - %8.8X | %10" PRIu64 " | %10" PRIu64 " | %10" PRIu64 "\n",
+			f->pc, f->write ? "write" : "read", f->min_addr, f->max_addr,
+			f->count, f->first, f->last);
+	}
+}
+
 uint32_t sll(uint32_t rt, uint32_t rs)
 {
 	return rt << (rs % 32);
@@ -250,7 +522,72 @@ uint32_t sign_h(uint16_t half)
 	return 0xFFFF0000 | half;
 }
 
-static bool is_eof = false;
+/* Returns the next byte from the UART. The end of the input is signaled with
+ * a 0 and all further reads return 1. */
+static uint8_t uart_read(struct simulator *sim)
+{
+	struct uart_log *log = sim->uart_in;
+
+	if (sim->shadow) {
+		/* lockstep mode: take what the reference core read */
+		if (sim->uart_pos < log->len)
+			return log->data[sim->uart_pos++];
+		return 1;
+	}
+
+	uint8_t value;
+	if (sim->is_eof) {
+		value = 1;
+	} else {
+		int c = getchar();
+		if (c == EOF) {
+			sim->is_eof = true;
+			value = 0;
+		} else {
+			value = c;
+		}
+	}
+
+	if (log != NULL) {
+		if (log->len == log->cap) {
+			log->cap = log->cap == 0 ? 256 : 2 * log->cap;
+			log->data = realloc(log->data, log->cap);
+			if (log->data == NULL) {
+				fprintf(stderr, "Out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		log->data[log->len++] = value;
+	}
+
+	return value;
+}
+
+static void uart_write(struct simulator *sim, uint32_t value)
+{
+	if (sim->shadow)
+		return;
+
+	printf("%c", value & 0xFF);
+	fflush(stdout);
+}
+
+static void log_store(struct simulator *sim, uint32_t addr, uint32_t value, uint8_t size)
+{
+	struct store_log *log = sim->stores;
+	if (log == NULL)
+		return;
+
+	if (log->len == log->cap) {
+		log->cap = log->cap == 0 ? 16 : 2 * log->cap;
+		log->data = realloc(log->data, log->cap * sizeof(*log->data));
+		if (log->data == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	log->data[log->len++] = (struct store) {addr, value, size};
+}
 
 uint32_t lb(struct simulator *sim, uint32_t addr)
 {
@@ -259,25 +596,16 @@ uint32_t lb(struct simulator *sim, uint32_t addr)
 	}
 
 	if (addr == UART_DATA) {
-		if (is_eof)
-			return 1;
-
-		int c = getchar();
-		if (c == EOF) {
-			is_eof = true;
-			return 0;
-		}
-		return sign_b(c);
+		return sign_b(uart_read(sim));
 	}
 
 	/* loads outside the valid range are ignored and read a zero value */
 	if (addr >= sim->dmem_size) {
-		fprintf(stderr, "Warning: Reading from address 0x%X (max. addr. 0x%X)\n", 
-				addr, sim->dmem_size);
+		record_fault(sim, addr, false);
 		return 0;
 	}
 
-	return sign_b(sim->dmem[addr]);
+	return sign_b(mem_read8(sim->dmem, addr));
 }
 
 uint32_t lbu(struct simulator *sim, uint32_t addr)
@@ -287,25 +615,16 @@ uint32_t lbu(struct simulator *sim, uint32_t addr)
 	}
 
 	if (addr == UART_DATA) {
-		if (is_eof)
-			return 1;
-
-		int c = getchar();
-		if (c == EOF) {
-			is_eof = true;
-			return 0;
-		}
-		return c;
+		return uart_read(sim);
 	}
 
 	/* loads outside the valid range are ignored and read a zero value */
 	if (addr >= sim->dmem_size) {
-		fprintf(stderr, "Warning: Reading from address 0x%X (max. addr. 0x%X)\n", 
-				addr, sim->dmem_size);
+		record_fault(sim, addr, false);
 		return 0;
 	}
 
-	return sim->dmem[addr];
+	return mem_read8(sim->dmem, addr);
 }
 
 uint32_t lh(struct simulator *sim, uint32_t addr)
@@ -315,28 +634,16 @@ uint32_t lh(struct simulator *sim, uint32_t addr)
 	}
 
 	if (addr == UART_DATA) {
-		if (is_eof)
-			return 1;
-
-		int c = getchar();
-		if (c == EOF) {
-			is_eof = true;
-			return 0;
-		}
-		return c;
+		return uart_read(sim);
 	}
 
 	/* loads outside the valid range are ignored and read a zero value */
 	if (addr >= sim->dmem_size) {
-		fprintf(stderr, "Warning: Reading from address 0x%X (max. addr. 0x%X)\n", 
-				addr, sim->dmem_size);
+		record_fault(sim, addr, false);
 		return 0;
 	}
 
-	uint16_t b0 = sim->dmem[addr + 1];
-	uint16_t b1 = sim->dmem[addr];
-	b0 |= b1 << 8;
-	return sign_h(b0);
+	return sign_h(mem_read16(sim->dmem, addr));
 }
 
 uint32_t lhu(struct simulator *sim, uint32_t addr)
@@ -346,28 +653,16 @@ uint32_t lhu(struct simulator *sim, uint32_t addr)
 	}
 
 	if (addr == UART_DATA) {
-		if (is_eof)
-			return 1;
-
-		int c = getchar();
-		if (c == EOF) {
-			is_eof = true;
-			return 0;
-		}
-		return c;
+		return uart_read(sim);
 	}
 
 	/* loads outside the valid range are ignored and read a zero value */
 	if (addr >= sim->dmem_size) {
-		fprintf(stderr, "Warning: Reading from address 0x%X (max. addr. 0x%X)\n", 
-				addr, sim->dmem_size);
+		record_fault(sim, addr, false);
 		return 0;
 	}
 	
-	uint16_t b0 = sim->dmem[addr + 1];
-	uint16_t b1 = sim->dmem[addr];
-	b0 |= b1 << 8;
-	return b0;
+	return mem_read16(sim->dmem, addr);
 }
 
 uint32_t lw(struct simulator *sim, uint32_t addr)
@@ -377,38 +672,24 @@ uint32_t lw(struct simulator *sim, uint32_t addr)
 	}
 
 	if (addr == UART_DATA) {
-		if (is_eof)
-			return 1;
-
-		int c = getchar();
-		if (c == EOF) {
-			is_eof = true;
-			return 0;
-		}
-		return c;
+		return uart_read(sim);
 	}
 
 	/* loads outside the valid range are ignored and read a zero value */
 	if (addr >= sim->dmem_size) {
-		fprintf(stderr, "Warning: Reading from address 0x%X (max. addr. 0x%X)\n", 
-				addr, sim->dmem_size);
+		record_fault(sim, addr, false);
 		return 0;
 	}
 	
-	uint32_t b0 = sim->dmem[addr];
-	uint32_t b1 = sim->dmem[addr + 1];
-	uint32_t b2 = sim->dmem[addr + 2];
-	uint32_t b3 = sim->dmem[addr + 3];
-	b1 |= b0 << 8;
-	b3 |= b2 << 8;
-	return (b1 << 16) | b3;
+	return mem_read32(sim->dmem, addr);
 }
 
 void sb(struct simulator *sim, uint32_t addr, uint32_t value)
 {
+	log_store(sim, addr, value & 0xFF, 1);
+
 	if (addr == UART_DATA) {
-		printf("%c", value & 0xFF);
-		fflush(stdout);
+		uart_write(sim, value);
 		return;
 	}
 
@@ -416,20 +697,21 @@ void sb(struct simulator *sim, uint32_t addr, uint32_t value)
 		return; /* ignored */
 	}
 
+	/* stores outside the valid range are ignored */
 	if (addr >= sim->dmem_size) {
-		fprintf(stderr, "Warning: Writing to address 0x%X (max. addr. 0x%X)\n", 
-				addr, sim->dmem_size);
+		record_fault(sim, addr, true);
 		return;
 	}
 	
-	sim->dmem[addr] = value & 0xFF;
+	mem_write8(sim->dmem, addr, value & 0xFF);
 }
 
 void sh(struct simulator *sim, uint32_t addr, uint32_t value)
 {
+	log_store(sim, addr, value & 0xFFFF, 2);
+
 	if (addr == UART_DATA) {
-		printf("%c", value & 0xFF);
-		fflush(stdout);
+		uart_write(sim, value);
 		return;
 	}
 
@@ -437,21 +719,21 @@ void sh(struct simulator *sim, uint32_t addr, uint32_t value)
 		return; /* ignored */
 	}
 
+	/* stores outside the valid range are ignored */
 	if (addr >= sim->dmem_size) {
-		fprintf(stderr, "Warning: Writing to address 0x%X (max. addr. 0x%X)\n", 
-				addr, sim->dmem_size);
+		record_fault(sim, addr, true);
 		return;
 	}
 	
-	sim->dmem[addr + 1] = value & 0xFF;
-	sim->dmem[addr + 0] = (value >> 8) & 0xFF;
+	mem_write16(sim->dmem, addr, value & 0xFFFF);
 }
 
 void sw(struct simulator *sim, uint32_t addr, uint32_t value)
 {
+	log_store(sim, addr, value, 4);
+
 	if (addr == UART_DATA) {
-		printf("%c", value & 0xFF);
-		fflush(stdout);
+		uart_write(sim, value);
 		return;
 	}
 
@@ -459,350 +741,1029 @@ void sw(struct simulator *sim, uint32_t addr, uint32_t value)
 		return; /* ignored */
 	}
 
+	/* stores outside the valid range are ignored */
 	if (addr >= sim->dmem_size) {
-		fprintf(stderr, "Warning: Writing to address 0x%X (max. addr. 0x%X)\n", 
-				addr, sim->dmem_size);
+		record_fault(sim, addr, true);
 		return;
 	}
 
-	sim->dmem[addr + 3] = value & 0xFF;
-	sim->dmem[addr + 2] = (value >> 8) & 0xFF;
-	sim->dmem[addr + 1] = (value >> 16) & 0xFF;
-	sim->dmem[addr + 0] = (value >> 24) & 0xFF;
+	mem_write32(sim->dmem, addr, value);
 }
 
-void simulator_run(struct simulator *sim, uint64_t num_steps, bool v2, int trace_fd)
+/* Signed overflow of rs + rt and rs - rt as defined for ADD, ADDI and SUB */
+static bool add_overflows(uint32_t rs, uint32_t rt, uint32_t res)
 {
+	return ((rs ^ res) & (rt ^ res) & 0x80000000) != 0;
+}
+
+static bool sub_overflows(uint32_t rs, uint32_t rt, uint32_t res)
+{
+	return ((rs ^ rt) & (rs ^ res) & 0x80000000) != 0;
+}
+
+/* Enters the exception vector like a MIPS-I core: the KU/IE stack in the
+ * Status register is pushed, Cause and EPC are updated. If the instruction is
+ * in a delay slot, then EPC points to the branch and the BD bit is set.
+ * Returns false if no exception vector is configured. */
+static bool raise_exception(struct simulator *sim, uint8_t exc_code, uint32_t pc, 
+	bool delay_slot, uint32_t branch_pc)
+{
+	uint32_t status = sim->cop0[COP0_STATUS];
+	sim->cop0[COP0_STATUS] = (status & ~0x3F) | ((status << 2) & 0x3C);
+
+	uint32_t cause = sim->cop0[COP0_CAUSE] & ~(CAUSE_BD | CAUSE_EXC_MASK);
+	cause |= ((uint32_t)exc_code << 2) & CAUSE_EXC_MASK;
+	if (delay_slot) {
+		cause |= CAUSE_BD;
+		sim->cop0[COP0_EPC] = branch_pc;
+	} else {
+		sim->cop0[COP0_EPC] = pc;
+	}
+	sim->cop0[COP0_CAUSE] = cause;
+
+	/* a pending branch is discarded, the handler restarts at EPC */
+	sim->jump = false;
+	sim->branch = false;
+
+	if (!exc_vector_set) {
+		fprintf(stderr, "Unhandled exception (Cause: 0x%8.8X, EPC: 0x%8.8X)\n",
+			sim->cop0[COP0_CAUSE], sim->cop0[COP0_EPC]);
+		return false;
+	}
+
+	sim->cur_pc = sim->exc_vector;
+	return true;
+}
+
+static void mtc0(struct simulator *sim, uint8_t reg, uint32_t value)
+{
+	switch (reg) {
+	case COP0_STATUS:
+	case COP0_EPC:
+		sim->cop0[reg] = value;
+		break;
+
+	case COP0_CAUSE:
+		/* only the software interrupt bits are writable */
+		sim->cop0[reg] = (sim->cop0[reg] & ~0x300) | (value & 0x300);
+		break;
+
+	default:
+		/* read-only or not implemented */
+		break;
+	}
+}
+
+/* Pops the KU/IE stack that raise_exception pushed, the old pair stays */
+static void rfe(struct simulator *sim)
+{
+	uint32_t status = sim->cop0[COP0_STATUS];
+	sim->cop0[COP0_STATUS] = (status & ~0x0F) | ((status >> 2) & 0x0F);
+}
+
+/*
+ * A miss refills the cache with the whole block of the missing line. The
+ * block is read compressed from the memory and decompressed into the
+ * cache after it arrived. Returns the bytes that are read from the memory.
+ */
+static uint32_t refill_blocks(struct simulator *sim, uint32_t addr, uint32_t size)
+{
+	const struct block_image *image = sim->blocks;
+	uint32_t last = addr + size - 1;
+	bool missing[2] = {!icache_contains(sim->icache, addr), !icache_contains(sim->icache, last)};
+	uint32_t blocks[2] = {addr / image->block_size, last / image->block_size};
+
+	icache_access(sim->icache, addr, size);
+
+	uint32_t bytes = 0;
+	sim->refill_cycles = 0;
+	for (int i = 0; i < 2; i++) {
+		uint32_t block = blocks[i];
+		if (!missing[i] || (i == 1 && block == blocks[0] && missing[0]))
+			continue;
+
+		/* e.g. the second half of a 32-bit fetch at the end of the image */
+		if (block >= image->num_blocks) {
+			bytes += sim->icache->line_size;
+			continue;
+		}
+
+		uint32_t len = block_length(image, block);
+		bytes += block_comp_size(image, block);
+		if (!block_is_raw(image, block))
+			sim->refill_cycles += (len + block_throughput - 1) / block_throughput;
+		sim->block_refills++;
+		icache_fill(sim->icache, block * image->block_size, len);
+	}
+
+	sim->decomp_cycles += sim->refill_cycles;
+	return bytes;
+}
+
+/* Executes a single instruction. Returns false if the simulation must stop. */
+static bool simulator_step(struct simulator *sim)
+{
+	bool v2 = sim->v2;
 	bool force_stop = false;
 
-	for (uint64_t i = 0; (i < num_steps || num_steps == 0) && !force_stop; i++) {
-		uint32_t pc = sim->cur_pc;
-		if (pc < PC_START) {
-			fprintf(stdout, "Invalid pc(0x%X). Must be >= 0x%X\n", pc, PC_START);
-			return;
-		}
-		uint32_t instr_code = u8to32(&sim->imem[pc - PC_START]);
-		struct instr instr;
-		memset(&instr, 0, sizeof(instr));
-
-		/* cur_pc points to the next instruction */
-		if (sim->jump) {
-			sim->cur_pc = sim->jump_addr;
-			sim->jump = false;
-			if (v2) {
-				parse_instr_v2(instr_code, &instr);
-			} else {
-				parse_instr(instr_code, &instr);
-			}
+	uint32_t pc = sim->cur_pc;
+	sim->pc = pc;
+	if (pc < PC_START) {
+		fprintf(stdout, "Invalid pc(0x%X). Must be >= 0x%X\n", pc, PC_START);
+		return false;
+	}
+	if (pc - PC_START >= sim->imem_size) {
+		fprintf(stdout, "Invalid pc(0x%X). Must be < 0x%X\n", pc, PC_START + sim->imem_size);
+		return false;
+	}
+	uint32_t instr_code = mem_read32(sim->imem, pc - PC_START);
+	struct instr instr;
+	memset(&instr, 0, sizeof(instr));
+
+	bool delay_slot = sim->branch;
+
+	/* cur_pc points to the next instruction */
+	if (sim->jump) {
+		sim->cur_pc = sim->jump_addr;
+		sim->jump = false;
+		if (v2) {
+			parse_instr_v2(instr_code, &instr);
 		} else {
-			if (v2) {
-				if (instr_code < 0x80000000) {
-					/* long instruction */
-					sim->cur_pc += 4;
-				} else {
-					sim->cur_pc += 2;
-				}
-				parse_instr_v2(instr_code, &instr);
-			} else {
+			parse_instr(instr_code, &instr);
+		}
+	} else {
+		if (v2) {
+			if (instr_code < 0x80000000) {
+				/* long instruction */
 				sim->cur_pc += 4;
-				parse_instr(instr_code, &instr);
+			} else {
+				sim->cur_pc += 2;
 			}
+			parse_instr_v2(instr_code, &instr);
+		} else {
+			sim->cur_pc += 4;
+			parse_instr(instr_code, &instr);
 		}
+	}
+
+	int size_next_instr = 4; 
+	if (v2 && mem_read8(sim->imem, sim->cur_pc - PC_START) >= 0x80) {
+		size_next_instr = 2;
+	}
 
-		int size_next_instr = 4; 
-		if (v2 && sim->imem[sim->cur_pc - PC_START] >= 0x80) {
-			size_next_instr = 2;
+	if (sim->trace_fd >= 0) {
+		uint8_t bytes[4] = {
+			instr_code >> 24, (instr_code >> 16) & 0xFF,
+			(instr_code >> 8) & 0xFF, instr_code & 0xFF
+		};
+		if (v2 && instr_code >= 0x80000000) {
+			write(sim->trace_fd, bytes, sizeof(uint16_t));
+		} else {
+			write(sim->trace_fd, bytes, sizeof(uint32_t));
 		}
+	}
 
-		if (trace_fd >= 0) {
-			if (v2 && instr_code >= 0x80000000) {
-				write(trace_fd, &sim->imem[pc - PC_START], sizeof(uint16_t));
-			} else {
-				write(trace_fd, &sim->imem[pc - PC_START], sizeof(uint32_t));
-			}
+	assert(instr.op < NOP);
+
+	if (debug) {
+		//fprintf(stdout, "%8.8X: (%8.8X) ", pc, instr_code);
+		struct instr i2 = instr;
+		conv_to_pseudo(&i2);
+		print_instr(&i2); 
+	}
+
+	if (sim->exec_count != NULL) {
+		sim->exec_count[(pc - PC_START) / 2]++;
+	}
+
+	uint32_t size = instr.compressed ? 2 : 4;
+	sim->bandwidth += size;
+	if (sim->icache != NULL && sim->blocks != NULL) {
+		sim->fetch_bytes = refill_blocks(sim, pc - PC_START, size);
+	} else if (sim->icache != NULL) {
+		sim->fetch_bytes = icache_access(sim->icache, pc - PC_START, size);
+	} else {
+		sim->fetch_bytes = size;
+	}
+	sim->bus_bytes += sim->fetch_bytes;
+
+	/* the fetch stage expands a small instruction with the dictionary */
+	sim->lookup_cycles = 0;
+	if (instr.compressed && dict_active()) {
+		sim->lookup_cycles = dict_latency;
+		sim->dict_lookups++;
+	}
+
+	uint32_t rt = sim->reg[instr.rt];
+	uint32_t rs = sim->reg[instr.rs];
+	uint32_t imm = instr.imm;
+	int32_t simm = instr.simm;
+
+	if (instr.rt == 0)
+		rt = 0;
+
+	if (instr.rs == 0)
+		rs = 0;
+
+	switch(instr.op) {
+	case SLL:
+		sim->reg[instr.rd] = sll(rt, instr.shamt);
+		break;
+
+	case SRL:
+		sim->reg[instr.rd] = srl(rt, instr.shamt);
+		break;
+
+	case SRA:
+		sim->reg[instr.rd] = sra(rt, instr.shamt);
+		break;
+
+	case SLLV:
+		sim->reg[instr.rd] = sll(rt, rs);
+		break;
+
+	case SRLV:
+		sim->reg[instr.rd] = srl(rt, rs);
+		break;
+
+	case SRAV:
+		sim->reg[instr.rd] = sra(rt, rs);
+		break;
+
+	case ADD:
+		if (add_overflows(rs, rt, rs + rt)) {
+			force_stop = !raise_exception(sim, EXC_OV, pc, delay_slot, sim->branch_pc);
+			break;
 		}
+		sim->reg[instr.rd] = rt + rs;
+		break;
+
+	case ADDU:
+		sim->reg[instr.rd] = rt + rs;
+		break;
 
-		assert(instr.op < NOP);
+	case SUB:
+		if (sub_overflows(rs, rt, rs - rt)) {
+			force_stop = !raise_exception(sim, EXC_OV, pc, delay_slot, sim->branch_pc);
+			break;
+		}
+		sim->reg[instr.rd] = rs - rt;
+		break;
 	
-		if (debug) {
-			//fprintf(stdout, "%8.8X: (%8.8X) ", pc, instr_code);
-			struct instr i2 = instr;
-			conv_to_pseudo(&i2);
-			print_instr(&i2); 
+	case SUBU: 
+		sim->reg[instr.rd] = rs - rt;
+		break;
+
+	case AND:
+		sim->reg[instr.rd] = rs & rt;
+		break;
+
+	case OR:
+		sim->reg[instr.rd] = rs | rt;
+		break;
+
+	case XOR:
+		sim->reg[instr.rd] = rs ^ rt;
+		break;
+
+	case NOR:
+		sim->reg[instr.rd] = ~(rs | rt);
+		break;
+
+	case ADDI:
+		if (add_overflows(rs, simm, rs + simm)) {
+			force_stop = !raise_exception(sim, EXC_OV, pc, delay_slot, sim->branch_pc);
+			break;
 		}
+		sim->reg[instr.rt] = rs + simm;
+		break;
 
-		if (instr.compressed) {
-			total_bandwidth += 2;
-		} else {
-			total_bandwidth += 4;
+	case ADDIU:
+		sim->reg[instr.rt] = rs + simm;
+		break;
+
+	case ANDI:
+		sim->reg[instr.rt] = rs & imm;
+		break;
+
+	case ORI:
+		sim->reg[instr.rt] = rs | imm;
+		break;
+
+	case XORI:
+		sim->reg[instr.rt] = rs ^ imm;
+		break;
+
+	case LUI:
+		sim->reg[instr.rt] = imm << 16;
+		break;
+
+	case LB:
+		sim->reg[instr.rt] = lb(sim, rs + simm);
+		break;
+
+	case LH:
+		sim->reg[instr.rt] = lh(sim, rs + simm);
+		break;
+
+	case LW:
+		sim->reg[instr.rt] = lw(sim, rs + simm);
+		break;
+
+	case LBU:
+		sim->reg[instr.rt] = lbu(sim, rs + simm);
+		break;
+
+	case LHU:
+		sim->reg[instr.rt] = lhu(sim, rs + simm);
+		break;
+
+	case SB:
+		sb(sim, rs + simm, rt);
+		break;
+
+	case SH:
+		sh(sim, rs + simm, rt);
+		break;
+
+	case SW:
+		sw(sim, rs + simm, rt);
+		break;
+
+	case SLT:
+		sim->reg[instr.rd] = slt(rs, rt);
+		break;
+
+	case SLTU:
+		sim->reg[instr.rd] = (rs < rt) ? 1 : 0;
+		break;
+
+	case SLTI:
+		sim->reg[instr.rt] = slt(rs, simm);
+		break;
+
+	case SLTIU:
+		sim->reg[instr.rt] = (rs < imm) ? 1 : 0;
+		break;
+
+	case BLTZ:
+		if (rs >= 0x80000000) {
+			sim->jump_addr = sim->cur_pc + simm;
+			sim->jump = true;
 		}
+		break;
 
-		uint32_t rt = sim->reg[instr.rt];
-		uint32_t rs = sim->reg[instr.rs];
-		uint32_t imm = instr.imm;
-		int32_t simm = instr.simm;
+	case BGEZ:
+		if (rs < 0x80000000) {
+			sim->jump_addr = sim->cur_pc + simm;
+			sim->jump = true;
+		}
+		break;
 
-		if (instr.rt == 0)
-			rt = 0;
-	
-		if (instr.rs == 0)
-			rs = 0;
+	case BLTZAL:
+		sim->reg[31] = sim->cur_pc + size_next_instr;
+		if (rs >= 0x80000000) {
+			sim->jump_addr = sim->cur_pc + simm;
+			sim->jump = true;
+		}
+		break;
 
-		switch(instr.op) {
-		case SLL:
-			sim->reg[instr.rd] = sll(rt, instr.shamt);
-			break;
+	case BGEZAL:
+		sim->reg[31] = sim->cur_pc + size_next_instr;
+		if (rs < 0x80000000) {
+			sim->jump_addr = sim->cur_pc + simm;
+			sim->jump = true;
+		}
+		break;
 
-		case SRL:
-			sim->reg[instr.rd] = srl(rt, instr.shamt);
-			break;
+	case BEQ:
+		if (rs == rt) {
+			sim->jump_addr = sim->cur_pc + simm;
+			sim->jump = true;
+		}
+		break;
 
-		case SRA:
-			sim->reg[instr.rd] = sra(rt, instr.shamt);
-			break;
+	case BNE:
+		if (rs != rt) {
+			sim->jump_addr = sim->cur_pc + simm;
+			sim->jump = true;
+		}
+		break;
 
-		case SLLV:
-			sim->reg[instr.rd] = sll(rt, rs);
-			break;
+	case BLEZ:
+		if (rs >= 0x80000000 || rs == 0) {
+			sim->jump_addr = sim->cur_pc + simm;
+			sim->jump = true;
+		}
+		break;
 
-		case SRLV:
-			sim->reg[instr.rd] = srl(rt, rs);
-			break;
+	case BGTZ:
+		if (rs < 0x80000000 && rs > 0) {
+			sim->jump_addr = sim->cur_pc + simm;
+			sim->jump = true;
+		}
+		break;
+
+	case J:
+		sim->jump_addr = (sim->cur_pc & 0xF0000000) | (instr.addr & 0x0FFFFFFF);
+		sim->jump = true;
+		break;
+
+	case JAL:
+		sim->jump_addr = (sim->cur_pc & 0xF0000000) | (instr.addr & 0x0FFFFFFF);
+		sim->reg[31] = sim->cur_pc + size_next_instr;
+		sim->jump = true;
+		break;
+
+	case JR:
+		sim->jump_addr = rs;
+		sim->jump = true;
+		break;
+
+	case JALR:
+		sim->jump_addr = rs;
+		sim->reg[instr.rd] = sim->cur_pc + size_next_instr;
+		sim->jump = true;
+		break;
+
+	case SYSCALL:
+	case BREAK:
+		force_stop = true;
+		break;
+
+	case MFHI:
+		sim->reg[instr.rd] = sim->hi;
+		break;
+
+	case MFLO:
+		sim->reg[instr.rd] = sim->lo;
+		break;
+
+	case MTHI:
+		sim->hi = sim->reg[instr.rs];
+		break;
+
+	case MTLO:
+		sim->lo = sim->reg[instr.rs];
+		break;
+
+	case MULT:
+		mult(sim, sim->reg[instr.rs], sim->reg[instr.rt]);
+		break;
+
+	case MULTU:
+		multu(sim, sim->reg[instr.rs], sim->reg[instr.rt]);
+		break;
+
+	case DIV:
+		divs(sim, sim->reg[instr.rs], sim->reg[instr.rt]);
+		break;
+
+	case DIVU:
+		divu(sim, sim->reg[instr.rs], sim->reg[instr.rt]);
+		break;
+
+	case MFC0:
+		sim->reg[instr.rt] = sim->cop0[instr.rd];
+		break;
+
+	case MTC0:
+		mtc0(sim, instr.rd, rt);
+		break;
+
+	case RFE:
+		rfe(sim);
+		break;
+
+	default:
+		assert(0);
+	}
 
-		case SRAV:
-			sim->reg[instr.rd] = sra(rt, rs);
-			break;
+	sim->reg[0] = 0; /* register 0 must always be zero */
 
-		case ADD: /* TODO check for overflow */
-			sim->reg[instr.rd] = rt + rs;
-			fprintf(stderr, "ADD: overflow not implemented\n");
-			break;
+	sim->instr = instr;
+	sim->step++;
 
-		case ADDU:
-			sim->reg[instr.rd] = rt + rs;
-			break;
+	sim->branch = !delay_slot && (is_branch(instr.op) || instr.op == J ||
+		instr.op == JAL || instr.op == JR || instr.op == JALR);
+	if (sim->branch) {
+		sim->branch_pc = pc;
+	}
 
-		case SUB: /* TODO check for overflow */
-			sim->reg[instr.rd] = rs - rt;
-			fprintf(stderr, "SUB: overflow not implemented\n");
-			break;
-		
-		case SUBU: 
-			sim->reg[instr.rd] = rs - rt;
-			break;
+	if (sim->jump && !delay_slot && sim->taken_count != NULL) {
+		sim->taken_count[(pc - PC_START) / 2]++;
+	}
 
-		case AND:
-			sim->reg[instr.rd] = rs & rt;
-			break;
+	return !force_stop && !sim->stop;
+}
 
-		case OR:
-			sim->reg[instr.rd] = rs | rt;
-			break;
+static void simulator_init(struct simulator *sim, struct mem *imem, uint32_t imem_size,
+	struct mem *dmem, uint32_t dmem_size, bool v2)
+{
+	memset(sim, 0, sizeof(*sim));
+	sim->cur_pc = PC_START;
+	sim->v2 = v2;
+	sim->trace_fd = -1;
+	sim->imem = imem;
+	sim->dmem = dmem;
+	sim->imem_size = imem_size;
+	sim->dmem_size = dmem_size;
+	sim->exc_vector = exc_vector;
+	sim->running = true;
+}
 
-		case XOR:
-			sim->reg[instr.rd] = rs ^ rt;
-			break;
+/* Loads the program and the data. Returns the size of the program. */
+static uint32_t load_program(struct simulator *sim, const char *bin_file_path,
+	const char *data_file_path)
+{
+	uint32_t size = load_file_bin(bin_file_path, sim->imem, 0, sim->imem_size);
+	if (data_file_path != NULL) {
+		load_file_bin(data_file_path, sim->dmem, 4, sim->dmem_size);
+	}
 
-		case NOR:
-			sim->reg[instr.rd] = ~(rs | rt);
-			break;
+	return size;
+}
 
-		case ADDI: /* TODO overflow */
-			sim->reg[instr.rt] = rs + simm;
-			fprintf(stderr, "ADDI: overflow not implemented\n");
+void simulator_run(struct simulator *sim, uint64_t num_steps)
+{
+	while (num_steps == 0 || sim->step < num_steps) {
+		if (!simulator_step(sim))
 			break;
+	}
+}
 
-		case ADDIU:
-			sim->reg[instr.rt] = rs + simm;
-			break;
+/* Relates the original and the converted program for the lockstep mode.
+ * The programs are compared at the sync points, the first instructions of
+ * the basic blocks of the original program, which the converter keeps in
+ * place within their block. The address map of the converter (-M) holds the
+ * new address of every instruction and the live registers at every sync
+ * point. Without it the same index refers to the same instruction in both
+ * programs and every instruction is a sync point with all registers, which
+ * only holds if no pass moves, inserts or deletes instructions.
+ */
+struct code_map {
+	uint32_t size; /* bytes of the original program */
+	uint32_t *new_addr; /* of every original instruction and of the end */
+	bool *sync;
+	uint32_t *live; /* registers that are compared at a sync point */
+	uint32_t comp_size;
+	int32_t *orig; /* original sync point at every halfword of the converted program or -1 */
+};
 
-		case ANDI:
-			sim->reg[instr.rt] = rs & imm;
-			break;
+/* how many instructions the converted program may execute between two sync
+ * points, per instruction of the original program and in addition to them */
+#define LOCKSTEP_SLACK (4)
+#define LOCKSTEP_EXTRA (64)
 
-		case ORI:
-			sim->reg[instr.rt] = rs | imm;
-			break;
+static void code_map_alloc(struct code_map *map, uint32_t size, uint32_t comp_size)
+{
+	size_t num = size / 4 + 1;
+
+	map->size = size;
+	map->comp_size = comp_size;
+	map->new_addr = calloc(num, sizeof(*map->new_addr));
+	map->sync = calloc(num, sizeof(*map->sync));
+	map->live = calloc(num, sizeof(*map->live));
+	map->orig = malloc((comp_size / 2 + 1) * sizeof(*map->orig));
+	if (map->new_addr == NULL || map->sync == NULL || map->live == NULL || map->orig == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+}
 
-		case XORI:
-			sim->reg[instr.rt] = rs ^ imm;
-			break;
+/* the instruction with the same index, all of them are sync points */
+static void code_map_by_index(struct code_map *map, struct simulator *comp)
+{
+	uint32_t num = map->size / 4;
+	uint32_t addr = 0;
 
-		case LUI:
-			sim->reg[instr.rt] = imm << 16;
-			break;
+	for (uint32_t i = 0; i < num; i++) {
+		map->new_addr[i] = addr < map->comp_size ? addr : map->comp_size;
+		map->sync[i] = addr < map->comp_size;
+		map->live[i] = 0xFFFFFFFE;
 
-		case LB:
-			sim->reg[instr.rt] = lb(sim, rs + simm);
-			break;
+		if (addr < map->comp_size)
+			addr += mem_read8(comp->imem, addr) >= 0x80 ? 2 : 4;
+	}
+	map->new_addr[num] = addr < map->comp_size ? addr : map->comp_size;
+}
 
-		case LH:
-			sim->reg[instr.rt] = lh(sim, rs + simm);
-			break;
+static void code_map_read(struct code_map *map, const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
 
-		case LW:
-			sim->reg[instr.rt] = lw(sim, rs + simm);
-			break;
+	uint32_t num = map->size / 4;
+	uint32_t i = 0;
+	char line[64];
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		uint32_t old_addr;
+		uint32_t new_addr;
+		uint32_t live;
+		int rc = sscanf(line, "%" SCNx32 " %" SCNx32 " %" SCNx32, &old_addr, &new_addr, &live);
+
+		if (rc < 2 || i > num || old_addr != PC_START + 4 * i || new_addr < PC_START ||
+			new_addr - PC_START > map->comp_size) {
+			fprintf(stderr, "The address map '%s' doesn't belong to the programs (line %u)\n",
+				path, i + 1);
+			exit(EXIT_FAILURE);
+		}
 
-		case LBU:
-			sim->reg[instr.rt] = lbu(sim, rs + simm);
-			break;
+		map->new_addr[i] = new_addr - PC_START;
+		map->sync[i] = rc == 3 && i < num;
+		map->live[i] = rc == 3 ? live : 0;
+		i++;
+	}
+	fclose(file);
 
-		case LHU:
-			sim->reg[instr.rt] = lhu(sim, rs + simm);
-			break;
+	if (i != num + 1) {
+		fprintf(stderr, "The address map '%s' doesn't belong to the programs\n", path);
+		exit(EXIT_FAILURE);
+	}
+}
 
-		case SB:
-			sb(sim, rs + simm, rt);
-			break;
+static void code_map_init(struct code_map *map, struct simulator *comp, uint32_t size,
+	uint32_t comp_size, const char *map_path)
+{
+	code_map_alloc(map, size, comp_size);
 
-		case SH:
-			sh(sim, rs + simm, rt);
-			break;
+	if (map_path != NULL) {
+		code_map_read(map, map_path);
+	} else {
+		code_map_by_index(map, comp);
+	}
 
-		case SW:
-			sw(sim, rs + simm, rt);
-			break;
+	for (uint32_t k = 0; k <= comp_size / 2; k++) {
+		map->orig[k] = -1;
+	}
 
-		case SLT:
-			sim->reg[instr.rd] = slt(rs, rt);
-			break;
+	for (uint32_t i = 0; i < size / 4; i++) {
+		if (map->sync[i] && map->new_addr[i] % 2 == 0 && map->new_addr[i] < comp_size)
+			map->orig[map->new_addr[i] / 2] = i;
+	}
+}
 
-		case SLTU:
-			sim->reg[instr.rd] = (rs < rt) ? 1 : 0;
-			break;
+static void code_map_free(struct code_map *map)
+{
+	free(map->new_addr);
+	free(map->sync);
+	free(map->live);
+	free(map->orig);
+}
 
-		case SLTI:
-			sim->reg[instr.rt] = slt(rs, simm);
-			break;
+/* the address in the converted program of an address of the original one */
+static uint32_t map_addr(const struct code_map *map, uint32_t addr)
+{
+	if (addr < PC_START || addr - PC_START > map->size || (addr - PC_START) % 4 != 0)
+		return addr;
+	return PC_START + map->new_addr[(addr - PC_START) / 4];
+}
 
-		case SLTIU:
-			sim->reg[instr.rt] = (rs < imm) ? 1 : 0;
-			break;
+/* the sync point that the original program executes next or -1 */
+static int32_t ref_sync(const struct code_map *map, const struct simulator *ref)
+{
+	uint32_t offset = ref->cur_pc - PC_START;
 
-		case BLTZ:
-			if (rs >= 0x80000000) {
-				sim->jump_addr = sim->cur_pc + simm;
-				sim->jump = true;
-			}
-			break;
+	if (ref->branch || ref->cur_pc < PC_START || offset >= map->size || offset % 4 != 0)
+		return -1;
+	return map->sync[offset / 4] ? (int32_t)(offset / 4) : -1;
+}
 
-		case BGEZ:
-			if (rs < 0x80000000) {
-				sim->jump_addr = sim->cur_pc + simm;
-				sim->jump = true;
-			}
-			break;
+/* the sync point that the converted program executes next or -1 */
+static int32_t comp_sync(const struct code_map *map, const struct simulator *comp)
+{
+	uint32_t offset = comp->cur_pc - PC_START;
 
-		case BLTZAL:
-			sim->reg[31] = sim->cur_pc + size_next_instr;
-			if (rs >= 0x80000000) {
-				sim->jump_addr = sim->cur_pc + simm;
-				sim->jump = true;
-			}
+	if (comp->branch || comp->cur_pc < PC_START || offset >= map->comp_size || offset % 2 != 0)
+		return -1;
+	return map->orig[offset / 2];
+}
+
+/* Values are equal if they are the same or point to the same instruction */
+static bool values_match(const struct code_map *map, uint32_t ref_value, uint32_t comp_value)
+{
+	return ref_value == comp_value || map_addr(map, ref_value) == comp_value;
+}
+
+static void print_divergence(struct simulator *ref, struct simulator *comp, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	fprintf(stderr, "Lockstep divergence after %" PRIu64 " instructions: ", ref->step);
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+
+	struct instr instr = ref->instr;
+	conv_to_pseudo(&instr);
+	fprintf(stderr, "original  %8.8X: ", ref->pc);
+	fprint_instr(stderr, &instr);
+
+	instr = comp->instr;
+	conv_to_pseudo(&instr);
+	fprintf(stderr, "converted %8.8X: %s", comp->pc, instr.compressed ? "c." : "");
+	fprint_instr(stderr, &instr);
+}
+
+/* compares the programs at the sync point index or at their end */
+static bool lockstep_compare(struct simulator *ref, struct simulator *comp,
+	const struct code_map *map, int32_t index, bool ref_running, bool comp_running)
+{
+	if (ref_running != comp_running) {
+		print_divergence(ref, comp, "only the %s program stopped",
+			ref_running ? "converted" : "original");
+		return false;
+	}
+
+	if (ref_running && comp_sync(map, comp) != index) {
+		print_divergence(ref, comp, "the converted program continues at %8.8X instead of %8.8X",
+			comp->cur_pc, map_addr(map, ref->cur_pc));
+		return false;
+	}
+
+	struct store_log *s1 = ref->stores;
+	struct store_log *s2 = comp->stores;
+	for (size_t i = 0; i < s1->len || i < s2->len; i++) {
+		if (i >= s1->len || i >= s2->len || s1->data[i].addr != s2->data[i].addr ||
+			s1->data[i].size != s2->data[i].size ||
+			!values_match(map, s1->data[i].value, s2->data[i].value)) {
+			struct store none = {0, 0, 0};
+			struct store *a = i < s1->len ? &s1->data[i] : &none;
+			struct store *b = i < s2->len ? &s2->data[i] : &none;
+			print_divergence(ref, comp, "store %u bytes %8.8X to %8.8X != %u bytes %8.8X to %8.8X",
+				a->size, a->value, a->addr, b->size, b->value, b->addr);
+			return false;
+		}
+	}
+	s1->len = 0;
+	s2->len = 0;
+
+	if (!ref_running)
+		return true;
+
+	for (int i = 1; i < 32; i++) {
+		if ((map->live[index] & (1u << i)) &&
+			!values_match(map, ref->reg[i], comp->reg[i])) {
+			print_divergence(ref, comp, "r%d: %8.8X != %8.8X", i, ref->reg[i], comp->reg[i]);
+			return false;
+		}
+	}
+
+	if (ref->hi != comp->hi || ref->lo != comp->lo) {
+		print_divergence(ref, comp, "hi/lo: %8.8X/%8.8X != %8.8X/%8.8X",
+			ref->hi, ref->lo, comp->hi, comp->lo);
+		return false;
+	}
+
+	return true;
+}
+
+/* Runs the original program (ref) and the converted program (comp) side by
+ * side. Both run to their next sync point, then the live registers and the
+ * stores since the last sync point are compared. Returns false at the
+ * first divergence. */
+static bool lockstep_run(struct simulator *ref, struct simulator *comp,
+	const struct code_map *map, uint64_t num_steps)
+{
+	struct store_log ref_stores = {NULL, 0, 0};
+	struct store_log comp_stores = {NULL, 0, 0};
+	ref->stores = &ref_stores;
+	comp->stores = &comp_stores;
+
+	bool same = true;
+	while (same && (num_steps == 0 || ref->step < num_steps)) {
+		uint64_t ref_start = ref->step;
+		uint64_t comp_start = comp->step;
+		bool ref_running;
+		bool comp_running;
+		int32_t index;
+
+		do {
+			ref_running = simulator_step(ref);
+			index = ref_sync(map, ref);
+		} while (ref_running && index < 0 && (num_steps == 0 || ref->step < num_steps));
+
+		/* the last sync point before the limit */
+		if (ref_running && index < 0)
 			break;
 
-		case BGEZAL:
-			sim->reg[31] = sim->cur_pc + size_next_instr;
-			if (rs < 0x80000000) {
-				sim->jump_addr = sim->cur_pc + simm;
-				sim->jump = true;
-			}
+		uint64_t limit = LOCKSTEP_SLACK * (ref->step - ref_start) + LOCKSTEP_EXTRA;
+		do {
+			comp_running = simulator_step(comp);
+		} while (comp_running && comp_sync(map, comp) < 0 && comp->step - comp_start < limit);
+
+		same = lockstep_compare(ref, comp, map, index, ref_running, comp_running);
+
+		if (!ref_running)
 			break;
+	}
+
+	ref->stores = NULL;
+	comp->stores = NULL;
+	free(ref_stores.data);
+	free(comp_stores.data);
+	return same;
+}
+
+/* Statistics of the shared instruction bus */
+struct bus_stat {
+	uint64_t cycles; /* cycles of the whole system */
+	uint64_t busy_cycles;
+	uint64_t bytes;
+	uint64_t conflicts; /* cycles in which a request waited for the bus */
+};
+
+/* Runs the cores deterministically interleaved. A core executes an
+ * instruction and requests its fetch (or cache refill) from the shared bus.
+ * The bus serves bus_width bytes per cycle, the requests of one cycle with a
+ * rotating priority. The core stalls until its request was served and then
+ * for the cycles of the dictionary lookup or the block decompression, only
+ * after that it executes its next instruction. */
+static void multicore_run(struct simulator *cores, unsigned num_cores, uint64_t num_steps,
+	uint32_t bus_width, struct bus_stat *bus)
+{
+	unsigned running = num_cores;
+	uint64_t cycle = 0;
+	uint64_t bus_pos = 0; /* bytes the bus has served or has to serve */
 
-		case BEQ:
-			if (rs == rt) {
-				sim->jump_addr = sim->cur_pc + simm;
-				sim->jump = true;
+	for (unsigned c = 0; c < num_cores; c++) {
+		cores[c].ready = 0;
+	}
+
+	while (running > 0) {
+		bool conflict = false;
+
+		for (unsigned i = 0; i < num_cores; i++) {
+			struct simulator *sim = &cores[(cycle + i) % num_cores];
+			if (!sim->running || sim->ready > cycle)
+				continue;
+
+			sim->fetch_bytes = 0;
+			if (!simulator_step(sim) || (num_steps != 0 && sim->step >= num_steps)) {
+				sim->running = false;
+				running--;
 			}
-			break;
 
-		case BNE:
-			if (rs != rt) {
-				sim->jump_addr = sim->cur_pc + simm;
-				sim->jump = true;
+			uint64_t done = cycle + 1;
+			if (sim->fetch_bytes > 0) {
+				uint64_t start = cycle * bus_width;
+				if (bus_pos > start) {
+					start = bus_pos;
+					conflict = true;
+				}
+
+				/* a request can use the rest of a cycle that another one started */
+				bus_pos = start + sim->fetch_bytes;
+				done = (bus_pos + bus_width - 1) / bus_width;
+				bus->busy_cycles += done - (start + bus_width - 1) / bus_width;
+				bus->bytes += sim->fetch_bytes;
 			}
-			break;
 
-		case BLEZ:
-			if (rs >= 0x80000000 || rs == 0) {
-				sim->jump_addr = sim->cur_pc + simm;
-				sim->jump = true;
+			done += sim->lookup_cycles + sim->refill_cycles;
+			sim->stall_cycles += done - cycle - 1;
+			sim->ready = done;
+			if (done > bus->cycles) {
+				bus->cycles = done;
 			}
-			break;
+		}
+
+		if (conflict) {
+			bus->conflicts++;
+		}
 
-		case BGTZ:
-			if (rs < 0x80000000 && rs > 0) {
-				sim->jump_addr = sim->cur_pc + simm;
-				sim->jump = true;
+		/* the next cycle in which a core executes an instruction */
+		uint64_t next = UINT64_MAX;
+		for (unsigned c = 0; c < num_cores; c++) {
+			if (cores[c].running && cores[c].ready < next) {
+				next = cores[c].ready;
 			}
-			break;
+		}
+		cycle = next;
+	}
+}
 
-		case J:
-			sim->jump_addr = (sim->cur_pc & 0xF0000000) | (instr.addr & 0x0FFFFFFF);
-			sim->jump = true;
-			break;
+struct core_thread {
+	pthread_t thread;
+	struct simulator *sim;
+	uint64_t num_steps;
+};
 
-		case JAL:
-			sim->jump_addr = (sim->cur_pc & 0xF0000000) | (instr.addr & 0x0FFFFFFF);
-			sim->reg[31] = sim->cur_pc + size_next_instr;
-			sim->jump = true;
-			break;
+static void *run_core(void *arg)
+{
+	struct core_thread *ct = arg;
+	simulator_run(ct->sim, ct->num_steps);
+	return NULL;
+}
 
-		case JR:
-			sim->jump_addr = rs;
-			sim->jump = true;
-			break;
+/* Runs every core in its own thread. The order of the memory accesses between
+ * the cores isn't deterministic and the bus isn't modeled. */
+static void multicore_run_threaded(struct simulator *cores, unsigned num_cores, uint64_t num_steps)
+{
+	struct core_thread threads[MAX_CORES];
+
+	for (unsigned c = 0; c < num_cores; c++) {
+		threads[c].sim = &cores[c];
+		threads[c].num_steps = num_steps;
+		if (pthread_create(&threads[c].thread, NULL, run_core, &threads[c]) != 0) {
+			fprintf(stderr, "Couldn't create thread for core %u\n", c);
+			exit(EXIT_FAILURE);
+		}
+	}
 
-		case JALR:
-			sim->jump_addr = rs;
-			sim->reg[instr.rd] = sim->cur_pc + size_next_instr;
-			sim->jump = true;
-			break;
+	for (unsigned c = 0; c < num_cores; c++) {
+		pthread_join(threads[c].thread, NULL);
+	}
+}
 
-		case SYSCALL:
-		case BREAK:
-			force_stop = true;
-			break;
+static void profile_init(struct simulator *sim)
+{
+	sim->exec_count = calloc(sim->imem_size / 2, sizeof(*sim->exec_count));
+	sim->taken_count = calloc(sim->imem_size / 2, sizeof(*sim->taken_count));
+	if (sim->exec_count == NULL || sim->taken_count == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+}
 
-		case MFHI:
-			sim->reg[instr.rd] = sim->hi;
-			break;
+/* Writes one line "ADDRESS EXEC-COUNT TAKEN-COUNT" for every executed
+ * instruction. The counts of all cores are added up. */
+static void write_profile(const char *path, struct simulator *cores, unsigned num_cores)
+{
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open file '%s'\n", path);
+		exit(EXIT_FAILURE);
+	}
 
-		case MFLO:
-			sim->reg[instr.rd] = sim->lo;
-			break;
+	for (uint32_t i = 0; i < cores[0].imem_size / 2; i++) {
+		uint64_t exec = 0;
+		uint64_t taken = 0;
 
-		case MTHI:
-			sim->hi = sim->reg[instr.rs];
-			break;
+		for (unsigned c = 0; c < num_cores; c++) {
+			exec += cores[c].exec_count[i];
+			taken += cores[c].taken_count[i];
+		}
 
-		case MTLO:
-			sim->lo = sim->reg[instr.rs];
-			break;
+		if (exec > 0) {
+			fprintf(file, "%8.8X %" PRIu64 " %" PRIu64 "\n", PC_START + 2 * i, exec, taken);
+		}
+	}
 
-		case MULT:
-			mult(sim, sim->reg[instr.rs], sim->reg[instr.rt]);
-			break;
+	fclose(file);
 
-		case MULTU:
-			multu(sim, sim->reg[instr.rs], sim->reg[instr.rt]);
-			break;
+	for (unsigned c = 0; c < num_cores; c++) {
+		free(cores[c].exec_count);
+		free(cores[c].taken_count);
+	}
+}
 
-		case DIV:
-			divs(sim, sim->reg[instr.rs], sim->reg[instr.rt]);
-			break;
+static void print_core_stats(struct simulator *cores, unsigned num_cores, uint32_t bus_width,
+	struct bus_stat *bus)
+{
+	uint64_t total_instr = 0;
+	uint64_t total_bytes = 0;
 
-		case DIVU:
-			divu(sim, sim->reg[instr.rs], sim->reg[instr.rt]);
-			break;
+	fprintf(stderr, "core | instructions | fetched bytes |  bus bytes | cache hits | cache misses | lookups | stalls\n");
+	for (unsigned c = 0; c < num_cores; c++) {
+		struct simulator *sim = &cores[c];
+		uint64_t hits = sim->icache != NULL ? sim->icache->hits : 0;
+		uint64_t misses = sim->icache != NULL ? sim->icache->misses : 0;
 
-		default:
-			assert(0);
+		fprintf(stderr, "%4u | %12" PRIu64 " | %13" PRIu64 " | %10" PRIu64 " | %10" PRIu64
+			" | %12" PRIu64 " | %7" PRIu64 " | %6" PRIu64 "\n", c, sim->step, sim->bandwidth,
+			sim->bus_bytes, hits, misses, sim->dict_lookups, sim->stall_cycles);
+
+		total_instr += sim->step;
+		total_bytes += sim->bus_bytes;
+	}
+
+	if (cores[0].blocks != NULL) {
+		uint64_t refills = 0;
+		uint64_t cycles = 0;
+		for (unsigned c = 0; c < num_cores; c++) {
+			refills += cores[c].block_refills;
+			cycles += cores[c].decomp_cycles;
 		}
+		fprintf(stderr, "decompressor: %" PRIu64 " block refills, %" PRIu64 " cycles\n", refills, cycles);
+	}
 
-		sim->reg[0] = 0; /* register 0 must always be zero */
+	if (bus == NULL) {
+		/* without interleaving only a lower bound of the bus load is known */
+		fprintf(stderr, "instruction bus: %" PRIu64 " bytes, at least %" PRIu64 " busy cycles\n",
+			total_bytes, (total_bytes + bus_width - 1) / bus_width);
+		return;
 	}
+
+	fprintf(stderr, "instruction bus: %" PRIu64 " bytes, %" PRIu64 " cycles, %" PRIu64
+		" busy cycles (%5.2f%%), %" PRIu64 " cycles with conflicts\n",
+		bus->bytes, bus->cycles, bus->busy_cycles,
+		bus->cycles > 0 ? (100.0 * bus->busy_cycles) / bus->cycles : 0.0, bus->conflicts);
+	fprintf(stderr, "instructions per cycle: %5.3f\n",
+		bus->cycles > 0 ? (double)total_instr / bus->cycles : 0.0);
 }
 
 int main(int argc, char *argv[])
@@ -810,8 +1771,8 @@ int main(int argc, char *argv[])
 	if (argc > 0)
 		program_name = argv[0];
 	
-	uint32_t imem_size  = DEFAULT_IMEM_SIZE;
-	uint32_t dmem_size  = DEFAULT_DMEM_SIZE;
+	uint64_t imem_size  = DEFAULT_IMEM_SIZE;
+	uint64_t dmem_size  = DEFAULT_DMEM_SIZE;
 	uint64_t num_cycles = DEFAULT_NUM_CYCLES;
 
 	bool v2 = false;
@@ -820,18 +1781,32 @@ int main(int argc, char *argv[])
 
 	const char *bin_file_path = NULL;
 	const char *data_file_path = NULL;
+	const char *comp_file_path = NULL;
+	const char *comp_data_path = NULL;
+	const char *map_path = NULL;
 	char *trace_file_path = NULL;
+	const char *profile_path = NULL;
+
+	unsigned num_cores = 1;
+	bool threaded = false;
+	uint32_t bus_width = DEFAULT_BUS_WIDTH;
+	uint32_t icache_size = 0;
+	uint32_t icache_line_size = ICACHE_DEFAULT_LINE_SIZE;
+	const char *dict_path = NULL;
+	const char *block_path = NULL;
 
 	int opt = 0;
 
-	while ((opt = getopt(argc, argv, "i:d:cn:xbt:r")) != -1) {
+	while ((opt = getopt(argc, argv, "i:d:c3n:xbt:P:re:fl:M:N:TC:w:X:Z:")) != -1) {
 		switch (opt) {
 		case 'i':
-			imem_size = 1024 * str_to_uint32(optarg);
+			imem_size = 1024 * (uint64_t)str_to_uint32(optarg);
 			break;
 
 		case 'd':
-			dmem_size = 1024 * str_to_uint32(optarg);
+			dmem_size = 1024 * (uint64_t)str_to_uint32(optarg);
+			if (dmem_size == 0)
+				dmem_size = MMIO_START;
 			break;
 
 		case 'n':
@@ -846,6 +1821,11 @@ int main(int argc, char *argv[])
 			v2 = true;
 			break;
 
+		case '3':
+			v2 = true;
+			use_v3_encodings();
+			break;
+
 		case 'b':
 			print_bandwidth = true;
 			break;
@@ -854,10 +1834,92 @@ int main(int argc, char *argv[])
 			trace_file_path = strdup(optarg);
 			break;
 
+		case 'P':
+			profile_path = optarg;
+			break;
+
 		case 'r':
 			print_regfile = true;
 			break;
 
+		case 'e':
+			exc_vector = str_to_addr(optarg);
+			exc_vector_set = true;
+			break;
+
+		case 'f':
+			stop_on_fault = true;
+			break;
+
+		case 'l': {
+			char *data = strchr(optarg, ',');
+			if (data != NULL) {
+				*data = '\0';
+				comp_data_path = data + 1;
+			}
+			comp_file_path = optarg;
+			break;
+		}
+
+		case 'M':
+			map_path = optarg;
+			break;
+
+		case 'N':
+			num_cores = str_to_uint32(optarg);
+			if (num_cores < 1 || num_cores > MAX_CORES) {
+				fprintf(stderr, "number of cores must be between 1 and %d\n", MAX_CORES);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'T':
+			threaded = true;
+			break;
+
+		case 'C': {
+			char *line = strchr(optarg, ',');
+			if (line != NULL) {
+				*line = '\0';
+				icache_line_size = str_to_uint32(line + 1);
+			}
+			icache_size = 1024 * str_to_uint32(optarg);
+			break;
+		}
+
+		case 'w':
+			bus_width = str_to_uint32(optarg);
+			if (bus_width == 0) {
+				fprintf(stderr, "bus width must not be 0\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'X': {
+			char *latency = strchr(optarg, ',');
+			if (latency != NULL) {
+				*latency = '\0';
+				dict_latency = str_to_uint32(latency + 1);
+			}
+			dict_path = optarg;
+			v2 = true;
+			break;
+		}
+
+		case 'Z': {
+			char *throughput = strchr(optarg, ',');
+			if (throughput != NULL) {
+				*throughput = '\0';
+				block_throughput = str_to_uint32(throughput + 1);
+				if (block_throughput == 0) {
+					fprintf(stderr, "the throughput must not be 0\n");
+					exit(EXIT_FAILURE);
+				}
+			}
+			block_path = optarg;
+			break;
+		}
+
 		case '?':
 		default:
 			usage();
@@ -869,57 +1931,194 @@ int main(int argc, char *argv[])
 		usage();
 	}
 
-	if (dmem_size > PC_START) {
+	/* data and instruction memory are separated, only the memory mapped I/O
+	 * limits the data memory */
+	if (dmem_size > MMIO_START) {
 		fprintf(stderr, "size of data memory is too big.\n");
 		exit(EXIT_FAILURE);
 	}
 
+	if (imem_size > MMIO_START - PC_START) {
+		fprintf(stderr, "size of instruction memory is too big.\n");
+		exit(EXIT_FAILURE);
+	}
+
 	bin_file_path = argv[optind];
 
+	if (dict_path != NULL) {
+		read_dictionary(dict_path);
+	}
+
 	if (optind + 1 < argc)
 		data_file_path = argv[optind + 1];
 	
-	struct simulator sim;
+	if (map_path != NULL && comp_file_path == NULL) {
+		fprintf(stderr, "the address map is only used in the lockstep mode (-l)\n");
+		exit(EXIT_FAILURE);
+	}
 
-	memset(&sim, 0, sizeof(sim));
-	sim.cur_pc = PC_START;
+	if (comp_file_path != NULL && num_cores > 1) {
+		fprintf(stderr, "lockstep mode supports only one core\n");
+		exit(EXIT_FAILURE);
+	}
 
-	sim.imem = calloc(1, imem_size);
-	sim.dmem = calloc(1, dmem_size);
+	if (block_path != NULL && icache_size == 0) {
+		fprintf(stderr, "the blocks of a block image are only refilled into an instruction cache\n");
+		exit(EXIT_FAILURE);
+	}
 
-	sim.imem_size = imem_size;
-	sim.dmem_size = dmem_size;
+	/* the program and data memory are shared by all cores */
+	struct mem imem;
+	struct mem dmem;
+	mem_init(&imem);
+	mem_init(&dmem);
 
-	load_file_bin(bin_file_path, sim.imem, sim.imem_size);
-	if (data_file_path != NULL) {
-		load_file_bin(data_file_path, sim.dmem + 4, sim.dmem_size - 4);
+	struct simulator *cores = calloc(num_cores, sizeof(*cores));
+	struct icache *icaches = calloc(num_cores, sizeof(*icaches));
+	if (cores == NULL || icaches == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (unsigned c = 0; c < num_cores; c++) {
+		simulator_init(&cores[c], &imem, imem_size, &dmem, dmem_size,
+			v2 && comp_file_path == NULL);
+		cores[c].cop0[COP0_PRID] = c;
+
+		if (icache_size != 0) {
+			icache_init(&icaches[c], icache_size, icache_line_size);
+			cores[c].icache = &icaches[c];
+		}
+
+		if (profile_path != NULL) {
+			profile_init(&cores[c]);
+		}
+	}
+
+	struct simulator *sim = &cores[0];
+	uint32_t bin_size = load_program(sim, bin_file_path, data_file_path);
+
+	struct block_image blocks = {0, 0, 0, NULL, NULL};
+	if (block_path != NULL) {
+		block_image_read(&blocks, block_path);
+
+		if (blocks.size != bin_size) {
+			fprintf(stderr, "the block image holds %u bytes, but the program has %u bytes\n",
+				blocks.size, bin_size);
+			exit(EXIT_FAILURE);
+		}
+
+		if (blocks.block_size < icache_line_size || blocks.block_size > icache_size) {
+			fprintf(stderr, "the blocks must be between a cache line and the cache in size\n");
+			exit(EXIT_FAILURE);
+		}
+
+		for (unsigned c = 0; c < num_cores; c++) {
+			cores[c].blocks = &blocks;
+		}
 	}
 
-	int trace_fd = -1;
 	if (trace_file_path != NULL) {
-		trace_fd = creat(trace_file_path, 0666);
+		sim->trace_fd = creat(trace_file_path, 0666);
 	}
 	
-	simulator_run(&sim, num_cycles, v2, trace_fd);
+	int rc = 0;
+	struct bus_stat bus = {0, 0, 0, 0};
+	if (comp_file_path != NULL) {
+		/* the original program is the reference for the converted one */
+		struct uart_log uart_log = {NULL, 0, 0};
+		struct mem comp_imem;
+		struct mem comp_dmem;
+		mem_init(&comp_imem);
+		mem_init(&comp_dmem);
+
+		struct simulator comp;
+		simulator_init(&comp, &comp_imem, imem_size, &comp_dmem, dmem_size, true);
+		uint32_t comp_size = load_program(&comp, comp_file_path,
+			comp_data_path != NULL ? comp_data_path : data_file_path);
+
+		sim->uart_in = &uart_log;
+		comp.uart_in = &uart_log;
+		comp.shadow = true;
+
+		struct code_map map;
+		code_map_init(&map, &comp, bin_size, comp_size, map_path);
+		comp.exc_vector = map_addr(&map, exc_vector);
+
+		if (lockstep_run(sim, &comp, &map, num_cycles)) {
+			fprintf(stderr, "Lockstep: %" PRIu64 " instructions without divergence\n", sim->step);
+		} else {
+			rc = EXIT_FAILURE;
+		}
+
+		if (print_bandwidth) {
+			printf("total instruction bandwidth (converted): %" PRIu64 " bytes\n",
+				comp.bandwidth
+			);
+		}
+
+		code_map_free(&map);
+		free(uart_log.data);
+		mem_destroy(&comp_imem);
+		mem_destroy(&comp_dmem);
+	} else if (num_cores > 1 && threaded) {
+		multicore_run_threaded(cores, num_cores, num_cycles);
+	} else if (num_cores > 1 || icache_size != 0 || dict_path != NULL) {
+		/* a single core only needs the bus model for the cycles of the fetches */
+		multicore_run(cores, num_cores, num_cycles, bus_width, &bus);
+	} else {
+		simulator_run(sim, num_cycles);
+	}
+	print_faults(sim->dmem_size);
+
+	if (profile_path != NULL) {
+		write_profile(profile_path, cores, num_cores);
+	}
 
 	if (print_bandwidth) {
+		uint64_t bandwidth = 0;
+		for (unsigned c = 0; c < num_cores; c++) {
+			bandwidth += cores[c].bandwidth;
+		}
 		printf("total instruction bandwidth: %" PRIu64 " bytes\n",
-			total_bandwidth
+			bandwidth
 		);
 	}
 
+	if (num_cores > 1 || icache_size != 0 || (dict_path != NULL && comp_file_path == NULL)) {
+		print_core_stats(cores, num_cores, bus_width, threaded ? NULL : &bus);
+	}
+
 	if (print_regfile) {
-		for (int i = 0; i < 32; i++) {
-			fprintf(stderr, "reg %2d: %8.8X\n",i, sim.reg[i]);
+		for (unsigned c = 0; c < num_cores; c++) {
+			if (num_cores > 1) {
+				fprintf(stderr, "core %u:\n", c);
+			}
+			for (int i = 0; i < 32; i++) {
+				fprintf(stderr, "reg %2d: %8.8X\n",i, cores[c].reg[i]);
+			}
+			fprintf(stderr, "hi: %8.8X\n", cores[c].hi);
+			fprintf(stderr, "lo: %8.8X\n", cores[c].lo);
+			fprintf(stderr, "status: %8.8X\n", cores[c].cop0[COP0_STATUS]);
+			fprintf(stderr, "cause: %8.8X\n", cores[c].cop0[COP0_CAUSE]);
+			fprintf(stderr, "epc: %8.8X\n", cores[c].cop0[COP0_EPC]);
 		}
-		fprintf(stderr, "hi: %8.8X\n", sim.hi);
-		fprintf(stderr, "lo: %8.8X\n", sim.lo);
 	}
 
-	free(sim.imem);
-	free(sim.dmem);
+	for (unsigned c = 0; c < num_cores; c++) {
+		if (cores[c].icache != NULL)
+			icache_destroy(cores[c].icache);
+	}
+	free(icaches);
+	free(cores);
+	if (block_path != NULL) {
+		block_image_free(&blocks);
+	}
+	mem_destroy(&imem);
+	mem_destroy(&dmem);
+	free(fault_table);
 	free(trace_file_path);
 
-	return 0;
+	return rc;
 }
 
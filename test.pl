@@ -39,6 +39,7 @@ foreach my $test (sort(keys %tests)) {
 	my $binu = $test_path . $test . ".bin";
 	my $binc = $test_path . $test . ".comp.bin";
 	my $datau = $test_path . $test . ".data.bin";
+	my $datac = $test_path . $test . ".comp.data.bin";
 
 	my $num_cycles = $tests{$test};
 
@@ -51,10 +52,10 @@ foreach my $test (sort(keys %tests)) {
 	my $ref_out = <REF_FILE>;
 
 	# convert 
-	`$conv $binu $binc`;
+	`$conv -d $datau -D $datac $binu $binc`;
 	
 	# simulate the compressed binary
-	my $outc = `$sim -c -n $num_cycles -t $test.c.trace $binc $datau`;
+	my $outc = `$sim -c -n $num_cycles -t $test.c.trace $binc $datac`;
 
 	# size of the instruction binaries
 	my $usize = -s $binu;
@@ -90,6 +91,7 @@ foreach my $test (sort(keys %io_tests)) {
 	my $binu = $test_path . $test . ".bin";
 	my $binc = $test_path . $test . ".comp.bin";
 	my $datau = $test_path . $test . ".data.bin";
+	my $datac = $test_path . $test . ".comp.data.bin";
 
 	my $num_cycles = $io_tests{$test};
 
@@ -102,10 +104,10 @@ foreach my $test (sort(keys %io_tests)) {
 	my $ref_out = <REF_FILE>;
 
 	# convert 
-	`$conv $binu $binc`;
+	`$conv -d $datau -D $datac $binu $binc`;
 	
 	# simulate the compressed binary
-	my $outc = `cat $ref_in | $escp | $sim -c -n $num_cycles -t $test.c.trace $binc $datau`;
+	my $outc = `cat $ref_in | $escp | $sim -c -n $num_cycles -t $test.c.trace $binc $datac`;
 
 	# size of the instruction binaries
 	my $usize = -s $binu;
@@ -131,3 +133,49 @@ foreach my $test (sort(keys %io_tests)) {
 		100.0 * ($bandwidthc / $bandwidthu);
 }
 
+# regression tests, every test runs uncompressed and converted with the options
+my $disas = "./disas/disas";
+
+my @regress_tests = (
+	# test, expected output, converter options, simulator and disas options
+	["not_rename", "7\n", "-r -X ${test_path}not_rename.dict", "-X ${test_path}not_rename.dict"],
+	["not_rename", "7\n", "-r -a 4", "-c"],
+	["overflow_rfe", "3 1\n", "", "-c"],
+	["overflow_rfe", "3 1\n", "-s", "-c"],
+	["overflow_bd", "3 3\n", "", "-c"],
+	["overflow_bd", "3 3\n", "-s", "-c"],
+	["peephole", "8\n", "-w", "-c"],
+	["outline_ra", "6\n", "-O", "-c"],
+);
+
+# the exception handler starts with mfc0 k0, EPC; its address moves with the conversion
+sub exc_vector {
+	my ($bin, $opts) = @_;
+	foreach my $line (split(/\n/, `$disas $opts -l $bin`)) {
+		return sprintf("-e 0x%x", hex($1) + 0x40000000) if $line =~ /^([0-9a-f]+)\s+(c\.)?mfc0 r26, \$14/;
+	}
+	return "";
+}
+
+print "\n| regression   | converter options                     | u c |\n";
+print "+--------------+---------------------------------------+-----+\n";
+
+foreach my $regress (@regress_tests) {
+	my ($test, $ref_out, $conv_opts, $sim_opts) = @$regress;
+	printf "| %-12s | %-37s | ", $test, $conv_opts;
+	my $binu = $test_path . $test . ".bin";
+	my $binc = $test_path . $test . ".comp.bin";
+	my $datau = $test_path . $test . ".data.bin";
+	my $datac = $test_path . $test . ".comp.data.bin";
+
+	my $excu = exc_vector($binu, "");
+	my $outu = `$sim -n 10000 $excu $binu $datau`;
+
+	`$conv $conv_opts -d $datau -D $datac $binu $binc`;
+
+	my $excc = exc_vector($binc, $sim_opts);
+	my $outc = `$sim $sim_opts -n 10000 $excc $binc $datac`;
+
+	print $outu eq $ref_out ? "s " : "f ";
+	print $outc eq $ref_out ? "s |\n" : "f |\n";
+}